@@ -0,0 +1,99 @@
+// Parse and evaluate a large generated program: parse throughput, the size
+// of the tree, the time to free it, and evaluation speed over a tree much
+// larger than the caches.
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "typecheck.hpp"
+#include "eval.hpp"
+#include "interpret.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// `subrs` small subroutines, then one loop whose body is `stmts` generated
+// statements calling into them, run `rounds` times
+std::string generate(int subrs, int stmts, int rounds) {
+    std::string src;
+    for (int i = 0; i < subrs; ++i) {
+        std::string n = std::to_string(i);
+        src += "subr f" + n + "(x: int): int { let a = x * " + std::to_string(i % 7 + 2) + " - " + n +
+               "; if (a > 100) { a = a / 3; } else { a = a + 1; } return a; }\n";
+    }
+    src += "{ let s = 0; let k = 0; while (k < " + std::to_string(rounds) + ") {\n";
+    for (int i = 0; i < stmts; ++i) {
+        std::string n = std::to_string(i);
+        switch (i % 4) {
+            case 0: src += "  s = s + (k * " + n + " - 7) / 3;\n"; break;
+            case 1: src += "  if (s > 100000) { s = s - 99991; } else { s += " + n + "; }\n"; break;
+            case 2: src += "  s = s + f" + std::to_string(i % subrs) + "(k);\n"; break;
+            default: src += "  check (s - s / 4 * 4) only case 0: s += 1; case 1: s -= 1; then s += 2;\n"; break;
+        }
+    }
+    src += "  k++; } s = s; }\n";
+    return src;
+}
+
+} // namespace
+
+int main() {
+    const std::string src = generate(2000, 20000, 20);
+    const double mb = src.size() / 1e6;
+
+    // Parsing only: the whole program into one arena, then freed
+    double parse_secs = 1e9, free_secs = 1e9;
+    std::size_t node_count = 0, bytes = 0;
+    for (int rep = 0; rep < 5; ++rep) {
+        auto start = Clock::now();
+        {
+            AstArena arena;
+            Lexer lex(src);
+            Parser parser(lex, arena);
+            while (parser.parse()) {}
+            double secs = since(start);
+            if (secs < parse_secs) parse_secs = secs;
+            node_count = arena.nodes();
+            bytes = arena.bytes();
+            start = Clock::now();
+        }
+        double secs = since(start);
+        if (secs < free_secs) free_secs = secs;
+    }
+    std::printf("source      %8.2f MB  %zu nodes, %.1f bytes/node\n", mb, node_count, double(bytes) / node_count);
+    std::printf("parse       %8.2f ms  %6.1f MB/s  %6.2f M nodes/s\n", parse_secs * 1e3, mb / parse_secs,
+                node_count / parse_secs / 1e6);
+    std::printf("free        %8.2f ms\n", free_secs * 1e3);
+
+    // Resolve and run every top-level node
+    AstArena arena;
+    Lexer lex(src);
+    Parser parser(lex, arena);
+    std::vector<Node*> nodes;
+    while (Node* node = parser.parse()) {
+        Resolver().resolve(node);
+        TypeChecker().check(node);
+        nodes.push_back(node);
+    }
+    // Each round calls the same subroutines with the same k several times,
+    // which the memo cache would answer instead of running them
+    EvalRuntime::memo_mode = MemoMode::Off;
+    EvalRuntime runtime;
+    runtime.push_scope();
+    Evaluator evaluator(runtime);
+    auto start = Clock::now();
+    Value result;
+    for (Node* n : nodes) result = evaluator.eval(n);
+    double eval_secs = since(start);
+    std::printf("eval        %8.2f ms  %6.2f M stmts/s  (result %s)\n", eval_secs * 1e3, 20000 * 20 / eval_secs / 1e6,
+                result.toString().c_str());
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Lexing throughput on multi-megabyte inputs, from a string in memory and
+// from a memory-mapped file.
+#include "lexer.hpp"
+#include "source.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// A mix of declarations, expressions, literals and keywords, ~`bytes` long
+std::string generate(std::size_t bytes) {
+    std::string src;
+    for (int i = 0; src.size() < bytes; ++i) {
+        std::string n = std::to_string(i);
+        src += "subr step" + n + "(x: int, y: double): int {\n"
+               "    let total: int = x * " + n + " + 42;\n"
+               "    let name = \"value " + n + "\\n\";\n"
+               "    while (total >= 1000 && y != 0.5) { total -= 17; y = y / 2.0; }\n"
+               "    check (total) only case 0: total++; case 1: total += 'a'; then total = ~total | 3;\n"
+               "    if (!(total < x)) { return total; } else { return step" + n + "(x - 1, y); }\n"
+               "}\n";
+    }
+    return src;
+}
+
+// Keywords and operators with short identifiers: stresses keyword lookup
+// and the operator scanner rather than literals
+std::string generate_dense(std::size_t bytes) {
+    std::string src;
+    while (src.size() < bytes) {
+        src += "if (a <= b && c != d || !e) { a += b; b -= c; c *= d; d /= 2; } else { a = b ** c; }\n"
+               "while (x >= y) { x--; y++; x &= y; y |= x; x ^= ~y; } return a -> b :: c ? d ?. e : f;\n"
+               "check (k) only case 1: break; on case 2: continue; then recheck; let z: int = $a.b;\n"
+               "const bool t = true == false; subr f(v: long): short { return sizeof v; }\n";
+    }
+    return src;
+}
+
+// Rows of integer and decimal literals, as in generated data tables
+std::string generate_numeric(std::size_t bytes) {
+    std::string src;
+    for (int i = 0; src.size() < bytes; ++i) {
+        src += "row = ";
+        for (int j = 0; j < 8; ++j) {
+            int k = i * 8 + j;
+            src += std::to_string(k * 7919 % 1000003) + " + " +
+                   std::to_string(k % 1000) + "." + std::to_string(k * 31 % 100000) + (j < 7 ? " + " : ";\n");
+        }
+    }
+    return src;
+}
+
+// Best of five runs over `src`; returns seconds and counts the tokens
+double lex_all(std::string_view src, std::size_t& tokens) {
+    double best = 1e9;
+    for (int rep = 0; rep < 5; ++rep) {
+        auto start = Clock::now();
+        Lexer lex(src);
+        std::size_t n = 0;
+        while (lex.current.type != TokenType::End) {
+            lex.current = lex.get_next_token();
+            ++n;
+        }
+        double secs = std::chrono::duration<double>(Clock::now() - start).count();
+        if (secs < best) best = secs;
+        tokens = n;
+    }
+    return best;
+}
+
+void report(const char* name, std::string_view src) {
+    std::size_t tokens = 0;
+    double secs = lex_all(src, tokens);
+    double mb = src.size() / 1e6;
+    std::printf("%-16s %6.1f MB  %8.1f MB/s  %6.1f M tokens/s\n", name, mb, mb / secs, tokens / secs / 1e6);
+}
+
+} // namespace
+
+int main() {
+    std::printf("sizeof(Token) = %zu\n", sizeof(Token));
+    const std::string src = generate(8 << 20);
+    report("string_view", src);
+    report("dense", generate_dense(8 << 20));
+    report("numeric", generate_numeric(8 << 20));
+
+    const char* path = "build/bench/lexer_bench.lk";
+    if (std::FILE* f = std::fopen(path, "wb")) {
+        std::fwrite(src.data(), 1, src.size(), f);
+        std::fclose(f);
+        MappedFile file(path);
+        report("mmap", file.view());
+        std::remove(path);
+    }
+    return 0;
+}
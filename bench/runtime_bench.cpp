@@ -0,0 +1,164 @@
+// Evaluator benchmark: calls/s for deep recursion and iterations/s for hot
+// loops, with the number of heap allocations each one performs.
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "typecheck.hpp"
+#include "optimizer.hpp"
+#include "eval.hpp"
+#include "interpret.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+unsigned long allocations = 0;
+}
+
+void* operator new(std::size_t n) {
+    ++allocations;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Program {
+    AstArena arena;
+    std::vector<Node*> nodes;
+};
+
+void load(Program& prog, const std::string& src, bool optimize = false) {
+    Lexer lex(src);
+    Parser parser(lex, prog.arena);
+    while (Node* node = parser.parse()) {
+        Resolver().resolve(node);
+        TypeChecker().check(node);
+        if (optimize) Optimizer().optimize(node, prog.arena);
+        prog.nodes.push_back(node);
+    }
+}
+
+// Runs `setup` once, then times `hot`; `units` is how many calls or loop
+// iterations one run of `hot` performs. `optimize` runs the -O pass on `hot`.
+void run(const char* name, const char* unit, const std::string& setup, const std::string& hot, double units,
+         bool optimize = false) {
+    EvalRuntime runtime;
+    runtime.push_scope();
+    Evaluator evaluator(runtime);
+    Program prelude, body;
+    load(prelude, setup);
+    for (Node* n : prelude.nodes) evaluator.eval(n);
+    load(body, hot, optimize);
+
+    unsigned long before = allocations;
+    auto start = Clock::now();
+    Value result;
+    for (Node* n : body.nodes) result = evaluator.eval(n);
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+    unsigned long allocs = allocations - before;
+
+    std::printf("%-20s %10.0f %s/s %8.2f allocs/%s  (result %s)\n",
+                name, units / secs, unit, allocs / units, unit, result.toString().c_str());
+}
+
+} // namespace
+
+int main() {
+    // The call benchmarks measure calls, not cache lookups
+    EvalRuntime::memo_mode = MemoMode::Off;
+    run("fib(24)", "call",
+        "let r = 0;\n"
+        "subr fib(n: int): int { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }\n",
+        "r = fib(24);\n",
+        2 * 75025.0 - 1); // fib(24) makes 2*fib(25)-1 calls
+
+    run("factorial(12) x 20k", "call",
+        "let r = 0;\n"
+        "subr factorial(n: int): int { if (n < 2) { return 1; } return n * factorial(n - 1); }\n",
+        "{ let i = 0; while (i < 20000) { r = factorial(12); i++; } }\n",
+        20000.0 * 12);
+
+    run("depth-2000 recursion", "call",
+        "let r = 0;\n"
+        "subr down(n: int): int { if (n < 1) { return 0; } return 1 + down(n - 1); }\n",
+        "{ let i = 0; while (i < 50) { r = down(2000); i++; } }\n",
+        50 * 2001.0);
+
+    // Every call is a tail call: one frame, however deep the recursion
+    run("tail-call loop 1M", "call",
+        "let r = 0;\n"
+        "subr count(n: int, acc: int): int { if (n < 1) { return acc; } return count(n - 1, acc + 1); }\n",
+        "r = count(1000000, 0);\n",
+        1000001.0);
+
+    // Pure, so memoized: 25 calls compute, 22 are answered by the table
+    EvalRuntime::memo_mode = MemoMode::Auto;
+    run("fib(24) memo", "call",
+        "let r = 0;\n"
+        "subr fib(n: int): int { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }\n",
+        "r = fib(24);\n",
+        47.0);
+    // Pure but never called twice alike: the table gives up after 1024 misses
+    run("pure, no repeats", "call",
+        "let r = 0;\n"
+        "subr sq(n: int): int { return n * n; }\n",
+        "{ let i = 0; while (i < 200000) { r = sq(i); i++; } }\n",
+        200000.0);
+    EvalRuntime::memo_mode = MemoMode::Off;
+    run("pure, memo off", "call",
+        "let r = 0;\n"
+        "subr sq(n: int): int { return n * n; }\n",
+        "{ let i = 0; while (i < 200000) { r = sq(i); i++; } }\n",
+        200000.0);
+
+    run("while loop 1M", "iter",
+        "let r = 0;\n",
+        "{ let i = 0; let s = 0; while (i < 1000000) { s += 3; i++; } r = s; }\n",
+        1000000.0);
+
+    run("arith-heavy loop", "iter",
+        "let r = 0;\n",
+        "{ let i = 0; let s = 0; while (i < 500000) { s = (s + i * 3) / 2 - i; i++; } r = s; }\n",
+        500000.0);
+
+    const char* const_loop =
+        "{ let i = 0; let s = 0; while (i < 500000) { s = s + (60 * 60 * 24) / (2 + 2); if (!(i < 0)) { s -= 21600; } i++; } r = s; }\n";
+    run("constant subexprs", "iter", "let r = 0;\n", const_loop, 500000.0);
+    run("constant subexprs -O", "iter", "let r = 0;\n", const_loop, 500000.0, true);
+
+    run("loop w/ block decl", "iter",
+        "let r = 0;\n",
+        "{ let i = 0; while (i < 500000) { let a = i; let b = a * 2; r = b; i++; } }\n",
+        500000.0);
+
+    // A 32-state machine: literal arms dispatch through a table
+    std::string int_arms, str_arms;
+    for (int k = 0; k < 32; ++k) {
+        int_arms += "case " + std::to_string(k) + ": s += " + std::to_string(k + 1) + "; ";
+        str_arms += "case \"s" + std::to_string(k) + "\": s += " + std::to_string(k + 1) + "; ";
+    }
+    run("check, 32 int arms", "iter",
+        "let r = 0;\n",
+        "{ let i = 0; let s = 0; while (i < 200000) { check (i & 31) only " + int_arms + "then s = 0; i++; } r = s; }\n",
+        200000.0);
+    run("check, 32 string arms", "iter",
+        "let r = 0;\nlet k = \"s31\";\n",
+        "{ let i = 0; let s = 0; while (i < 200000) { check (k) only " + str_arms + "then s = 0; i++; } r = s; }\n",
+        200000.0);
+
+    // Typed declarations run as a store plus the TypeChecker's conversion
+    run("loop w/ typed decl", "iter",
+        "let r = 0;\n",
+        "{ let i = 0; while (i < 500000) { let a: int = i; let b: float = 2; let c: double = a; r = a; i++; } }\n",
+        500000.0);
+
+    return 0;
+}
@@ -0,0 +1,339 @@
+// Benchmark suite over the programs in bench/corpus plus a large generated
+// source: lexer MB/s, parser nodes/s, nodes/s loaded from the program cache,
+// evaluator ops/s, peak RSS and heap allocations per program, written as
+// JSON.
+//
+// Each corpus program sets a global `ops` to the number of operations (loop
+// iterations or calls) it performs, which the evaluator rate is based on.
+// Every program runs in a child process of its own, so its peak RSS is its
+// own.
+//
+//   suite_bench [--corpus=DIR] [--out=FILE] [--baseline=FILE] [--threshold=PCT]
+//
+// With --baseline, each result is compared with the same program's entry in
+// a file an earlier run wrote with --out: a rate lower, or a peak RSS or
+// allocation count higher, by more than PCT percent (default 10) is reported
+// as a regression and the exit status is 1.
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "typecheck.hpp"
+#include "eval.hpp"
+#include "interpret.hpp"
+#include "source.hpp"
+#include "cache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+unsigned long allocations = 0;
+}
+
+void* operator new(std::size_t n) {
+    ++allocations;
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Short phases are repeated until they have run this long
+constexpr double kMinPhaseSecs = 0.1;
+
+struct Result {
+    std::string name;
+    double lexer_mb_s = 0;
+    double parser_nodes_s = 0;
+    double cache_nodes_s = 0;
+    double eval_ops_s = 0;
+    long peak_rss_kb = 0;
+    unsigned long allocs = 0; // during evaluation
+};
+
+// The metrics compared with a baseline; `higher` if more is better
+struct Metric {
+    const char* key;
+    bool higher;
+};
+constexpr Metric kMetrics[] = {
+    {"lexer_mb_s", true}, {"parser_nodes_s", true}, {"cache_nodes_s", true}, {"eval_ops_s", true},
+    {"peak_rss_kb", false}, {"allocs", false},
+};
+
+double metric(const Result& r, const std::string& key) {
+    if (key == "lexer_mb_s") return r.lexer_mb_s;
+    if (key == "parser_nodes_s") return r.parser_nodes_s;
+    if (key == "cache_nodes_s") return r.cache_nodes_s;
+    if (key == "eval_ops_s") return r.eval_ops_s;
+    if (key == "peak_rss_kb") return double(r.peak_rss_kb);
+    return double(r.allocs);
+}
+
+std::string to_json(const Result& r) {
+    char buf[512];
+    std::snprintf(buf, sizeof buf,
+                  "{\"name\": \"%s\", \"lexer_mb_s\": %.2f, \"parser_nodes_s\": %.0f, \"cache_nodes_s\": %.0f, "
+                  "\"eval_ops_s\": %.0f, \"peak_rss_kb\": %ld, \"allocs\": %lu}",
+                  r.name.c_str(), r.lexer_mb_s, r.parser_nodes_s, r.cache_nodes_s, r.eval_ops_s, r.peak_rss_kb,
+                  r.allocs);
+    return buf;
+}
+
+// Reads back one line to_json wrote
+bool from_json(const std::string& line, Result& r) {
+    auto field = [&](const std::string& key) -> std::string {
+        std::size_t at = line.find("\"" + key + "\": ");
+        if (at == std::string::npos) return {};
+        at += key.size() + 4;
+        if (line[at] == '"') return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+        return line.substr(at, line.find_first_of(",}", at) - at);
+    };
+    r.name = field("name");
+    if (r.name.empty()) return false;
+    r.lexer_mb_s = std::atof(field("lexer_mb_s").c_str());
+    r.parser_nodes_s = std::atof(field("parser_nodes_s").c_str());
+    r.cache_nodes_s = std::atof(field("cache_nodes_s").c_str());
+    r.eval_ops_s = std::atof(field("eval_ops_s").c_str());
+    r.peak_rss_kb = std::atol(field("peak_rss_kb").c_str());
+    r.allocs = std::strtoul(field("allocs").c_str(), nullptr, 10);
+    return true;
+}
+
+// `subrs` small subroutines and one top-level call of each, `rounds` times:
+// a source of a few megabytes with an op per call
+std::string generate(int subrs, int rounds) {
+    std::string src = "let ops = " + std::to_string(subrs * rounds) + ";\nlet r = 0;\n";
+    for (int i = 0; i < subrs; ++i) {
+        std::string n = std::to_string(i);
+        src += "subr f" + n + "(x: int): int { let a = x * " + std::to_string(i % 7 + 2) + " - " + n +
+               "; if (a > 100) { a = a / 3; } else { a = a + 1; } check (a) only case 0: a++; case 1: a--; "
+               "then a += 2; return a; }\n";
+    }
+    for (int k = 0; k < rounds; ++k) {
+        for (int i = 0; i < subrs; ++i)
+            src += "r = f" + std::to_string(i) + "(r - " + std::to_string(k) + ");\n";
+    }
+    return src;
+}
+
+Result measure(const std::string& name, std::string_view src) {
+    Result r;
+    r.name = name;
+
+    std::size_t reps = 0;
+    auto start = Clock::now();
+    do {
+        Lexer lex(src);
+        while (lex.current.type != TokenType::End) lex.current = lex.get_next_token();
+        ++reps;
+    } while (since(start) < kMinPhaseSecs);
+    r.lexer_mb_s = src.size() * reps / 1e6 / since(start);
+
+    std::size_t nodes = 0;
+    reps = 0;
+    start = Clock::now();
+    do {
+        AstArena arena;
+        Lexer lex(src);
+        Parser parser(lex, arena);
+        while (parser.parse()) {}
+        nodes += arena.nodes();
+        ++reps;
+    } while (since(start) < kMinPhaseSecs);
+    r.parser_nodes_s = nodes / since(start);
+
+    char cache[] = "/tmp/suite_bench_XXXXXX";
+    int fd = mkstemp(cache);
+    if (fd < 0) throw std::runtime_error("cannot create a cache file");
+    close(fd);
+    {
+        AstArena arena;
+        Lexer lex(src);
+        Parser parser(lex, arena);
+        CacheWriter writer;
+        while (Node* node = parser.parse()) writer.add(node);
+        writer.save(cache, src);
+    }
+    nodes = 0;
+    reps = 0;
+    start = Clock::now();
+    do {
+        AstArena arena;
+        std::vector<Node*> program;
+        if (!load_cache(cache, src, arena, program)) {
+            std::remove(cache);
+            throw std::runtime_error("cannot load its cache");
+        }
+        nodes += arena.nodes();
+        ++reps;
+    } while (since(start) < kMinPhaseSecs);
+    r.cache_nodes_s = nodes / since(start);
+    std::remove(cache);
+
+    AstArena arena;
+    Lexer lex(src);
+    Parser parser(lex, arena);
+    std::vector<Node*> program;
+    while (Node* node = parser.parse()) {
+        Resolver().resolve(node);
+        TypeChecker().check(node);
+        program.push_back(node);
+    }
+    EvalRuntime runtime;
+    runtime.push_scope();
+    Evaluator evaluator(runtime);
+    unsigned long before = allocations;
+    start = Clock::now();
+    for (Node* node : program) evaluator.eval(node);
+    double secs = since(start);
+    r.allocs = allocations - before;
+    Value ops = runtime.get_var(intern("ops"));
+    if (ops.type != ValueType::INT) throw std::runtime_error(name + " does not set an int `ops`");
+    r.eval_ops_s = ops.get<int>() / secs;
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    r.peak_rss_kb = usage.ru_maxrss;
+    return r;
+}
+
+// Runs measure(name, load()) in a child process and reads back its result
+template <typename Load>
+bool run_isolated(const std::string& name, Load load, Result& out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(fds[0]);
+        int status = 0;
+        std::string line;
+        try {
+            line = to_json(measure(name, load())) + "\n";
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "suite_bench: %s: %s\n", name.c_str(), e.what());
+            status = 1;
+        }
+        if (write(fds[1], line.data(), line.size()) != ssize_t(line.size())) status = 1;
+        _exit(status);
+    }
+    close(fds[1]);
+    std::string line;
+    char buf[512];
+    for (ssize_t n; (n = read(fds[0], buf, sizeof buf)) > 0;) line.append(buf, std::size_t(n));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && from_json(line, out);
+}
+
+std::vector<std::string> corpus_files(const std::string& dir) {
+    std::vector<std::string> files;
+    if (DIR* d = opendir(dir.c_str())) {
+        while (dirent* e = readdir(d)) {
+            std::string name = e->d_name;
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, ".lk") == 0) files.push_back(name);
+        }
+        closedir(d);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Prints the regressions of `results` against `path`; false if there are any
+bool compare(const std::vector<Result>& results, const std::string& path, double threshold) {
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "suite_bench: cannot read baseline %s\n", path.c_str());
+        return false;
+    }
+    std::vector<Result> baseline;
+    for (std::string line; std::getline(in, line);) {
+        Result r;
+        if (from_json(line, r)) baseline.push_back(r);
+    }
+    bool ok = true;
+    for (const Result& now : results) {
+        auto old = std::find_if(baseline.begin(), baseline.end(), [&](const Result& b) { return b.name == now.name; });
+        if (old == baseline.end()) continue; // new program: nothing to compare
+        for (const Metric& m : kMetrics) {
+            double before = metric(*old, m.key), after = metric(now, m.key);
+            if (before <= 0) continue;
+            double change = (after - before) / before * 100;
+            if (m.higher ? change < -threshold : change > threshold) {
+                std::fprintf(stderr, "regression: %s %s %.6g -> %.6g (%+.1f%%)\n", now.name.c_str(), m.key, before,
+                             after, change);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string corpus = "bench/corpus", out, baseline;
+    double threshold = 10;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--corpus=", 0) == 0) corpus = arg.substr(9);
+        else if (arg.rfind("--out=", 0) == 0) out = arg.substr(6);
+        else if (arg.rfind("--baseline=", 0) == 0) baseline = arg.substr(11);
+        else if (arg.rfind("--threshold=", 0) == 0) threshold = std::atof(arg.c_str() + 12);
+        else {
+            std::fprintf(stderr, "usage: suite_bench [--corpus=DIR] [--out=FILE] [--baseline=FILE] [--threshold=PCT]\n");
+            return 64;
+        }
+    }
+
+    // The call-heavy programs measure calls, not cache lookups
+    EvalRuntime::memo_mode = MemoMode::Off;
+
+    std::vector<Result> results;
+    bool ok = true;
+    auto add = [&](const std::string& name, auto load) {
+        Result r;
+        if (run_isolated(name, load, r)) results.push_back(r);
+        else ok = false;
+    };
+    for (const std::string& file : corpus_files(corpus)) {
+        std::string path = corpus + "/" + file;
+        add(file.substr(0, file.size() - 3), [path] {
+            MappedFile mapped(path);
+            return std::string(mapped.view());
+        });
+    }
+    add("generated", [] { return generate(2000, 20); });
+
+    std::ostringstream json;
+    json << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i)
+        json << "  " << to_json(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+    json << "]\n";
+    std::fputs(json.str().c_str(), stdout);
+    if (!out.empty()) std::ofstream(out) << json.str();
+
+    if (!baseline.empty() && !compare(results, baseline, threshold)) ok = false;
+    return ok ? 0 : 1;
+}
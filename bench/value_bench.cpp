@@ -0,0 +1,72 @@
+// Value microbenchmark: copy, construction and arithmetic throughput.
+// Only uses the public Value API so it builds against any Value layout.
+#include "value.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps results observable so the optimizer cannot drop the loops.
+volatile long sink;
+
+template <typename F>
+void run(const char* name, long iters, F&& body) {
+    auto start = Clock::now();
+    body(iters);
+    double secs = std::chrono::duration<double>(Clock::now() - start).count();
+    std::printf("%-22s %8.2f ns/op %10.2f Mops/s\n", name, secs * 1e9 / iters, iters / secs / 1e6);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    long iters = argc > 1 ? std::stol(argv[1]) : 20000000;
+    std::printf("sizeof(Value) = %zu\n", sizeof(Value));
+
+    run("construct int", iters, [](long n) {
+        long acc = 0;
+        for (long i = 0; i < n; ++i) {
+            Value v(static_cast<int>(i));
+            acc += v.get<int>();
+        }
+        sink = acc;
+    });
+
+    run("copy int", iters, [](long n) {
+        std::vector<Value> src(64, Value(7)), dst(64);
+        for (long i = 0; i < n; ++i) dst[i & 63] = src[i & 63];
+        sink = dst[0].get<int>();
+    });
+
+    run("copy string", iters / 4, [](long n) {
+        std::vector<Value> src(64, Value(std::string("a string that does not fit in SSO"))), dst(64);
+        for (long i = 0; i < n; ++i) dst[i & 63] = src[i & 63];
+        sink = static_cast<long>(dst[0].get<std::string>().size());
+    });
+
+    run("int add/mul", iters, [](long n) {
+        Value acc(0), one(1), three(3);
+        for (long i = 0; i < n; ++i) acc = (acc + one) * three - acc * Value(2);
+        sink = acc.get<int>();
+    });
+
+    run("double add", iters, [](long n) {
+        Value acc(0.0), step(0.5);
+        for (long i = 0; i < n; ++i) acc = acc + step;
+        sink = static_cast<long>(acc.get<double>());
+    });
+
+    run("int compare", iters, [](long n) {
+        std::vector<Value> vals;
+        for (int i = 0; i < 64; ++i) vals.push_back(Value(i % 7));
+        long hits = 0;
+        for (long i = 0; i < n; ++i) hits += (vals[i & 63] < vals[(i + 1) & 63]) + (vals[i & 63] == vals[(i + 3) & 63]);
+        sink = hits;
+    });
+
+    return 0;
+}
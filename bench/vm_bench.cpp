@@ -0,0 +1,97 @@
+// Tree-walking evaluator vs bytecode VM on the same programs: time per run
+// of each engine and the VM's speedup.
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "typecheck.hpp"
+#include "eval.hpp"
+#include "interpret.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<Node*> load(AstArena& arena, const std::string& src) {
+    std::vector<Node*> nodes;
+    Lexer lex(src);
+    Parser parser(lex, arena);
+    while (Node* node = parser.parse()) {
+        Resolver().resolve(node);
+        TypeChecker().check(node);
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+// Runs every top-level node of `src` on one engine; `hot` is the index of
+// the node that is timed, everything before it is setup. The hot node runs
+// kRuns times and the fastest run counts, which keeps one noisy run out of
+// the ratio.
+constexpr int kRuns = 7;
+
+template <typename Run>
+double time_engine(const std::vector<Node*>& nodes, size_t hot, Run&& run, std::string& result) {
+    for (size_t i = 0; i < hot; ++i) run(nodes[i]);
+    double best = 1e9;
+    for (int r = 0; r < kRuns; ++r) {
+        auto start = Clock::now();
+        result = run(nodes[hot]).toString();
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    return best;
+}
+
+void compare(const char* name, const std::string& setup, const std::string& hot) {
+    AstArena arena;
+    auto nodes = load(arena, setup + hot);
+    size_t hot_index = nodes.size() - 1;
+
+    EvalRuntime runtime;
+    runtime.push_scope();
+    Evaluator evaluator(runtime);
+    std::string eval_result;
+    double eval_secs = time_engine(nodes, hot_index, [&](const Node* n) { return evaluator.eval(n); }, eval_result);
+
+    VM vm;
+    std::string vm_result;
+    double vm_secs = time_engine(nodes, hot_index, [&](const Node* n) { return vm.run(n); }, vm_result);
+
+    std::printf("%-22s eval %8.2f ms  vm %8.2f ms  %5.1fx%s\n", name, eval_secs * 1e3, vm_secs * 1e3,
+                eval_secs / vm_secs, eval_result == vm_result ? "" : "  (results differ!)");
+}
+
+} // namespace
+
+int main() {
+    // Both engines make every call: a memoized evaluator would answer the
+    // recursive rows from its cache
+    EvalRuntime::memo_mode = MemoMode::Off;
+
+    compare("fib(24)",
+            "subr fib(n: int): int { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }\n",
+            "{ let r = fib(24); r = r; }\n");
+
+    compare("factorial(12) x 20k",
+            "subr factorial(n: int): int { if (n < 2) { return 1; } return n * factorial(n - 1); }\n",
+            "{ let r = 0; let i = 0; while (i < 20000) { r = factorial(12); i++; } r = r; }\n");
+
+    compare("while loop 1M", "",
+            "{ let i = 0; let s = 0; while (i < 1000000) { s += 3; i++; } s = s; }\n");
+
+    compare("double loop 1M", "",
+            "{ let i = 0; let x = 0.0d; while (i < 1000000) { x = x * 0.5d + 1.0d; i++; } x = x; }\n");
+
+    compare("loop w/ block decl", "",
+            "{ let r = 0; let i = 0; while (i < 500000) { let a = i; let b = a * 2; r = b; i++; } r = r; }\n");
+
+    compare("check in loop", "",
+            "{ let i = 0; let s = 0; while (i < 300000) { check (i - i / 3 * 3) only case 0: s += 1; case 1: s += 2; then s += 3; i++; } s = s; }\n");
+
+    return 0;
+}
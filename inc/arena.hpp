@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Storage for the nodes of one compilation. Nodes are bump-allocated into
+// large chunks in the order the parser creates them, so a tree (and the
+// statements of a block) sit next to each other in memory, and everything
+// is released at once when the arena goes away. Children point straight at
+// other nodes in the same arena; nothing frees a node on its own.
+//
+// Most node types are trivially destructible. The few that own a string,
+// vector or Value are remembered and destroyed when the arena is, so the
+// teardown cost is one pass over those plus one free per chunk.
+class AstArena {
+public:
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+    ~AstArena() { clear(); }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned node");
+        T* node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>)
+            finalizers.push_back({node, [](void* p) { static_cast<T*>(p)->~T(); }});
+        ++count;
+        return node;
+    }
+
+    // Destroys every node; the arena can be reused afterwards
+    void clear();
+
+    // Where the arena stands now. release() destroys the nodes made since,
+    // and the next ones reuse their memory; nodes made before stay.
+    struct Mark {
+        std::size_t chunks = 0, finalizers = 0, count = 0, used = 0;
+        std::byte* next = nullptr;
+        std::byte* end = nullptr;
+    };
+    Mark mark() const { return {chunks.size(), finalizers.size(), count, used, next, end}; }
+    void release(const Mark& m);
+
+    std::size_t nodes() const { return count; }
+    std::size_t bytes() const { return used; }
+
+private:
+    static constexpr std::size_t kChunkSize = 64 * 1024;
+
+    struct Finalizer {
+        void* node;
+        void (*destroy)(void*);
+    };
+
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+    std::vector<Finalizer> finalizers;
+    std::byte* next = nullptr;
+    std::byte* end = nullptr;
+    std::size_t count = 0;
+    std::size_t used = 0;
+
+    void* allocate(std::size_t size, std::size_t align);
+};
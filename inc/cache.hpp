@@ -0,0 +1,77 @@
+#pragma once
+#include "arena.hpp"
+#include "node.hpp"
+#include "symbol.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct Expr;
+struct Stmt;
+struct Decl;
+struct CheckArms;
+struct Value;
+
+// Compiled-program cache for `toy run`. The top-level trees of a script are
+// written, as the parser built them, to a compact binary file that is mapped
+// and turned back into nodes on the next run instead of lexing and parsing
+// the source again. The Resolver, TypeChecker and optimizer still run on
+// the loaded trees, so the file holds nothing that depends on the options
+// or on state they fill in.
+//
+// A cache file is used only if it was written from the same bytes of source
+// (a 64-bit hash plus the length) by the same build (cache_build_key);
+// anything else, including a damaged file, counts as a miss and the source
+// is parsed as usual. Symbol ids differ between processes, so the file
+// carries the names it uses and they are interned again on load.
+
+// Identifies the running build: a hash of the executable's size and
+// modification time, so every relink invalidates older caches without
+// anyone having to bump a version, and the node layouts' sizes. Where the
+// executable cannot be found, the time this file was compiled stands in.
+std::uint32_t cache_build_key();
+
+std::uint64_t source_hash(std::string_view source);
+
+// Where the cache of the script at `source_path` lives: next to it with a
+// trailing `c` (script.lk -> script.lkc), or, if `dir` is not empty, in
+// `dir` under a name derived from the script's absolute path
+std::string cache_path(const std::string& source_path, const std::string& dir);
+
+// Collects the trees of one script as they are parsed
+class CacheWriter {
+public:
+    // Call before anything rewrites `tree`
+    void add(const Node* tree);
+
+    // Writes the trees added so far for `source` to `path` through a temporary
+    // file and a rename, so a reader never sees half a file, making the
+    // directory `path` is in if it does not exist. A failure only
+    // means there is no cache next time; returns false then.
+    bool save(const std::string& path, std::string_view source) const;
+
+private:
+    std::string body;                  // the encoded trees
+    std::vector<Symbol> names;         // by index in the file
+    std::unordered_map<Symbol, std::uint32_t> indexes;
+    std::uint32_t trees = 0;
+    std::uint32_t last_offset = 0; // offsets are stored as differences
+    bool ok = true; // false once a tree held something the format cannot
+
+    void node(const Node* n);
+    void expr(const Expr* e);
+    void stmt(const Stmt* s);
+    void decl(const Decl* d);
+    void arms(const CheckArms& a);
+    void value(const Value& v);
+    void offset(std::uint32_t at);
+    void symbol(Symbol s);
+    void uint(std::uint64_t n);
+    void bytes(const void* p, std::size_t n) { body.append(static_cast<const char*>(p), n); }
+};
+
+// Rebuilds in `arena` the trees the cache at `path` holds for `source` and
+// appends them to `program`; false, with `program` as it was, on a miss
+bool load_cache(const std::string& path, std::string_view source, AstArena& arena, std::vector<Node*>& program);
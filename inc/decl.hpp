@@ -1,66 +1,73 @@
 #pragma once
 #include "node.hpp"
-#include <string>
+#include "symbol.hpp"
+#include "value.hpp"
 #include <vector>
-#include <memory>
 #include <utility>
 
 // Forward declarations to avoid circular includes between decl.hpp and stmt.hpp
 struct Expr;
 struct Stmt;
 
-enum class DeclKind { Var, Subr, Struct, Enum, Union, Tool, Kit };
+enum class DeclKind : std::uint8_t { Var, Subr, Struct, Enum, Union, Tool, Kit };
 
 struct Decl : Node {
     DeclKind kind;
     explicit Decl(DeclKind k) : Node(NodeType::Decl), kind(k) { }
-    virtual ~Decl() = default;
 };
 
 struct VarDecl : Decl {
-    std::string name;
-    std::string type_name; 
-    std::unique_ptr<Expr> init;
-    VarDecl(std::string n, std::string t, std::unique_ptr<Expr> i)
-        : Decl(DeclKind::Var), name(std::move(n)), type_name(std::move(t)), init(std::move(i)) {}
+    Symbol name;
+    Symbol type_name; 
+    Expr* init;
+    TypeSlot slot; // set by the TypeChecker
+    // Slot in its block's scope, set by the Resolver; -1 for REPL globals
+    // and redeclarations, which are checked by name at run time
+    int local = -1;
+    VarDecl(Symbol n, Symbol t, Expr* i)
+        : Decl(DeclKind::Var), name(n), type_name(t), init(i) {}
 };
 
 struct SubrDecl : Decl {
-    std::string name;
-    std::string return_type;
-    std::vector<std::pair<std::string, std::string>> params;
-    std::unique_ptr<Stmt> body;
-    SubrDecl(std::string n, std::string rt)
-        : Decl(DeclKind::Subr), name(std::move(n)), return_type(std::move(rt)) {}
+    Symbol name;
+    Symbol return_type;
+    std::vector<std::pair<Symbol, Symbol>> params;
+    Stmt* body = nullptr;
+    bool memo = false; // `memo subr`: cache results even if not provably pure
+    // Set by the TypeChecker: what each parameter and the result accept
+    std::vector<TypeSlot> param_types;
+    TypeSlot ret;
+    SubrDecl(Symbol n, Symbol rt)
+        : Decl(DeclKind::Subr), name(n), return_type(rt) {}
 };
 
 struct StructDecl : Decl {
-    std::string name;
-    std::vector<std::pair<std::string, std::string>> fields;
-    StructDecl(std::string n) : Decl(DeclKind::Struct), name(std::move(n)) {}
+    Symbol name;
+    std::vector<std::pair<Symbol, Symbol>> fields;
+    StructDecl(Symbol n) : Decl(DeclKind::Struct), name(n) {}
 };
 
 struct EnumDecl : Decl {
-    std::string name;
-    std::vector<std::string> values;
-    EnumDecl(std::string n) : Decl(DeclKind::Enum), name(std::move(n)) {}
+    Symbol name;
+    std::vector<Symbol> values;
+    EnumDecl(Symbol n) : Decl(DeclKind::Enum), name(n) {}
 };
 
 struct UnionDecl : Decl {
-    std::string name;
-    std::vector<std::pair<std::string, std::string>> variants;
-    UnionDecl(std::string n) : Decl(DeclKind::Union), name(std::move(n)) {}
+    Symbol name;
+    std::vector<std::pair<Symbol, Symbol>> variants;
+    UnionDecl(Symbol n) : Decl(DeclKind::Union), name(n) {}
 };
 
 struct ToolDecl : Decl {
-    std::string name;
-    std::vector<std::unique_ptr<Decl>> methods;
-    ToolDecl(std::string n) : Decl(DeclKind::Tool), name(std::move(n)) {}
+    Symbol name;
+    std::vector<Decl*> methods;
+    ToolDecl(Symbol n) : Decl(DeclKind::Tool), name(n) {}
 };
 
 struct KitDecl : Decl {
-    std::string name;
-    std::vector<std::unique_ptr<Decl>> exports;
-    KitDecl(std::string n) : Decl(DeclKind::Kit), name(std::move(n)) {}
+    Symbol name;
+    std::vector<Decl*> exports;
+    KitDecl(Symbol n) : Decl(DeclKind::Kit), name(n) {}
 };
 
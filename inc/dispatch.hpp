@@ -0,0 +1,51 @@
+#pragma once
+#include "value.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CheckArms;
+
+// Constant-time arm selection for a check/recheck whose arms are all
+// literals, instead of comparing the subject with each arm in turn. A
+// subject matches an arm exactly when Value::operator== says so: same type
+// and same value. Int arms that are close together index a dense table;
+// other keys go through a hash table.
+//
+// The table owns its keys, so bytecode can keep it after the tree is gone.
+class ArmTable {
+public:
+    static constexpr std::uint32_t kNoArm = UINT32_MAX;
+    // Fewer arms than this are compared in turn: the scan is as fast
+    static constexpr std::size_t kMinArms = 4;
+
+    // nullptr unless there are at least kMinArms arms and each one is an
+    // int, short, long, bool, char or string literal (floating-point == is
+    // not an equivalence: NaN, -0.0)
+    static std::unique_ptr<ArmTable> build(const CheckArms& arms);
+
+    // Index of the first arm `subject` matches, or kNoArm
+    std::uint32_t first(const Value& subject) const;
+    // The next arm with the same value as `arm`, for `on`, or kNoArm
+    std::uint32_t next(std::uint32_t arm) const { return next_same[arm]; }
+
+private:
+    struct ScalarKey {
+        ValueType type;
+        long value;
+        bool operator==(const ScalarKey& o) const { return type == o.type && value == o.value; }
+    };
+    struct ScalarHash {
+        std::size_t operator()(const ScalarKey& k) const {
+            return std::hash<long>()(k.value) ^ (static_cast<std::size_t>(k.type) << 29);
+        }
+    };
+
+    long dense_min = 0;
+    std::vector<std::uint32_t> dense; // INT arms, when compact
+    std::unordered_map<ScalarKey, std::uint32_t, ScalarHash> scalars;
+    std::unordered_map<std::string, std::uint32_t> strings;
+    std::vector<std::uint32_t> next_same;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <stdexcept>
 #include <string>
 
@@ -43,9 +44,12 @@ struct UnderflowError : public std::runtime_error {
 struct MemoryError : public std::runtime_error {
     explicit MemoryError(const std::string& msg) : std::runtime_error(msg) {}
 };
-struct RecursionError : public std::runtime_error {                         
+struct RecursionError : public std::runtime_error {
     explicit RecursionError(const std::string& msg) : std::runtime_error(msg) {}
 };
+// Nesting of subroutine calls past which both engines raise RecursionError;
+// `--max-depth=N` overrides it. Tail calls do not nest.
+constexpr std::size_t kDefaultMaxDepth = 4000;
 struct NotImplementedError : public std::runtime_error {
     explicit NotImplementedError(const std::string& msg) : std::runtime_error(msg) {}
 };
@@ -18,11 +18,23 @@ inline void cleanup_scopes();
 #include "expr.hpp"
 #include "stmt.hpp"
 #include "decl.hpp"
+#include <cstdint>
 #include <memory>
 #include <iostream>
 
 struct EvalRuntime; // forward declaration
 
+// How a statement finished. Anything but Normal skips the rest of the
+// enclosing blocks until a loop (Break, Continue) or the subroutine call
+// (Return) takes it. TailCall is a Return whose value is still to be computed
+// by the call EvalRuntime::tail_call describes, in the returning frame.
+enum class Flow : std::uint8_t { Normal, Return, Break, Continue, TailCall };
+
+struct Completion {
+    Value value;
+    Flow flow = Flow::Normal;
+};
+
 class Evaluator {
 public:
     Evaluator() = default;
@@ -30,22 +42,38 @@ public:
     ~Evaluator() = default;
 
     Value eval(const Node* node);
+    // Runs a subroutine body: Flow::Return with what its `return` produced,
+    // Flow::TailCall, or Flow::Normal with void if it fell off the end
+    Completion eval_body(const BlockStmt* body);
 private:
     Value eval_expr(const Expr* e);
     Value eval_literal(const LiteralExpr* l);
     Value eval_ident(const IdentExpr* i);
     Value eval_binary(const BinaryExpr* b);
+    static Value eval_binary_generic(BinaryOp op, const Value& left, const Value& right);
+    // `e`'s value: a literal or variable in place, anything else evaluated into `tmp`
+    const Value& operand(const Expr* e, Value& tmp);
+    // A condition's truth, without building a Value for a comparison the
+    // operator has specialized; anything but a bool throws bad_variant_access
+    bool eval_cond(const Expr* e);
     Value eval_unary(const UnaryExpr* u);
     Value eval_call(const CallExpr* c);
-    Value eval_stmt(const Stmt* s);
+    const Subr* push_call(const CallExpr* c, size_t base, Symbol& name);
+    Completion eval_stmt(const Stmt* s);
     Value eval_expr_stmt(const ExprStmt* es);
-    Value eval_block(const BlockStmt* b);
-    Value eval_if(const IfStmt* i);
-    Value eval_while(const WhileStmt* w);
-    Value eval_for(const ForEachStmt* f);
-    Value eval_check(const CheckStmt* c);
-    Value eval_recheck(const RecheckStmt* r);
-    Value eval_return(const ReturnStmt* r);
+    Value eval_assign(const AssignStmt* a);
+    Value eval_assign_op(const AssignOpStmt* a);
+    Value eval_inc_dec(const IncDecStmt* i);
+    Completion eval_block(const BlockStmt* b);
+    // A block's declarations and statements, in the scope already on top
+    Completion eval_block_body(const BlockStmt* b);
+    Completion eval_loop_body(const Stmt* body, bool scoped);
+    Completion eval_if(const IfStmt* i);
+    Completion eval_while(const WhileStmt* w);
+    Completion eval_for(const ForEachStmt* f);
+    Completion eval_check(const CheckStmt* c);
+    Completion eval_recheck(const RecheckStmt* r);
+    Completion eval_return(const ReturnStmt* r);
     void eval_decl(const Decl* d);
     void eval_var_decl(const VarDecl* v);
     void eval_subr_decl(const SubrDecl* s);
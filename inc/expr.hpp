@@ -1,17 +1,27 @@
 #pragma once
 #include "node.hpp"
 #include "value.hpp"
+#include "ops.hpp"
+#include "symbol.hpp"
+#include <cstdint>
 #include <string>
-#include <memory>
 #include <vector>
 
 
-enum class ExprKind { Literal, Ident, Binary, Unary, Call };
+enum class ExprKind : std::uint8_t { Literal, Ident, Binary, Unary, Call };
+
+// Static address of a variable, filled in by the Resolver: `depth` scopes up
+// from the innermost one, entry `slot` within it. Unresolved references
+// (REPL globals, names from enclosing frames) fall back to lookup by name.
+struct SlotRef {
+    int depth = -1;
+    int slot = -1;
+    bool resolved() const { return slot >= 0; }
+};
 
 struct Expr : Node {
     ExprKind kind;
     explicit Expr(ExprKind k) : Node(NodeType::Expr), kind(k) { }
-    virtual ~Expr() = default;
 };
 
 // Literal numbers, strings, etc.
@@ -22,28 +32,52 @@ struct LiteralExpr : Expr {
 };
 
 struct IdentExpr : Expr {
-    std::string name;
-    IdentExpr(const std::string& n) 
+    Symbol name;
+    SlotRef ref;
+    IdentExpr(Symbol n) 
         : Expr(ExprKind::Ident), name(n) {}
 };
 
+// What a BinaryExpr has rewritten itself to in the evaluator, from the
+// operand types it has seen: int or double operands run inline, another
+// single pair of types calls its kernel directly, and a node that has seen
+// more than one pair falls back to the generic dispatch for good.
+enum class BinaryForm : std::uint8_t { Unseen, Int, Double, Mono, Generic };
+
 struct BinaryExpr : Expr {
-    std::string op;
-    std::unique_ptr<Expr> lhs, rhs;
-    BinaryExpr(const std::string& o, std::unique_ptr<Expr> l, std::unique_ptr<Expr> r)
-        : Expr(ExprKind::Binary), op(o), lhs(std::move(l)), rhs(std::move(r)) {}
+    BinaryOp op;
+    Expr* lhs;
+    Expr* rhs;
+    // Type feedback, updated by const evaluation like CallExpr's cache
+    mutable BinaryForm form = BinaryForm::Unseen;
+    mutable ValueType seen_lhs = ValueType::NONE; // Mono: the pair `kernel` is for
+    mutable ValueType seen_rhs = ValueType::NONE;
+    mutable BinaryKernel kernel = nullptr;
+    BinaryExpr(BinaryOp o, Expr* l, Expr* r)
+        : Expr(ExprKind::Binary), op(o), lhs(l), rhs(r) {}
 };
 
 struct UnaryExpr : Expr {
-    std::string op;
-    std::unique_ptr<Expr> operand;
-    UnaryExpr(const std::string& o, std::unique_ptr<Expr> e)
-        : Expr(ExprKind::Unary), op(o), operand(std::move(e)) {}
+    UnaryOp op;
+    Expr* operand;
+    UnaryExpr(UnaryOp o, Expr* e)
+        : Expr(ExprKind::Unary), op(o), operand(e) {}
+};
+
+struct Subr; // a declared subroutine as the evaluator stores it (interpret.hpp)
+
+// Inline cache of a call site for the evaluator: the subroutine the callee
+// named, valid while `epoch` matches EvalRuntime::subr_epoch, which every
+// subroutine declaration bumps.
+struct CallCache {
+    const Subr* subr = nullptr;
+    std::uint32_t epoch = 0;
 };
 
 struct CallExpr : Expr {
-    std::unique_ptr<Expr> callee;
-    std::vector<std::unique_ptr<Expr>> args;
-    CallExpr(std::unique_ptr<Expr> c, std::vector<std::unique_ptr<Expr>> a)
-        : Expr(ExprKind::Call), callee(std::move(c)), args(std::move(a)) {}
+    Expr* callee;
+    std::vector<Expr*> args;
+    mutable CallCache cache;
+    CallExpr(Expr* c, std::vector<Expr*> a)
+        : Expr(ExprKind::Call), callee(c), args(std::move(a)) {}
 };
\ No newline at end of file
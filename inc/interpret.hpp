@@ -4,65 +4,190 @@
 #include "decl.hpp"
 #include "value.hpp"
 #include "eval.hpp"
+#include "error.hpp"
+#include "purity.hpp"
+#include "stats.hpp"
+#include <cstdint>
 #include <vector>
 #include <iostream>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <cstddef>
 #include <algorithm>
 #include <variant>
 #include <memory>
 #include <cmath>
 
 struct Evaluator; // forward declaration
+class Profiler;   // profile.hpp
+
+// Results of one memoized subroutine, keyed by its argument values (equal
+// when of the same type and bit pattern, so 1 and 1.0 are different keys)
+struct MemoTable {
+    struct Entry {
+        std::vector<Value> args;
+        Value result;
+    };
+    std::unordered_multimap<std::size_t, Entry> entries; // by hash of the arguments
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+};
+
+// Which subroutines cache their results (--memo=). Annotated is the default:
+// a cache hit skips the depth checks a real call makes, so only subroutines
+// that ask for it behave differently from an uncached run.
+enum class MemoMode : std::uint8_t {
+    Off,
+    Annotated, // only `memo subr`
+    Auto,      // also every pure subroutine, while the cache keeps paying off
+};
+
+struct Subr {
+    std::vector<Symbol> params;
+    const BlockStmt* body = nullptr;
+    bool defined = false;
+    std::vector<TypeSlot> param_types; // from the TypeChecker; empty when it did not run
+    TypeSlot ret;
+    SubrEffects effects;
+    bool annotated = false; // declared `memo subr`
+    bool pure = false;      // local, and so is everything it calls
+    // Cached on the side of a const Subr, like CallExpr's cache
+    mutable bool memoize = false;
+    mutable MemoTable memo;
+};
 
 class EvalRuntime {
 public:
-    struct Var { std::string name; Value* addr; };
-    using Scope = std::vector<Var>;
+    // Locals live inline in one contiguous stack. A scope is the range
+    // [scope_base.back(), top); leaving it moves `top` back, and the slots are
+    // reused in place by the next declarations.
+    struct Var { Symbol name; Value value; };
 
     EvalRuntime() = default;
     ~EvalRuntime() { cleanup_scopes(); }
 
-    void push_scope(); 
-    void push_scope(Var v);
+    void push_scope() {
+        TOY_STAT(scope_pushes++);
+        scope_base.push_back(top);
+    }
     void pop_scope();
+    // Empties the innermost scope but keeps it open, for the next run of a
+    // loop body
+    void clear_scope() {
+        size_t base = scope_base.back();
+        // Drop references held by the dead slots; scalars make this a tag test
+        for (size_t i = base; i < top; ++i) stack[i].value = Value();
+        top = base;
+    }
     void cleanup_scopes();
-    Scope get_current_scope() const { return scopes.back(); }
-    bool is_scope_empty() const { return scopes.empty(); }
+    // Pops scopes left behind by a non-local exit (return, runtime error)
+    void unwind_scopes(size_t depth) { while (scope_base.size() > depth) pop_scope(); }
+    bool is_scope_empty() const { return scope_base.empty(); }
     // Subroutines support
-    struct Subr {
-        std::vector<std::string> params;
-        const BlockStmt* body;
-    };
+    // Indexed by the Symbol id of the subroutine's name
+    static std::vector<Subr> subrs;
+    // Bumped by every declaration, which may also move `subrs`; call sites
+    // cache a Subr* only for the epoch they looked it up in
+    static std::uint32_t subr_epoch;
 
-    static std::unordered_map<std::string, Subr> subrs;
+    void decl_subr(Symbol name, const std::vector<Symbol>& params, const BlockStmt* body,
+                   SubrEffects effects = {}, bool annotated = false,
+                   std::vector<TypeSlot> param_types = {}, TypeSlot ret = {});
 
-    // Exception for return statements
-    struct ReturnException : public std::exception {
-        Value value;
-        ReturnException(Value v) : value(v) {}
-    };
+    // Memoization. The tables of all subroutines share memo_limit bytes and
+    // are emptied together when it is reached, and whenever a subroutine is
+    // (re)declared, since any cached result may depend on the old body.
+    static MemoMode memo_mode;
+    static std::size_t memo_limit;
+    static std::size_t memo_bytes;
+    static std::uint64_t memo_resets; // times memo_limit emptied the tables
+    // The subroutine `name` names, checked to take `argc` arguments
+    const Subr& lookup_subr(Symbol name, size_t argc);
 
-    void decl_subr(const std::string& name, const std::vector<std::string>& params, const BlockStmt* body);
+    // Arguments are evaluated straight onto the top of the stack, then
+    // become the callee's parameters in place: call_subr opens its scope at
+    // `args_base`. drop_args discards them if evaluating one failed.
+    size_t args_base() const { return top; }
+    void push_arg(Value v) {
+        if (top == stack.size()) stack.emplace_back();
+        stack[top].name = Symbol{}; // not visible by name until the call
+        stack[top].value = std::move(v);
+        ++top;
+    }
+    void drop_args(size_t base) {
+        for (size_t i = base; i < top; ++i) stack[i].value = Value();
+        top = base;
+    }
+    // Runs `subr` on the arguments at `args_base`. The active calls are kept
+    // in `call_stack`; nesting deeper than max_depth raises RecursionError
+    // instead of overflowing the native stack.
+    Value call_subr(Symbol name, const Subr& subr, size_t args_base, Evaluator& evaluator);
+    // Records the call a `return f(...)` ends with: its arguments at
+    // `args_base` move aside until call_subr reuses the returning frame
+    void tail_call(Symbol name, const Subr& subr, size_t args_base);
 
-    Value call_subr(const std::string& name, const std::vector<Value>& args, Evaluator& evaluator);
+    size_t max_depth = kDefaultMaxDepth;
+    std::vector<Symbol> call_stack; // names of the active calls, innermost last
+    Profiler* profiler = nullptr;   // told each statement the evaluator starts
 
-    Value get_var(const std::string& name);
+    Value get_var(Symbol name);
+    Value& get_var_ref(Symbol name);
+    // O(1) access to a variable the Resolver gave a static address. The
+    // reference is only valid until the next declaration grows the stack.
+    Value& slot(const SlotRef& ref) {
+        TOY_STAT(slot_reads++);
+        return stack[scope_base[scope_base.size() - 1 - ref.depth] + ref.slot].value;
+    }
 
-    void set_var(const std::string& name, const Value& value);
-    void decl_var(const std::string& name, const Value& value);
+    void set_var(Symbol name, const Value& value);
+    void decl_var(Symbol name, const Value& value);
+    // decl_var for a VarDecl the Resolver gave a slot: when that slot is the
+    // next one, the name cannot be taken yet and the value is stored directly
+    void decl_local(Symbol name, int local, Value value) {
+        if (local < 0 || scope_base.back() + local != top) return decl_var(name, value);
+        if (top == stack.size()) stack.emplace_back();
+        stack[top].name = name;
+        stack[top].value = std::move(value);
+        ++top;
+    }
     // Type registry for basic types
-    static std::unordered_map<std::string, ValueType> types;
+    static std::unordered_map<Symbol, ValueType> types;
     // Type registry for user defined types
-    static std::vector<std::string> user_types;
+    static std::vector<Symbol> user_types;
 
-    static bool is_user_type(const std::string& name) {
+    static bool is_user_type(Symbol name) {
         return std::find(user_types.begin(), user_types.end(), name) != user_types.end();
     }
     static std::string valueTypeToString(ValueType t); 
-    static ValueType stringToValueType(const std::string& s);
+    // Checks and converts the initializer of `let name: type_name [= init];`
+    static Value typed_init(Symbol name, Symbol type_name, const Value* init);
+    static ValueType stringToValueType(Symbol s);
+    // TypeErrors of the typed slots, shared by the TypeChecker and both
+    // engines: "Type mismatch in <what>: expected T but got U"
+    [[noreturn]] static void type_mismatch(const std::string& what, ValueType expected, ValueType got);
+    // A subroutine declared to return a value fell off its end
+    [[noreturn]] static void missing_return(Symbol subr, ValueType expected);
+    // A `return f(...)` may leave the frame to f only when f's own checks
+    // already give the result the type the returning subroutine promises
+    static bool tail_callable(const TypeSlot& ret, const TypeSlot& callee_ret) {
+        return !ret.checked() || (callee_ret.checked() && callee_ret.type == ret.type);
+    }
 
 private:
-    std::vector<Scope> scopes;
+    struct TailCall {
+        Symbol name;
+        const Subr* subr = nullptr;
+        std::vector<Value> args; // keeps its capacity from call to call
+    } pending;
+    const char* native_base = nullptr; // native stack at the outermost call
+
+    // Converts the arguments at `args_base` for the parameters of `subr`
+    void convert_args(Symbol name, const Subr& subr, size_t args_base);
+    static void update_memo();
+    void memo_store(const Subr& subr, std::size_t hash, std::vector<Value> args, const Value& result);
+
+    std::vector<Var> stack;         // grows, never shrinks; [0, top) is live
+    size_t top = 0;
+    std::vector<size_t> scope_base; // start of each open scope in `stack`
 };
\ No newline at end of file
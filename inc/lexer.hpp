@@ -7,7 +7,10 @@
 #include <optional>
 #include "value.hpp"
 #include "error.hpp"
-#include <unordered_map>
+#include "symbol.hpp"
+#include <string_view>
+#include <cstdint>
+#include <vector>
 
 enum class TokenType {
     End,
@@ -26,8 +29,8 @@ enum class TokenType {
     BoolAnd, BoolOr, 
     // keywords
     KwIf, KwWhile, KwFor,
-    KwCheck, KwThen, KwRecheck,KwOn, KwOnly, KwReturn, KwConst,
-    KwTrue, KwFalse, KwLet, KwSubr, KwCase, KwElse, KwTypeof,
+    KwCheck, KwThen, KwRecheck,KwOn, KwOnly, KwReturn, KwBreak, KwContinue, KwConst,
+    KwTrue, KwFalse, KwLet, KwSubr, KwMemo, KwCase, KwElse, KwTypeof,
     KwStruct, KwEnum, KwUnion, KwTool, KwKit, KwImport,
     // punctuation
     Colon, Assign, Semi, Comma,
@@ -37,7 +40,7 @@ enum class TokenType {
     
 };
 
-constexpr std::array<const char*, 76> token_type_names = {
+constexpr std::array<const char*, 79> token_type_names = {
     "End",
     "Literal", "KwType",
     "Ident",
@@ -54,8 +57,8 @@ constexpr std::array<const char*, 76> token_type_names = {
     "BoolAnd", "BoolOr", 
     // keywords
     "KwIf", "KwWhile", "KwFor",
-    "KwCheck", "KwThen", "KwRecheck", "KwOn", "KwOnly", "KwReturn", "KwConst",
-    "KwTrue", "KwFalse", "KwLet", "KwSubr", "KwCase", "KwElse", "KwTypeof",
+    "KwCheck", "KwThen", "KwRecheck", "KwOn", "KwOnly", "KwReturn", "KwBreak", "KwContinue", "KwConst",
+    "KwTrue", "KwFalse", "KwLet", "KwSubr", "KwMemo", "KwCase", "KwElse", "KwTypeof",
     "KwStruct", "KwEnum", "KwUnion", "KwTool", "KwKit", "KwImport",
     // punctuation
     "Colon", "Assign", "Semi", "Comma",
@@ -72,35 +75,72 @@ inline const char* token_type_to_string(TokenType type) {
     return token_type_names[index];
 }
 
+// Byte classes for the scanner. Unlike <cctype> they do not depend on the
+// locale, and bytes >= 0x80 are never letters.
+enum CharClass : std::uint8_t { CharSpace = 1, CharDigit = 2, CharAlpha = 4 }; // '_' counts as alpha
+
+constexpr std::array<std::uint8_t, 256> char_classes = [] {
+    std::array<std::uint8_t, 256> t{};
+    for (int c = 0; c < 256; ++c) {
+        if (c == ' ' || (c >= '\t' && c <= '\r')) t[c] = CharSpace;
+        else if (c >= '0' && c <= '9') t[c] = CharDigit;
+        else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') t[c] = CharAlpha;
+    }
+    return t;
+}();
+
+inline bool char_is(char c, std::uint8_t classes) {
+    return char_classes[static_cast<unsigned char>(c)] & classes;
+}
+
+// A token is a kind and a slice [offset, offset + length) of the source; it
+// owns nothing and is cheap to copy. `payload` is the Symbol id of an
+// identifier or keyword, or the index of a literal's value in
+// Lexer::literals.
 struct Token {
-    TokenType type;
-    Value value;
-    std::string lexeme;
+    TokenType type = TokenType::End;
+    std::uint32_t offset = 0;
+    std::uint32_t length = 0;
+    std::uint32_t payload = 0;
+
+    Symbol symbol() const { return Symbol{payload}; }
 };
 
+// Scans a view of the source without copying it: the text must outlive the
+// lexer and any token still in use (the REPL's input line, a MappedFile).
 struct Lexer {
-    std::string src;
+    std::string_view src;
     size_t pos = 0;
     Token current;
+    std::vector<Value> literals; // values of this input's Literal tokens
 
-    Lexer(const std::string& input) : src(input), pos(0) {
-        current = get_next_token();
-    }
+    explicit Lexer(std::string_view input) { reset_lexer(input); }
     Lexer () {}
     Token get_next_token();
 
-    void reset_lexer(const std::string& input) {  src = input; pos = 0; current = get_next_token(); }
-        
+    void reset_lexer(std::string_view input) {
+        if (input.size() > UINT32_MAX) throw std::runtime_error("Source too large");
+        src = input; pos = 0; literals.clear(); current = get_next_token();
+    }
+
+    std::string_view text(const Token& t) const { return src.substr(t.offset, t.length); }
+    const Value& literal(const Token& t) const { return literals[t.payload]; }
+
+    Token scan_token();
     Token op_check();
-    Token ident_check(const std::string& ident);
+    Token ident_check(std::string_view ident);
     Token literal_check();
-    Token access_check();
+    Token number_check();
+    Token literal_token(const Value& v) {
+        literals.push_back(v);
+        return {TokenType::Literal, 0, 0, static_cast<std::uint32_t>(literals.size() - 1)};
+    }
     void log_token() {
 #ifdef TOKEN_LOG
         std::cerr << "Token: ";
-        if (current.type != TokenType::Literal) std::cerr << current.lexeme;
+        if (current.type != TokenType::Literal) std::cerr << text(current);
         else std::cerr << "<literal>";
-        std::cerr << " type=" << token_type_to_string(curren.type) << std::endl;
+        std::cerr << " type=" << token_type_to_string(current.type) << std::endl;
 #endif
     }
 
@@ -112,34 +152,14 @@ struct Lexer {
     }
 
     void skip_whitespace() {
-        while (pos < src.size() && isspace(src[pos])) pos++;
+        while (pos < src.size() && char_is(src[pos], CharSpace)) pos++;
     }
     bool is_ident_start(char c) {
-        return isalpha(c) || c == '_';
+        return char_is(c, CharAlpha);
     }
     bool is_ident_char(char c) {
-        return isalnum(c) || c == '_';
+        return char_is(c, CharAlpha | CharDigit);
     }
-    bool match_str(const std::string& s, bool requireIdBoundary = true) {
-        // skip if we're too close to end
-        if (pos + s.size() > src.size()) return false;
-
-        // compare substring
-        if (src.compare(pos, s.size(), s) != 0) return false;
-
-        // if caller requires identifier boundary, ensure it's not part of a longer identifier
-        if (requireIdBoundary) {
-            char next = (pos + s.size() < src.size()) ? src[pos + s.size()] : '\0';
-            if (isalnum(next) || next == '_') return false;
-        }
-
-        // match succeeded, advance and return true
-        pos += s.size();
-        return true;
-}
-     static const std::unordered_map<std::string, TokenType> keywords;
-
-
 };
 
 
@@ -1,10 +1,15 @@
 #pragma once
+#include <cstdint>
 #include <string>
 
-enum class NodeType { Expr, Stmt, Decl };
+enum class NodeType : std::uint8_t { Expr, Stmt, Decl };
 
+// Nodes live in an AstArena (arena.hpp) and are never deleted one at a time,
+// so there is no virtual destructor; consumers switch on nodeType and kind.
 struct Node {
-  NodeType nodeType;
+  // Byte offset in its source of the token a statement or declaration
+  // starts with, set by the Parser for --profile; 0 for expressions
+  std::uint32_t offset = 0;
+  NodeType nodeType; // the one-byte kinds of subclasses pack in after it
   explicit Node(NodeType t): nodeType(t) {}
-  virtual ~Node() = default;
 };
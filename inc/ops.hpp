@@ -0,0 +1,49 @@
+#pragma once
+#include "value.hpp"
+#include "error.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Operators as the parser emits them
+enum class BinaryOp : std::uint8_t {
+    Add, Sub, Mul, Div,
+    Eq, Ne, Lt, Le, Gt, Ge,
+    And, Or,
+    BitAnd, BitOr,
+};
+enum class UnaryOp : std::uint8_t { Neg, Not, BitNot };
+
+constexpr std::size_t kBinaryOpCount = static_cast<std::size_t>(BinaryOp::BitOr) + 1;
+constexpr std::size_t kUnaryOpCount = static_cast<std::size_t>(UnaryOp::BitNot) + 1;
+constexpr std::size_t kValueTypeCount = static_cast<std::size_t>(ValueType::USERDEFINED) + 1;
+
+// One kernel per (operator, lhs type, rhs type), generated in ops.cpp. Each
+// computes exactly what the matching Value operator does, with the operand
+// types fixed at compile time.
+using BinaryKernel = Value (*)(const Value&, const Value&);
+using UnaryKernel = Value (*)(const Value&);
+
+extern const std::array<BinaryKernel, kBinaryOpCount * kValueTypeCount * kValueTypeCount> binary_kernels;
+extern const std::array<UnaryKernel, kUnaryOpCount * kValueTypeCount> unary_kernels;
+
+inline BinaryKernel binary_kernel(BinaryOp op, ValueType lhs, ValueType rhs) {
+    std::size_t i = (static_cast<std::size_t>(op) * kValueTypeCount + static_cast<std::size_t>(lhs)) * kValueTypeCount
+                    + static_cast<std::size_t>(rhs);
+    return binary_kernels[i];
+}
+
+inline Value apply(BinaryOp op, const Value& lhs, const Value& rhs) {
+    return binary_kernel(op, lhs.type, rhs.type)(lhs, rhs);
+}
+
+// Before an integral division, in every engine: a zero divisor and a
+// quotient out of its type's range are RuntimeErrors rather than a trap
+inline void check_divisor(const Value& lhs, const Value& rhs) {
+    if (rhs.is_integral_zero()) throw RuntimeError("Division by zero");
+    if (lhs.divides_out_of_range(rhs)) throw RuntimeError("Integer overflow in division");
+}
+
+inline Value apply(UnaryOp op, const Value& operand) {
+    return unary_kernels[static_cast<std::size_t>(op) * kValueTypeCount + static_cast<std::size_t>(operand.type)](operand);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "node.hpp"
+#include "expr.hpp"
+#include "stmt.hpp"
+#include "decl.hpp"
+#include "arena.hpp"
+#include <cstddef>
+
+// Tree-to-tree simplification, run after the Resolver on each tree returned
+// by Parser::parse (enabled with -O). It
+//  - folds unary/binary operators on literals with the same kernels the
+//    engines use (an operation that would fail is left for run time),
+//  - applies identities that hold for every operand value: a negated
+//    comparison becomes the opposite comparison, and `&& true`, `|| false`
+//    and `!!` disappear around operands that are known to be bool,
+//  - replaces if/check statements whose outcome is constant by the branch
+//    that runs, and drops `while (false)` loops.
+// It never adds or removes a scope, so the Resolver's SlotRefs stay valid.
+class Optimizer {
+public:
+    Optimizer() = default;
+
+    // Replacement nodes are allocated in `nodes`, the arena `node` lives in
+    void optimize(Node*& node, AstArena& nodes);
+
+    // Nodes removed from the trees optimized so far
+    std::size_t eliminated() const { return removed; }
+
+private:
+    std::size_t removed = 0;
+    AstArena* arena = nullptr;
+
+    void expr(Expr*& e);
+    void stmt(Stmt*& s);
+    void decl(Decl* d);
+    void check(Stmt*& s);
+};
@@ -3,49 +3,61 @@
 #include "expr.hpp"
 #include "stmt.hpp"
 #include "lexer.hpp"
+#include "arena.hpp"
 #include "ast.hpp"
-#include <memory>
+#include <cstddef>
 #include <vector>
 
 
 struct Parser {
-    explicit Parser(Lexer& l) : lexer(l) { lexer.advance(); }
-    Parser() = default;
+    // Nodes are allocated in `a`, which must outlive every tree returned
+    Parser(Lexer& l, AstArena& a) : lexer(l), arena(a), current(l.current) {}
 
-    std::unique_ptr<Node> parse(); // new entry point
+    Node* parse(); // new entry point
     Lexer& lexer;
+    AstArena& arena;
     Token current;
+    // Subroutine declarations parsed so far, nested ones included. The
+    // evaluator keeps pointing at their bodies after they have run.
+    std::size_t subr_decls = 0;
 
     void advance() { current = lexer.get_next_token(); lexer.current = current; }
     void expect(TokenType type);
+    Symbol expect_type_name();
 
-    std::unique_ptr<Expr> parse_expr();
-        std::unique_ptr<Expr> parse_literal();
-        std::unique_ptr<Expr> parse_factor();
-        std::unique_ptr<Expr> parse_term();
-        std::unique_ptr<Expr> parse_additive();
-        std::unique_ptr<Expr> parse_bitwise_and();
-        std::unique_ptr<Expr> parse_bitwise_or();
-        std::unique_ptr<Expr> parse_comparison();
-        std::unique_ptr<Expr> parse_unary();
-        std::unique_ptr<Expr> parse_call();
-    std::unique_ptr<Stmt> parse_stmt();
-        std::unique_ptr<Stmt> parse_block();
-        std::unique_ptr<Stmt> parse_recheck();
-        std::unique_ptr<Stmt> parse_check();
-        std::unique_ptr<Stmt> parse_if();
-        std::unique_ptr<Stmt> parse_while();
-        std::unique_ptr<Stmt> parse_for();
-        std::unique_ptr<Stmt> parse_assign();
-        std::unique_ptr<Stmt> parse_expr_stmt();
-    std::unique_ptr<Decl> parse_decl();
-        std::unique_ptr<Decl> parse_var_decl();
-        std::unique_ptr<Decl> parse_subr_decl();
-        std::unique_ptr<Decl> parse_struct_decl();
-        std::unique_ptr<Decl> parse_enum_decl();
-        std::unique_ptr<Decl> parse_union_decl();
-        std::unique_ptr<Decl> parse_tool_decl();
-        std::unique_ptr<Decl> parse_kit_decl();
+    Expr* parse_expr();
+        Expr* parse_literal();
+        Expr* parse_factor();
+        Expr* parse_term();
+        Expr* parse_additive();
+        Expr* parse_bitwise_and();
+        Expr* parse_bitwise_or();
+        Expr* parse_comparison();
+        Expr* parse_unary();
+        Expr* parse_call();
+        Expr* parse_call_args(Expr* callee);
+    Stmt* parse_stmt(); // records the statement's offset
+        Stmt* parse_stmt_kind();
+        Stmt* parse_block();
+        Stmt* parse_recheck();
+        Stmt* parse_check();
+        Stmt* parse_if();
+        Stmt* parse_while();
+        Stmt* parse_for();
+        Stmt* parse_assign();
+        Stmt* parse_return();
+        Stmt* parse_loop_jump();
+        CheckArms parse_check_arms();
+        Stmt* parse_expr_stmt();
+    Decl* parse_decl(); // records the declaration's offset
+        Decl* parse_decl_kind();
+        Decl* parse_var_decl();
+        Decl* parse_subr_decl();
+        Decl* parse_struct_decl();
+        Decl* parse_enum_decl();
+        Decl* parse_union_decl();
+        Decl* parse_tool_decl();
+        Decl* parse_kit_decl();
 };
 
 
@@ -0,0 +1,71 @@
+#pragma once
+#include "node.hpp"
+#include "symbol.hpp"
+#include <csignal>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Sampling profiler for `toy run --profile`. A SIGPROF timer ticks every
+// millisecond of CPU time, or as often as the kernel's scheduler tick allows,
+// and the handler only counts the ticks. The
+// evaluator reports every statement it starts to at(), which charges the
+// pending ticks to the statement that ran until then and to the calls on
+// EvalRuntime::call_stack, the evaluator's shadow stack. Nothing is
+// recorded, and the evaluator only tests a null pointer per statement, when
+// no profiler is attached.
+class Profiler {
+public:
+    static constexpr long kIntervalUs = 1000;
+
+    // `source` is the text the statement offsets point into
+    Profiler(std::string_view source, const std::vector<Symbol>& call_stack)
+        : source(source), call_stack(call_stack) {}
+    ~Profiler() { stop(); }
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    void start();
+    void stop();
+
+    // The evaluator is starting `stmt`; kept out of line so the test for a
+    // profiler is all that is left in the evaluator's statement dispatch
+    void at(const Node* stmt);
+
+    // Self and total time per subroutine and per line, most self time first
+    void report(std::ostream& out) const;
+    // One `frame;frame;... count` line per distinct stack, as flamegraph.pl
+    // and speedscope read them
+    void write_folded(std::ostream& out) const;
+
+private:
+    static constexpr std::uint32_t kNowhere = UINT32_MAX;
+    static volatile std::sig_atomic_t ticks;
+    static void on_tick(int);
+
+    struct Count {
+        long self = 0;
+        long total = 0;
+    };
+
+    std::string_view source;
+    const std::vector<Symbol>& call_stack;
+    std::vector<std::uint32_t> where; // statement running in each frame; [0] is the top level
+    bool running = false;
+    double cpu_secs = 0; // while running: CPU time at start()
+
+    long samples = 0;
+    std::unordered_map<Symbol, Count> subrs; // Symbol{} is the top level
+    std::unordered_map<std::size_t, Count> lines; // 1-based
+    std::unordered_map<std::string, long> stacks; // folded
+    std::vector<std::uint32_t> line_starts;
+    std::vector<std::size_t> seen_lines; // scratch for sample()
+    std::vector<Symbol> seen_subrs;
+
+    void sample();
+    std::size_t line_of(std::uint32_t offset) const;
+    std::string_view line_text(std::size_t line) const;
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include "decl.hpp"
+#include "symbol.hpp"
+#include <vector>
+
+// What a subroutine body does besides computing its result, for deciding
+// whether its calls can be memoized. Run on resolved trees.
+//
+// A body is `local` when every variable it reads or writes is one of its own
+// parameters or locals (the Resolver gave it a slot; resolution never
+// crosses a frame), it declares nothing but variables, and it calls
+// subroutines only by name. The language has no I/O statements yet; one that
+// is added must clear `local`.
+//
+// Whether the callees are pure is only known when the subroutine is called,
+// since calls bind by name: EvalRuntime combines the effects of all declared
+// subroutines for that.
+struct SubrEffects {
+    bool local = true;
+    std::vector<Symbol> callees; // called by name, without duplicates
+};
+
+SubrEffects analyze_effects(const SubrDecl* s);
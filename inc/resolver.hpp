@@ -0,0 +1,48 @@
+#pragma once
+#include "node.hpp"
+#include "expr.hpp"
+#include "stmt.hpp"
+#include "decl.hpp"
+#include <vector>
+
+// Static resolution pass, run once on each tree returned by Parser::parse.
+// It mirrors the scopes EvalRuntime pushes at run time (one per block, one for
+// the parameters of a subroutine call) and annotates IdentExpr, AssignStmt,
+// AssignOpStmt and IncDecStmt with a (depth, slot) SlotRef so the evaluator
+// can index straight into the scope instead of searching by name.
+//
+// Resolution never crosses a subroutine frame: the dynamic scope chain above
+// a call is not known statically. Those references, and top-level REPL
+// globals, stay unresolved and use the by-name lookup.
+//
+// It also rejects `break`/`continue` outside a loop and `return` outside a
+// subroutine, so neither engine has to handle a stray jump at run time.
+class Resolver {
+public:
+    Resolver() = default;
+
+    void resolve(Node* node);
+
+private:
+    struct Scope {
+        std::vector<Symbol> names;      // in declaration (= slot) order
+        bool frame_base = false;        // parameter scope of a subroutine
+    };
+    std::vector<Scope> scopes;
+    int loop_depth = 0;   // enclosing while/recheck loops in the current subroutine
+    bool in_subr = false;
+
+    void resolve_expr(Expr* e);
+    void resolve_stmt(Stmt* s);
+    void resolve_decl(Decl* d);
+    void resolve_block(BlockStmt* b);
+    // A block's contents, in the scope already on top
+    void resolve_block_body(BlockStmt* b);
+    // A recheck arm, in the arms' shared scope if `scoped`
+    void resolve_arm(Stmt* arm, bool scoped);
+    static bool all_blocks(const CheckArms& arms);
+
+    // The slot `name` gets in the innermost scope, or -1 if it has none
+    int declare(Symbol name);
+    SlotRef lookup(Symbol name) const;
+};
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// A whole file mapped read-only into memory, so the lexer scans the page
+// cache directly instead of a copy of the file. The view stays valid for
+// the lifetime of the object.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path); // throws std::runtime_error
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const { return {data, size}; }
+
+private:
+    const char* data = nullptr;
+    std::size_t size = 0;
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+
+// Counters behind `toy --stats`. They are compiled in unless NDEBUG is
+// defined, as for the release build/toy and the benchmarks, where TOY_STAT
+// expands to nothing and the hot paths are what they would be without it;
+// build/toy-debug (`make debug`) has them. -DTOY_STATS=0 or =1 overrides
+// that.
+#ifndef TOY_STATS
+#ifdef NDEBUG
+#define TOY_STATS 0
+#else
+#define TOY_STATS 1
+#endif
+#endif
+
+#if TOY_STATS
+#define TOY_STAT(update) ((void)(stats.update))
+#else
+#define TOY_STAT(update) ((void)0)
+#endif
+
+// What the interpreter is doing, for the allocation counts
+enum class Phase : std::uint8_t { Other, Parse, Check, Eval };
+
+struct Stats {
+    std::uint64_t exprs[5] = {};  // evaluated, by ExprKind
+    std::uint64_t stmts[13] = {}; // executed, by StmtKind
+    std::uint64_t scope_pushes = 0;
+    std::uint64_t scope_pops = 0;
+    std::uint64_t scope_clears = 0; // loop bodies reusing their scope
+    std::uint64_t value_copies = 0;
+    std::uint64_t slot_reads = 0;    // variables the Resolver gave a slot
+    std::uint64_t name_lookups = 0;  // the others, searched by name
+    std::uint64_t names_scanned = 0; // stack entries those searches compared
+    std::uint64_t calls = 0;
+    std::uint64_t tail_calls = 0;
+    std::uint64_t errors = 0;        // reported at the top level, not every throw
+    std::uint64_t unwound_calls = 0; // calls an error propagated out of
+    std::uint64_t allocs[4] = {};    // heap allocations, by Phase
+    Phase phase = Phase::Other;
+
+    // Also sums the memo counters of the subroutines declared now
+    void print(std::ostream& out) const;
+};
+
+extern Stats stats;
@@ -3,105 +3,147 @@
 #include "expr.hpp"
 #include "decl.hpp"
 #include "lexer.hpp"
+#include "dispatch.hpp"
 #include <array>
+#include <memory>
 #include <string>
 #include <vector>
-#include <memory>
 
-enum class StmtKind { ExprStmt, Block, If, While, Return, Check, Recheck };
+enum class StmtKind : std::uint8_t { ExprStmt, Assign, AssignOp, IncDec, Decl, Block, If, While, Return, Break, Continue, Check, Recheck };
 
 struct Stmt : Node {
     StmtKind kind;
     explicit Stmt(StmtKind k) : Node(NodeType::Stmt), kind(k) {}
-    virtual ~Stmt() = default;
 };
 
 struct ExprStmt : Stmt {
-    std::unique_ptr<Expr> expr;
-    ExprStmt(std::unique_ptr<Expr> e) 
-        : Stmt(StmtKind::ExprStmt), expr(std::move(e)) {}
+    Expr* expr;
+    ExprStmt(Expr* e) 
+        : Stmt(StmtKind::ExprStmt), expr(e) {}
 };
 
 struct AssignStmt : Stmt {
-    std::string identifier;
-    std::unique_ptr<Expr> rhs;
-    AssignStmt(std::unique_ptr<Expr> init, const std::string& id)
-        : Stmt(StmtKind::ExprStmt), rhs(std::move(init)), identifier(id) {}
+    Symbol identifier;
+    Expr* rhs;
+    SlotRef ref;
+    AssignStmt(Expr* init, Symbol id)
+        : Stmt(StmtKind::Assign), identifier(id), rhs(init) {}
 };
 struct AssignOpStmt : Stmt {
-    std::string identifier;
-    std::unique_ptr<Expr> rhs;
+    Symbol identifier;
+    Expr* rhs;
     char op; // '+', '-', '*', '/'
-    AssignOpStmt(std::string id, std::unique_ptr<Expr> r, char o)
-        : Stmt(StmtKind::ExprStmt), identifier(std::move(id)), rhs(std::move(r)), op(o) {}
+    SlotRef ref;
+    AssignOpStmt(Symbol id, Expr* r, char o)
+        : Stmt(StmtKind::AssignOp), identifier(id), rhs(r), op(o) {}
 };
 struct IncDecStmt : Stmt {
-    std::string identifier;
+    Symbol identifier;
     char op; // '+' for increment, '-' for decrement
-    IncDecStmt(std::string id, char o)
-        : Stmt(StmtKind::ExprStmt), identifier(std::move(id)), op(o) {}
+    SlotRef ref;
+    IncDecStmt(Symbol id, char o)
+        : Stmt(StmtKind::IncDec), identifier(id), op(o) {}
 }; 
 
+// A declaration appearing in statement position inside a block
+struct DeclStmt : Stmt {
+    Decl* decl;
+    DeclStmt(Decl* d)
+        : Stmt(StmtKind::Decl), decl(d) {}
+};
+
 
 struct ReturnStmt : Stmt {
-    std::unique_ptr<Expr> expr; // can be null for void return
-    std::string type_name; // for compile time type checking
-    ReturnStmt(std::unique_ptr<Expr> e) 
-        : Stmt(StmtKind::Return), expr(std::move(e)) {}
+    Expr* expr; // can be null for void return
+    Symbol type_name; // for compile time type checking
+    TypeSlot slot;    // how the value is converted to it, set by the TypeChecker
+    Symbol subr;      // the enclosing subroutine, for error messages
+    ReturnStmt(Expr* e) 
+        : Stmt(StmtKind::Return), expr(e) {}
+};
+
+// Leave / restart the innermost while or recheck loop
+struct BreakStmt : Stmt {
+    BreakStmt() : Stmt(StmtKind::Break) {}
+};
+
+struct ContinueStmt : Stmt {
+    ContinueStmt() : Stmt(StmtKind::Continue) {}
 };
 
 struct BlockStmt : Stmt {
-    std::vector<std::unique_ptr<Stmt>> stmts;
-    std::unique_ptr<ReturnStmt> rturn_stmt = nullptr; // optional return statement at end (for functions)
-    std::string type_name; // expected return type for the block (for functions)
-    std::vector<std::unique_ptr<Decl>> decl; // optional declarations (for tools/kits)
+    std::vector<Stmt*> stmts;
+    ReturnStmt* rturn_stmt = nullptr; // optional return statement at end (for functions)
+    Symbol type_name; // expected return type for the block (for functions)
+    std::vector<Decl*> decl; // optional declarations (for tools/kits)
     
     BlockStmt() : Stmt(StmtKind::Block) {}
-    void add_stmt(std::unique_ptr<Stmt> s) { stmts.push_back(std::move(s)); }
+    void add_stmt(Stmt* s) { stmts.push_back(s); }
 };
 
 struct IfStmt : Stmt {
-    std::unique_ptr<Expr> cond;
-    std::unique_ptr<Stmt> then_branch, else_branch;
-    IfStmt(std::unique_ptr<Expr> c, std::unique_ptr<Stmt> t, std::unique_ptr<Stmt> e)
-        : Stmt(StmtKind::If), cond(std::move(c)), then_branch(std::move(t)), else_branch(std::move(e)) {}
+    Expr* cond;
+    Stmt* then_branch;
+    Stmt* else_branch;
+    IfStmt(Expr* c, Stmt* t, Stmt* e)
+        : Stmt(StmtKind::If), cond(c), then_branch(t), else_branch(e) {}
 };
 
 struct WhileStmt : Stmt {
-    std::unique_ptr<Expr> cond;
-    std::unique_ptr<Stmt> body;
-    WhileStmt(std::unique_ptr<Expr> c, std::unique_ptr<Stmt> b)
-        : Stmt(StmtKind::While), cond(std::move(c)), body(std::move(b)) {}
+    Expr* cond;
+    Stmt* body;
+    // Set by the Resolver when the body is a block: the loop keeps its scope
+    // open across iterations, and the condition is resolved inside it
+    bool scoped = false;
+    WhileStmt(Expr* c, Stmt* b)
+        : Stmt(StmtKind::While), cond(c), body(b) {}
 }; 
 
 struct ForEachStmt : Stmt {
-    std::unique_ptr<Expr> iterable;
-    std::unique_ptr<Stmt> body;
-    std::string var_name;
-    ForEachStmt(std::string v, std::unique_ptr<Expr> iter, std::unique_ptr<Stmt> b)
-        : Stmt(StmtKind::While), iterable(std::move(iter)), body(std::move(b)), var_name(std::move(v)) {}
+    Expr* iterable;
+    Stmt* body;
+    Symbol var_name;
+    ForEachStmt(Symbol v, Expr* iter, Stmt* b)
+        : Stmt(StmtKind::While), iterable(iter), body(b), var_name(v) {}
 };
 
 struct CheckArms {
-    std::vector<std::pair<std::unique_ptr<Expr>, std::unique_ptr<Stmt>>> arms;
-    std::unique_ptr<Stmt> else_arm;
+    std::vector<std::pair<Expr*, Stmt*>> arms;
+    Stmt* else_arm = nullptr;
+    // Set by the Resolver for a recheck whose arms are all blocks: they share
+    // one scope the loop keeps open, like WhileStmt::scoped
+    bool scoped = false;
     CheckArms() = default;
+
+    // The evaluator's dispatch table for literal arms, built on first use so
+    // it sees the arms as -O left them; nullptr if they are compared in turn
+    const ArmTable* dispatch() const {
+        if (!prepared) {
+            table = ArmTable::build(*this);
+            prepared = true;
+        }
+        return table.get();
+    }
+
+private:
+    mutable std::unique_ptr<ArmTable> table;
+    mutable bool prepared = false;
 };
 
 struct CheckStmt : Stmt {
-    std::unique_ptr<Expr> expr;
+    Expr* expr;
     CheckArms arms;
     bool execute_first_match = false; // true if "check(expr) only", false if "check(expr) on"
-    CheckStmt(std::unique_ptr<Expr> e, CheckArms a)
-        : Stmt(StmtKind::Check), expr(std::move(e)), arms(std::move(a)) {}
+    CheckStmt(Expr* e, CheckArms a)
+        : Stmt(StmtKind::Check), expr(e), arms(std::move(a)) {}
 };
 
 struct RecheckStmt : Stmt {
-    std::unique_ptr<Expr> expr;
+    Expr* expr;
     CheckArms arms;
     bool execute_first_match = false;
-    RecheckStmt(std::unique_ptr<Expr> c, CheckArms a)
-        : Stmt(StmtKind::Recheck), expr(std::move(c)), arms(std::move(a)) {}
+    RecheckStmt(Expr* c, CheckArms a)
+        : Stmt(StmtKind::Recheck), expr(c), arms(std::move(a)) {}
 };
 
 
@@ -109,7 +151,7 @@ struct RecheckStmt : Stmt {
 
 
 inline bool is_decl_kind(TokenType k) {
-    return k == TokenType::KwLet || k == TokenType::KwSubr || k == TokenType::KwStruct ||
+    return k == TokenType::KwLet || k == TokenType::KwSubr || k == TokenType::KwMemo || k == TokenType::KwStruct ||
            k == TokenType::KwEnum || k == TokenType::KwUnion || k == TokenType::KwTool ||
            k == TokenType::KwKit;
 }
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// An interned name: identifiers, keywords and type names are entered into
+// the global SymbolTable once, by the lexer, and everything after it compares
+// and hashes the 32-bit id instead of the text. Ids are dense, so tables
+// keyed by name can be plain vectors indexed by `id`.
+struct Symbol {
+    static constexpr std::uint32_t kNone = ~std::uint32_t(0);
+    std::uint32_t id = kNone;
+
+    // No name, e.g. a `let` without a type annotation
+    bool empty() const { return id == kNone; }
+    const std::string& str() const;
+
+    bool operator==(Symbol o) const { return id == o.id; }
+    bool operator!=(Symbol o) const { return id != o.id; }
+};
+
+template <> struct std::hash<Symbol> {
+    std::size_t operator()(Symbol s) const noexcept { return s.id; }
+};
+
+class SymbolTable {
+public:
+    static SymbolTable& global();
+
+    Symbol intern(std::string_view text);
+    const std::string& name(Symbol s) const { return names[s.id]; }
+    std::size_t size() const { return names.size(); }
+
+private:
+    SymbolTable() = default;
+    std::deque<std::string> names;                   // by id; a deque never moves them
+    std::unordered_map<std::string_view, Symbol> ids; // views into `names`
+};
+
+inline Symbol intern(std::string_view text) { return SymbolTable::global().intern(text); }
+inline const std::string& Symbol::str() const {
+    static const std::string none;
+    return empty() ? none : SymbolTable::global().name(*this);
+}
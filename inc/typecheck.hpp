@@ -0,0 +1,37 @@
+#pragma once
+#include "node.hpp"
+#include "expr.hpp"
+#include "stmt.hpp"
+#include "decl.hpp"
+#include <optional>
+#include <vector>
+
+// Static type pass, run once on each resolved tree. It resolves the declared
+// types of `let` declarations, subroutine parameters and results to
+// ValueTypes and records on each VarDecl, SubrDecl and ReturnStmt the
+// TypeSlot both engines apply, so a declaration runs as a store plus at most
+// one precomputed conversion instead of a type-name lookup per execution.
+//
+// An expression's type is known here when it is built from literals; a
+// mismatch is then a TypeError before anything runs. Variables and calls
+// are only typed at run time, where the slot checks them. Unknown type
+// names, `let x: void;` and a bare `return;` from a subroutine declared to
+// return a value are rejected here too.
+class TypeChecker {
+public:
+    TypeChecker() = default;
+
+    void check(Node* node);
+
+    // Type of `e` if it follows from the tree alone
+    static std::optional<ValueType> static_type(const Expr* e);
+
+private:
+    std::vector<const SubrDecl*> subrs; // enclosing subroutines, innermost last
+
+    void check_stmt(Stmt* s);
+    void check_decl(Decl* d);
+    void check_var(VarDecl* v);
+    void check_subr(SubrDecl* s);
+    void check_return(ReturnStmt* r);
+};
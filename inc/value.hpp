@@ -1,10 +1,14 @@
 #pragma once
 
+#include "stats.hpp"
 #include <variant>
 #include <string>
 #include <stdexcept>
 #include <type_traits>
 #include <cmath>
+#include <cstdint>
+#include <limits>
+#include <functional>
 #include <memory>
 
 struct Node;
@@ -21,7 +25,7 @@ struct userdefined {
 };
 
 
-enum class ValueType {
+enum class ValueType : std::uint8_t {
     INT,
     SHORT,
     LONG,
@@ -34,69 +38,164 @@ enum class ValueType {
     USERDEFINED
 };
 
-using IntegralValue = std::variant<int, short, long, float, double, bool, char, std::string, userdefined, std::monostate>;
+// Out-of-line payloads for the non-scalar alternatives. They are shared between
+// copies of a Value and freed when the last copy goes away.
+struct StringRep {
+    std::uint32_t refs;
+    std::string str;
+};
+
+struct UserRep {
+    std::uint32_t refs;
+    userdefined ud;
+};
+
+// Maps a C++ payload type onto its ValueType tag.
+template <typename T> struct ValueTag;
+template <> struct ValueTag<int>         { static constexpr ValueType type = ValueType::INT; };
+template <> struct ValueTag<short>       { static constexpr ValueType type = ValueType::SHORT; };
+template <> struct ValueTag<long>        { static constexpr ValueType type = ValueType::LONG; };
+template <> struct ValueTag<float>       { static constexpr ValueType type = ValueType::FLOAT; };
+template <> struct ValueTag<double>      { static constexpr ValueType type = ValueType::DOUBLE; };
+template <> struct ValueTag<bool>        { static constexpr ValueType type = ValueType::BOOL; };
+template <> struct ValueTag<char>        { static constexpr ValueType type = ValueType::CHAR; };
+template <> struct ValueTag<std::string> { static constexpr ValueType type = ValueType::STRING; };
+template <> struct ValueTag<userdefined> { static constexpr ValueType type = ValueType::USERDEFINED; };
+template <> struct ValueTag<std::monostate> { static constexpr ValueType type = ValueType::NONE; };
 
+// 16-byte tagged value: an 8-byte payload plus the type tag. Scalars live
+// inline, strings and user-defined values are refcounted and live out of line.
 struct Value {
     ValueType type = ValueType::NONE;
-    IntegralValue value = std::monostate{};
-
-    Value() = default;
-    Value(IntegralValue val): value(val) {
-        setTypeFromVariant();
-    }
-    Value(int val): value(val) {setTypeFromVariant();}
-    Value(short val): value(val) {setTypeFromVariant();}
-    Value(long val): value(val) {setTypeFromVariant();}
-    Value(float val): value(val) {setTypeFromVariant();}
-    Value(double val): value(val) {setTypeFromVariant();}
-    Value(bool val): value(val) {setTypeFromVariant();}
-    Value(char val): value(val) {setTypeFromVariant();}
-    Value(const std::string& val): value(val) {setTypeFromVariant();}
-    Value(const userdefined& val): value(val) {setTypeFromVariant();}
-    Value(ValueType t, IntegralValue v): type(t), value(v) {}
-
-    // Utility: infer type from variant
-    void setTypeFromVariant() {
-        std::visit([&](auto&& arg) {
-            using T = std::decay_t<decltype(arg)>;
-            if constexpr (std::is_same_v<T, int>) type = ValueType::INT;
-            else if constexpr (std::is_same_v<T, short>) type = ValueType::SHORT;
-            else if constexpr (std::is_same_v<T, long>) type = ValueType::LONG;
-            else if constexpr (std::is_same_v<T, float>) type = ValueType::FLOAT;
-            else if constexpr (std::is_same_v<T, double>) type = ValueType::DOUBLE;
-            else if constexpr (std::is_same_v<T, bool>) type = ValueType::BOOL;
-            else if constexpr (std::is_same_v<T, char>) type = ValueType::CHAR;
-            else if constexpr (std::is_same_v<T, std::string>) type = ValueType::STRING;
-            else if constexpr (std::is_same_v<T, userdefined>) type = ValueType::USERDEFINED;
-            else if constexpr (std::is_same_v<T, std::monostate>) type = ValueType::NONE;
-            else type = ValueType::NONE;
-        }, value);
+
+    // Narrow integers are written as a full 8-byte word and read back through
+    // their own member (little-endian), so a load right after construction is
+    // forwarded from a single store instead of stalling on a partial one.
+    Value() { as.l = 0; }
+    Value(int val)    : type(ValueType::INT)    { as.l = val; }
+    Value(short val)  : type(ValueType::SHORT)  { as.l = val; }
+    Value(long val)   : type(ValueType::LONG)   { as.l = val; }
+    Value(float val)  : type(ValueType::FLOAT)  { as.f = val; }
+    Value(double val) : type(ValueType::DOUBLE) { as.d = val; }
+    Value(bool val)   : type(ValueType::BOOL)   { as.l = val; }
+    Value(char val)   : type(ValueType::CHAR)   { as.l = val; }
+    Value(const char* val) : Value(std::string(val)) {}
+    Value(std::string val) : type(ValueType::STRING) {
+        as.str = new StringRep{1, std::move(val)};
+    }
+    Value(const userdefined& val) : type(ValueType::USERDEFINED) {
+        as.ud = new UserRep{1, val};
+    }
+    Value(std::monostate) : Value() {}
+
+    Value(const Value& other) noexcept : type(other.type), as(other.as) {
+        TOY_STAT(value_copies++);
+        retain();
+    }
+    Value(Value&& other) noexcept : type(other.type), as(other.as) {
+        other.type = ValueType::NONE;
+    }
+    Value& operator=(const Value& other) noexcept {
+        TOY_STAT(value_copies++);
+        if (this != &other) {
+            other.retain();
+            release();
+            type = other.type;
+            as = other.as;
+        }
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            release();
+            type = other.type;
+            as = other.as;
+            other.type = ValueType::NONE;
+        }
+        return *this;
+    }
+    ~Value() { release(); }
+
+    // Zero value of a declared type (`let x: int;`)
+    static Value defaultFor(ValueType t) {
+        switch (t) {
+            case ValueType::INT: return Value(0);
+            case ValueType::SHORT: return Value(static_cast<short>(0));
+            case ValueType::LONG: return Value(0L);
+            case ValueType::FLOAT: return Value(0.0f);
+            case ValueType::DOUBLE: return Value(0.0);
+            case ValueType::BOOL: return Value(false);
+            case ValueType::CHAR: return Value('\0');
+            case ValueType::STRING: return Value(std::string());
+            default: return Value();
+        }
+    }
+
+    // Calls f with the payload as its C++ type (std::monostate for NONE)
+    template <typename F>
+    auto visit(F&& f) const -> decltype(f(std::monostate{})) {
+        switch (type) {
+            case ValueType::INT: return f(as.i);
+            case ValueType::SHORT: return f(as.s);
+            case ValueType::LONG: return f(as.l);
+            case ValueType::FLOAT: return f(as.f);
+            case ValueType::DOUBLE: return f(as.d);
+            case ValueType::BOOL: return f(as.b);
+            case ValueType::CHAR: return f(as.c);
+            case ValueType::STRING: return f(static_cast<const std::string&>(as.str->str));
+            case ValueType::USERDEFINED: return f(static_cast<const userdefined&>(as.ud->ud));
+            case ValueType::NONE: break;
+        }
+        return f(std::monostate{});
     }
 
     // Getters (templated)
     template <typename T>
     T get() const {
-        return std::get<T>(value);
+        if (type != ValueTag<T>::type) throw std::bad_variant_access();
+        return unchecked<T>();
+    }
+
+    // Payload read for callers that have already tested `type`
+    template <typename T>
+    T unchecked() const {
+        if constexpr (std::is_same_v<T, int>) return as.i;
+        else if constexpr (std::is_same_v<T, short>) return as.s;
+        else if constexpr (std::is_same_v<T, long>) return as.l;
+        else if constexpr (std::is_same_v<T, float>) return as.f;
+        else if constexpr (std::is_same_v<T, double>) return as.d;
+        else if constexpr (std::is_same_v<T, bool>) return as.b;
+        else if constexpr (std::is_same_v<T, char>) return as.c;
+        else if constexpr (std::is_same_v<T, std::string>) return as.str->str;
+        else if constexpr (std::is_same_v<T, userdefined>) return as.ud->ud;
+        else return T{};
     }
 
-    // Setters (auto-detect type)
+    // Setters (auto-detect type). A scalar is written in place, with no
+    // temporary Value to move from and destroy, as the constructors write it.
     template <typename T>
-    void set(T v) {
-        value = v;
-        setTypeFromVariant();
+    __attribute__((always_inline)) void set(T v) {
+        if constexpr (std::is_arithmetic_v<T>) {
+            release();
+            type = ValueTag<T>::type;
+            if constexpr (std::is_same_v<T, float>) as.f = v;
+            else if constexpr (std::is_same_v<T, double>) as.d = v;
+            else as.l = v;
+        } else {
+            *this = Value(std::move(v));
+        }
     }
 
     // Convert int to float
     void promoteToFloat() {
-        if (std::holds_alternative<int>(value)) {
-            float f = static_cast<float>(std::get<int>(value));
-            value = f;
+        if (type == ValueType::INT) {
+            as.f = static_cast<float>(as.i);
             type = ValueType::FLOAT;
         }
     }
 
     std::string toString() const {
-        return std::visit([](auto&& v) -> std::string {
+        return visit([](auto&& v) -> std::string {
             using T = std::decay_t<decltype(v)>;
 
             if constexpr (std::is_same_v<T, std::monostate>)
@@ -111,8 +210,8 @@ struct Value {
                 return "\"" + v + "\"";
             else
                 return "<unknown>";
-        }, value);
-    }   
+        });
+    }
 
     // Arithmetic operators
     Value operator+(const Value& other) const { return arithmeticOp(other, std::plus<>()); }
@@ -133,37 +232,71 @@ struct Value {
         return Value(static_cast<double>(std::pow(base, exponent)));
     }
     Value operator&&(const Value& other) const {
-    return std::visit([](auto&& lhs, auto&& rhs) -> Value {
-        if constexpr(std::is_same_v<std::decay_t<decltype(lhs)>, bool> &&
-                     std::is_same_v<std::decay_t<decltype(rhs)>, bool>)
-                return Value(lhs && rhs);
-            else throw std::runtime_error("&& requires bools");
-        }, value, other.value);
+        if (type != ValueType::BOOL || other.type != ValueType::BOOL)
+            throw std::runtime_error("&& requires bools");
+        return Value(as.b && other.as.b);
     }
 
     Value operator||(const Value& other) const {
-    return std::visit([](auto&& lhs, auto&& rhs) -> Value {
-        if constexpr(std::is_same_v<std::decay_t<decltype(lhs)>, bool> &&
-                     std::is_same_v<std::decay_t<decltype(rhs)>, bool>)
-                return Value(lhs || rhs);
-            else throw std::runtime_error("|| requires bools");
-        }, value, other.value);
+        if (type != ValueType::BOOL || other.type != ValueType::BOOL)
+            throw std::runtime_error("|| requires bools");
+        return Value(as.b || other.as.b);
     }
 
     Value operator~() const { return unaryOp(std::bit_not<>());}
     Value operator!() const {
-        return std::visit([](auto&& v) -> Value {
-            if constexpr (std::is_same_v<std::decay_t<decltype(v)>, bool>)
-                return Value(!v);
-            else
-                throw std::runtime_error("Logical NOT requires a boolean");
-        }, value);
+        if (type != ValueType::BOOL)
+            throw std::runtime_error("Logical NOT requires a boolean");
+        return Value(!as.b);
+    }
+
+    // A zero of an integral type (int, short, long, char or bool): the
+    // divisors that trap in integer division, where a floating-point zero
+    // gives inf or NaN. Every engine's "Division by zero" check uses this.
+    bool is_integral_zero() const {
+        switch (type) {
+            case ValueType::INT: return as.i == 0;
+            case ValueType::SHORT: return as.s == 0;
+            case ValueType::LONG: return as.l == 0;
+            case ValueType::CHAR: return as.c == 0;
+            case ValueType::BOOL: return !as.b;
+            default: return false;
+        }
+    }
+    // Whether this / divisor overflows its quotient's type: that type's
+    // minimum divided by -1. For int and long it traps like a zero divisor.
+    bool divides_out_of_range(const Value& divisor) const {
+        switch (type) {
+            case ValueType::INT: return divisor.quotient_overflows(as.i);
+            case ValueType::SHORT: return divisor.quotient_overflows(as.s);
+            case ValueType::LONG: return divisor.quotient_overflows(as.l);
+            case ValueType::CHAR: return divisor.quotient_overflows(as.c);
+            default: return false;
+        }
+    }
+    template <typename L, typename R>
+    static bool division_overflows(L l, R r) {
+        using Quotient = std::common_type_t<L, R>;
+        if constexpr (std::is_same_v<L, bool> || std::is_same_v<R, bool>) return false;
+        else return r == static_cast<R>(-1) && l == std::numeric_limits<Quotient>::min();
     }
 
     // Comparison
     bool operator==(const Value& other) const {
         if (type != other.type) return false;
-        return value == other.value;
+        switch (type) {
+            case ValueType::INT: return as.i == other.as.i;
+            case ValueType::SHORT: return as.s == other.as.s;
+            case ValueType::LONG: return as.l == other.as.l;
+            case ValueType::FLOAT: return as.f == other.as.f;
+            case ValueType::DOUBLE: return as.d == other.as.d;
+            case ValueType::BOOL: return as.b == other.as.b;
+            case ValueType::CHAR: return as.c == other.as.c;
+            case ValueType::STRING: return as.str == other.as.str || as.str->str == other.as.str->str;
+            case ValueType::USERDEFINED: return as.ud == other.as.ud || as.ud->ud == other.as.ud->ud;
+            case ValueType::NONE: return true;
+        }
+        return false;
     }
 
     bool operator!=(const Value& other) const {
@@ -172,7 +305,9 @@ struct Value {
 
     bool operator<(const Value& other) const {
         if (type != other.type) throw std::runtime_error("Cannot compare different types");
-        return std::visit([](auto&& lhs, auto&& rhs) -> bool {
+        if (type == ValueType::INT) return as.i < other.as.i;
+        if (type == ValueType::DOUBLE) return as.d < other.as.d;
+        return visit2(other, [](auto&& lhs, auto&& rhs) -> bool {
             using L = std::decay_t<decltype(lhs)>;
             using R = std::decay_t<decltype(rhs)>;
 
@@ -183,7 +318,7 @@ struct Value {
             } else {
                 throw std::runtime_error("Invalid types for comparison");
             }
-        }, value, other.value);
+        });
     }
     bool operator<=(const Value& other) const {
         return *this < other || *this == other;
@@ -197,9 +332,62 @@ struct Value {
 
 
 private:
+    union Payload {
+        int i;
+        short s;
+        long l;
+        float f;
+        double d;
+        bool b;
+        char c;
+        StringRep* str;
+        UserRep* ud;
+    } as;
+
+    void retain() const noexcept {
+        if (type == ValueType::STRING) ++as.str->refs;
+        else if (type == ValueType::USERDEFINED) ++as.ud->refs;
+    }
+    template <typename L>
+    bool quotient_overflows(L dividend) const {
+        switch (type) {
+            case ValueType::INT: return division_overflows(dividend, as.i);
+            case ValueType::SHORT: return division_overflows(dividend, as.s);
+            case ValueType::LONG: return division_overflows(dividend, as.l);
+            case ValueType::CHAR: return division_overflows(dividend, as.c);
+            default: return false;
+        }
+    }
+    bool isBoxed() const noexcept {
+        return type == ValueType::STRING || type == ValueType::USERDEFINED;
+    }
+    // Scalars only pay for the tag test; the refcount drop stays out of line
+    __attribute__((always_inline)) void release() noexcept {
+        if (isBoxed()) releaseBoxed();
+    }
+    __attribute__((noinline)) void releaseBoxed() noexcept {
+        if (type == ValueType::STRING) {
+            if (--as.str->refs == 0) delete as.str;
+        } else if (--as.ud->refs == 0) {
+            delete as.ud;
+        }
+    }
+
+    template <typename F>
+    auto visit2(const Value& other, F&& f) const -> decltype(f(std::monostate{}, std::monostate{})) {
+        return visit([&](auto&& lhs) {
+            return other.visit([&](auto&& rhs) { return f(lhs, rhs); });
+        });
+    }
+
     template <typename Op>
     Value arithmeticOp(const Value& other, Op op) const {
-        return std::visit([&](auto&& lhs, auto&& rhs) -> Value {
+        // Same-type int/double operands skip the 10x10 type matrix
+        if (type == other.type) {
+            if (type == ValueType::INT) return Value(static_cast<int>(op(as.i, other.as.i)));
+            if (type == ValueType::DOUBLE) return Value(static_cast<double>(op(as.d, other.as.d)));
+        }
+        return visit2(other, [&](auto&& lhs, auto&& rhs) -> Value {
         using L = std::decay_t<decltype(lhs)>;
         using R = std::decay_t<decltype(rhs)>;
 
@@ -208,15 +396,15 @@ private:
             // Compute result in the "wider" type
             using ResultType = std::common_type_t<L, R>;
             return Value(static_cast<ResultType>(op(lhs, rhs)));
-        } 
+        }
         else {
             throw std::runtime_error("Invalid arithmetic operation");
         }
-    }, value, other.value);
+    });
     }
     template <typename Op>
     Value binaryOp(const Value& other, Op op) const {
-        return std::visit([&](auto&& lhs, auto&& rhs) -> Value {
+        return visit2(other, [&](auto&& lhs, auto&& rhs) -> Value {
         using L = std::decay_t<decltype(lhs)>;
         using R = std::decay_t<decltype(rhs)>;
 
@@ -229,12 +417,12 @@ private:
         } else {
             throw std::runtime_error("Invalid operands for binary operator");
         }
-    }, value, other.value);
+    });
     }
 
     template <typename Op>
     Value unaryOp(Op op) const {
-        return std::visit([&](auto&& v) -> Value {
+        return visit([&](auto&& v) -> Value {
         using T = std::decay_t<decltype(v)>;
 
         if constexpr (std::is_integral_v<T>) {
@@ -246,29 +434,63 @@ private:
         } else {
             throw std::runtime_error("Invalid operand for unary operator");
         }
-    }, value);
+    });
     }
 
     bool isNumeric() const {
-        return std::holds_alternative<int>(value) ||
-               std::holds_alternative<short>(value) ||
-               std::holds_alternative<long>(value) ||
-               std::holds_alternative<float>(value) ||
-               std::holds_alternative<double>(value);
+        return type == ValueType::INT || type == ValueType::SHORT ||
+               type == ValueType::LONG || type == ValueType::FLOAT ||
+               type == ValueType::DOUBLE;
     }
     bool isBitFieldable() const {
-        return std::holds_alternative<int>(value) ||
-               std::holds_alternative<short>(value) ||
-               std::holds_alternative<long>(value);
+        return type == ValueType::INT || type == ValueType::SHORT ||
+               type == ValueType::LONG;
     }
 
     double toDouble() const {
-        return std::visit([](auto&& arg) -> double {
+        return visit([](auto&& arg) -> double {
             using T = std::decay_t<decltype(arg)>;
             if constexpr (std::is_same_v<T, bool>) return arg ? 1.0 : 0.0;
             else if constexpr (std::is_arithmetic_v<T>) return static_cast<double>(arg);
             else throw std::runtime_error("Cannot convert to double");
-        }, value);
+        });
+    }
+
+};
+
+static_assert(sizeof(Value) == 16, "Value is expected to be a 16-byte tag + payload");
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Value payload layout assumes little-endian");
+
+// How a typed slot (`let x: T`, a parameter, a return value) takes a value.
+// The TypeChecker picks one per slot from what it knows statically, so the
+// engines only convert where a conversion is actually needed.
+enum class TypeConv : std::uint8_t {
+    Unchecked,   // no declared builtin type: anything goes (a `let` uses EvalRuntime::typed_init)
+    Store,       // statically of the slot's type already
+    IntToFloat,  // statically an int, widened
+    IntToDouble,
+    Check,       // type known only at run time: same type passes, an int widens to float/double
+    Default,     // `let x: T;` starts at T's zero value
+};
+
+struct TypeSlot {
+    ValueType type = ValueType::NONE;
+    TypeConv conv = TypeConv::Unchecked;
+
+    // Converts v for the slot; false if the slot does not take v's type
+    bool accept(Value& v) const {
+        switch (conv) {
+            case TypeConv::IntToFloat: v = Value(static_cast<float>(v.unchecked<int>())); return true;
+            case TypeConv::IntToDouble: v = Value(static_cast<double>(v.unchecked<int>())); return true;
+            case TypeConv::Check:
+                if (v.type == type) return true;
+                if (v.type != ValueType::INT) return false;
+                if (type == ValueType::FLOAT) v = Value(static_cast<float>(v.unchecked<int>()));
+                else if (type == ValueType::DOUBLE) v = Value(static_cast<double>(v.unchecked<int>()));
+                else return false;
+                return true;
+            default: return true;
+        }
     }
-    
+    bool checked() const { return conv != TypeConv::Unchecked; }
 };
@@ -0,0 +1,230 @@
+#pragma once
+#include "node.hpp"
+#include "expr.hpp"
+#include "stmt.hpp"
+#include "decl.hpp"
+#include "value.hpp"
+#include "error.hpp"
+#include "dispatch.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Register bytecode. Every instruction is 8 bytes: an opcode and three 16-bit
+// operands. Registers are relative to the current frame; K is the constant
+// pool of the function being run. RK[x] is K[x - kConstBit] when x has
+// kConstBit set and R[x] otherwise. Jumps take an absolute 32-bit target in
+// (b, c), see Instr::target().
+constexpr std::uint16_t kConstBit = 0x8000;
+
+enum class Op : std::uint8_t {
+    LoadK,        // R[a] = K[b]
+    LoadNil,      // R[a] = void
+    Move,         // R[a] = R[b]
+    GetGlobal,    // R[a] = globals[b]
+    SetGlobal,    // globals[a] = R[b]
+    GetName,      // R[a] = the innermost live local named global_names[b] in
+                  // the active frames, else globals[b]
+    SetName,      // that binding of global_names[a] = R[b]
+    DeclGlobal,   // declare globals[a] = R[b]
+    DeclInit,     // R[a] = typed initializer for decls[b] (c: has initializer)
+    Add, Sub, Mul, Div,
+    Eq, Ne, Lt, Le, Gt, Ge,
+    And, Or, BitAnd, BitOr, // R[a] = RK[b] op RK[c]
+    Neg, Not, BitNot, // R[a] = op R[b]
+    TestEq, TestNe, TestLt, TestLe, TestGt, TestGe, // if (RK[b] op RK[c]) skip the Jump that follows
+    StepEq, StepNe, StepLt, StepLe, StepGt, StepGe, // R[a] += 1 (-= 1 if c), then as
+                  // TestEq.. on R[a] and RK[b]: `i++` and a loop's test of i in one
+    Jump,         // pc = target
+    JumpIfFalse,  // if (!R[a]) pc = target
+    JumpIfTrue,   // if (R[a]) pc = target
+    Switch,       // pc = the first arm of switches[b] R[a] matches, else its miss target
+    Call,         // R[a] = subrs[b](R[a+1] .. R[a+c])
+    TailCall,     // return subrs[b](R[a+1] .. R[a+c]), run in this frame; a Call
+                  // if the result still needs converting by the Return that follows
+    Return,       // return R[a], converted to this subroutine's result type by
+                  // TypeConv b (Unchecked: as it is)
+    ReturnNil,    // return void
+    DefSubr,      // subrs[a] = protos[target]
+};
+
+struct Instr {
+    Op op;
+    std::uint16_t a = 0, b = 0, c = 0;
+
+    std::uint32_t target() const { return b | (static_cast<std::uint32_t>(c) << 16); }
+    void set_target(std::uint32_t t) {
+        b = static_cast<std::uint16_t>(t & 0xffff);
+        c = static_cast<std::uint16_t>(t >> 16);
+    }
+};
+static_assert(sizeof(Instr) == 8, "Instr is expected to be 8 bytes");
+
+// Typed `let` data DeclInit needs; copied out of the tree so compiled code
+// never points back into it
+struct DeclInfo {
+    Symbol name;
+    Symbol type_name;
+    TypeSlot slot;
+};
+
+// Where a named local lives: register `reg` of its frame while the frame's
+// pc is in [start, end). Subroutines look names that are not their own
+// locals up through these, innermost frame first, as the evaluator's
+// dynamic scoping does.
+struct LocalInfo {
+    Symbol name;
+    std::uint16_t reg;
+    std::uint32_t start;
+    std::uint32_t end = UINT32_MAX;
+};
+
+// Jump targets of a check/recheck dispatched by an ArmTable
+struct SwitchTable {
+    std::unique_ptr<ArmTable> arms;
+    std::vector<std::uint32_t> targets; // by arm index
+    std::uint32_t miss = 0;             // where a subject matching no arm goes
+};
+
+// A compiled function: a subroutine body or one top-level REPL input
+struct Proto {
+    std::string name;
+    std::vector<Instr> code;
+    std::vector<Value> constants;
+    std::vector<DeclInfo> decls;
+    std::vector<LocalInfo> locals;
+    std::vector<SwitchTable> switches;
+    std::vector<Symbol> params;        // names, for argument TypeErrors
+    std::vector<TypeSlot> param_types; // from the TypeChecker, like Subr's
+    bool converts_args = false;        // some parameter converts or checks
+    TypeSlot ret;
+    std::uint16_t num_params = 0;
+    std::uint16_t num_regs = 0;
+};
+
+// Name -> slot index, stable for the lifetime of a VM so bytecode compiled
+// for earlier inputs keeps addressing the same slots.
+struct SlotTable {
+    std::unordered_map<Symbol, std::uint16_t> index;
+    std::vector<Symbol> names;
+
+    std::uint16_t intern(Symbol name);
+};
+
+class VM;
+
+// Compiles one top-level node (and any subroutines declared in it) to bytecode.
+// Locals of blocks and subroutines are registers; top-level declarations are
+// globals addressed by slot. A name that is not a local of the current
+// subroutine is looked up at run time through the frames below it (GetName),
+// so a subroutine sees its callers' locals as in the evaluator; outside of
+// subroutines it always refers to a global.
+class Compiler {
+public:
+    explicit Compiler(VM& vm) : vm(vm) {}
+
+    std::unique_ptr<Proto> compile(const Node* node);
+
+private:
+    struct Scope {
+        std::vector<std::pair<Symbol, std::uint16_t>> locals;
+        int reg_base;
+        std::size_t info_base; // first of proto->locals declared in the scope
+    };
+    struct Loop {
+        std::size_t top;                 // where continue jumps to
+        std::vector<std::size_t> breaks; // jumps patched to the loop's end
+    };
+    struct FnState {
+        Proto* proto;
+        std::vector<Scope> scopes;
+        std::vector<Loop> loops;
+        int next_reg = 0;
+        bool in_subr = false;
+    };
+
+    VM& vm;
+    FnState* fn = nullptr;
+
+    Proto* new_proto(const std::string& name);
+    std::uint16_t alloc_reg();
+    void free_to(int mark) { fn->next_reg = mark; }
+    std::uint16_t constant(const Value& v);
+    int lookup_local(Symbol name) const;
+    std::uint16_t declare_local(Symbol name);
+    bool at_top_level() const { return fn->scopes.empty(); }
+
+    std::size_t emit(Op op, int a = 0, int b = 0, int c = 0);
+    std::size_t emit_jump(Op op, int a = 0);
+    void patch(std::size_t at) { patch_to(at, fn->proto->code.size()); }
+    void patch_to(std::size_t at, std::size_t target);
+
+    void expr_to(const Expr* e, int dst);
+    std::uint16_t expr_any(const Expr* e);
+    std::uint16_t rk(const Expr* e);
+    std::size_t jump_unless(const Expr* cond);
+    std::size_t jump_if(const Expr* cond);
+    void call_to(const CallExpr* c, int dst);
+    void stmt(const Stmt* s, int dst);
+    void block(const BlockStmt* b, int dst);
+    void loop_body(const Stmt* body, int dst);
+    void end_loop();
+    void fuse_step(const Stmt* body, std::size_t jump);
+    void check(const CheckStmt* c, int dst);
+    std::uint16_t switch_table(std::unique_ptr<ArmTable> table);
+    void switch_arms(const CheckArms& arms, bool only, int dst, std::size_t loop_top);
+    void recheck(const RecheckStmt* r, int dst);
+    void store(Symbol name, int src);
+    void load(Symbol name, int dst);
+    void decl(const Decl* d, int dst);
+    void var_decl(const VarDecl* v);
+    void subr_decl(const SubrDecl* s);
+};
+
+// Executes compiled code. Holds the globals and subroutines that persist
+// across REPL inputs, and a register stack shared by all call frames.
+//
+// Speed: bench/vm_bench, memoization off, medians of 7 runs: fib(24) 5.2x
+// the evaluator, factorial 6.8x, int loop 5.3x, double loop 5.7x, loop with
+// block decls 6.5x, check in a loop 3.6x. That comes from threaded dispatch,
+// scalar results written in place, Test ops that branch without dispatching
+// their Jump, and Step ops that fold a loop's trailing i++ into its test.
+class VM {
+public:
+    VM() = default;
+
+    // Compiles and runs one top-level node, returning its value like
+    // Evaluator::eval does
+    Value run(const Node* node);
+
+    // Calls nested deeper than this raise RecursionError, as in EvalRuntime
+    std::size_t max_depth = kDefaultMaxDepth;
+
+private:
+    friend class Compiler;
+
+    std::vector<std::unique_ptr<Proto>> protos;
+    SlotTable global_names;
+    std::vector<bool> local_names; // by global slot: some frame may bind it
+    std::vector<Value> globals;
+    std::vector<bool> global_defined;
+    SlotTable subr_names;
+    std::vector<const Proto*> subrs;
+    std::vector<Value> stack;
+
+    struct Frame {
+        const Proto* proto;
+        const Instr* pc;
+        std::size_t base;
+        std::uint16_t ret_reg; // caller register that receives the result
+    };
+
+    Value execute(const Proto* main);
+    // The binding GetName and SetName use for global slot `slot`, searched
+    // from the frame running at `pc` down through its callers
+    Value& name_ref(const std::vector<Frame>& frames, const Instr* pc, std::uint16_t slot);
+    // Converts the arguments in `args` for the parameters of `callee`
+    static void convert_args(const Proto* callee, Value* args);
+};
@@ -2,11 +2,22 @@
 set -euo pipefail
 ROOT=$(cd "$(dirname "$0")/.." && pwd)
 TOY=$ROOT/build/toy
-if [ ! -x "$TOY" ]; then
+TOY_DEBUG=$ROOT/build/toy-debug # keeps the --stats counters
+if [ ! -x "$TOY" ] || [ ! -x "$TOY_DEBUG" ]; then
   echo "binary not found; building..."
-  make -C "$ROOT"
+  make -C "$ROOT" all debug
 fi
 
+# expect_result <name> <program> <expected last "Result:" line> [toy args...]
+expect_result() {
+  local out
+  out=$({ printf "%b" "$2" | "$TOY" "${@:4}" 2>&1; } | grep "^Result:" | tail -n1 || true)
+  if [[ "$out" != "$3" ]]; then
+    echo "$1 failed: expected '$3' got: $out"
+    exit 2
+  fi
+}
+
 # Test 1: basic decl + assign
 OUT=$({ printf "let x = (2);\n x = 3;\n" | "$TOY"; } | grep "^Result:" | tail -n1 || true)
 if [[ "$OUT" != "Result: 3" ]]; then
@@ -14,4 +25,381 @@ if [[ "$OUT" != "Result: 3" ]]; then
   exit 2
 fi
 
+# Test 2: resolved locals in nested blocks, with shadowing and outer writes
+expect_result "Test2" \
+  "let r = 0;\n{ let a = 1; { let a = 10; let b = a + 1; a += b; r = a; } r = r * 100 + a; }\nr = r;\n" \
+  "Result: 2101"
+
+# Test 3: subroutine parameters and recursion
+expect_result "Test3" \
+  "let r = 0;\n{ subr fact(n: int): int { if (n < 2) { return 1; } return n * fact(n - 1); } r = fact(10); }\nr = r;\n" \
+  "Result: 3628800"
+
+# Test 4: subroutines fall back to name lookup for REPL globals
+expect_result "Test4" \
+  "let g = 7;\n{ subr addg(n: int): int { return n + g; } let i = 0; while (i < 3) { i++; g = addg(i); } }\ng = g;\n" \
+  "Result: 13"
+
+# Test 5: the bytecode VM runs locals, loops, calls and check arms
+expect_result "Test5" \
+  "let r = 0;\n{ subr fib(n: int): int { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); } let i = 0; while (i < 3) { r += fib(10 + i); i++; } }\ncheck (r) only case 0: r = 1; case 288: r = 2; then r = 3;\n" \
+  "Result: 2" --engine=vm
+
+# Test 6: --engine=diff agrees on a mixed program
+DIFF_PROG="let x: float = 3;\n{ let s = 0; let i = 0; while (i < 10) { s += i; i++; } x = x * s; }\nx = x / 0;\nlet y: int;\ny--;\n"
+if ! printf "%b" "$DIFF_PROG" | "$TOY" --engine=diff >/dev/null 2>&1; then
+  echo "Test6 failed: engines disagree on:"
+  printf "%b" "$DIFF_PROG" | "$TOY" --engine=diff 2>&1 | grep "^Mismatch" || true
+  exit 2
+fi
+# Subroutines see their callers' locals in both engines, innermost binding
+# first, for reads and writes
+DYN_PROG="let g = 1;\nlet r = 0;\n{ subr inner(): int { g = g + 1; return g * 10; } subr mid(g: int): int { let a = inner(); { let g = 100; a = a + inner(); } return a + g; } subr outer(): int { let g = 5; return mid(7) + g; } r = outer() * 1000 + g; }\n{ subr bump(): int { cnt += 1; return cnt; } let cnt = 0; let i = 0; while (i < 3) { bump(); i++; } r = r + cnt; }\nr = r;\n"
+for engine in eval vm; do
+  expect_result "Test6 $engine" "$DYN_PROG" "Result: 1103004" --engine=$engine
+done
+if ! printf "%b" "$DYN_PROG" | "$TOY" --engine=diff >/dev/null 2>&1; then
+  echo "Test6 failed: engines disagree on callers' locals"
+  exit 2
+fi
+
+# Test 7: operators dispatch on operand types, including the bitwise ones
+expect_result "Test7" \
+  "let r = 0;\nlet d = 1.5;\nd = d * 2.0 - 0.5;\nr = (6 & 3) | 8;\nr = r * 10 + (~r & 7) + (-r | 1);\n" \
+  "Result: 96" --engine=diff
+
+# Test 8: break/continue in while, recheck loops until no arm matches, and
+# return leaves loops inside a subroutine
+expect_result "Test8" \
+  "let r = 0;\n{ let i = 0; while (true) { i++; if (i > 5) { break; } if (i == 2) { continue; } r += i; } }\n{ let n = 0; recheck (n < 5) only case true: n++; r = r + n; }\n{ subr f(x: int): int { while (true) { x++; if (x > 9) { return x; } } } r = r * 100 + f(0); }\n" \
+  "Result: 1810" --engine=diff
+
+# Test 9: -O folds constants and prunes constant branches without changing results
+OPT_PROG="let r = (2 + 3) * 4;\nif (1 < 2) { r = r + 1; } else { r = 0; }\ncheck (3) only case 1: r = 1; case 3: r = r * 2; then r = 0;\n{ let i = 0; while (!(i >= 10)) { i++; r = r - 2 * 3 + 1; } }\nr = r / 0;\n"
+expect_result "Test9" "$OPT_PROG" "Result: -8"
+expect_result "Test9 -O" "$OPT_PROG" "Result: -8" -O --engine=diff
+OUT=$(printf "%b" "$OPT_PROG" | "$TOY" -O 2>&1 >/dev/null | grep "^Optimizer:" || true)
+if [[ "$OUT" != "Optimizer: 22 nodes eliminated" ]]; then
+  echo "Test9 failed: unexpected optimizer report: $OUT"
+  exit 2
+fi
+
+# Test 10: every kind of literal reaches the tree through the lexer's side table
+expect_result "Test10" \
+  "let s = \"hi\";\nlet c = 'x';\nlet f = 2.5 * 2.0;\nlet b = !false;\nb = b && (f == 5.0) && (c == 'x') && (s == \"hi\");\n" \
+  "Result: true" --engine=diff
+
+# Test 11: `toy run` parses the whole file first, then runs it silently; a
+# subroutine declared at top level stays callable from later statements
+SCRIPT=$(mktemp --suffix=.lk)
+FOLDED=$(mktemp --suffix=.folded)
+CACHE_DIR=$(mktemp -d)
+trap 'rm -rf "$SCRIPT" "$SCRIPT"c "$FOLDED" "$CACHE_DIR"' EXIT
+printf "subr sq(x: int): int { return x * x; }\nlet r = 0;\nlet i = 0;\nwhile (i < 10) { r += sq(i); i++; }\nif (r != 285) { r = r / 0; }\n" > "$SCRIPT"
+for engine in eval vm diff; do
+  if ! OUT=$("$TOY" run --engine=$engine "$SCRIPT" 2>&1) || [[ -n "$OUT" ]]; then
+    echo "Test11 failed: run --engine=$engine: $OUT"
+    exit 2
+  fi
+done
+printf "let r = 1;\nr = r / 0;\nr = 2;\n" > "$SCRIPT"
+if OUT=$("$TOY" run "$SCRIPT" 2>&1) || [[ "$OUT" != "Error: Division by zero" ]]; then
+  echo "Test11 failed: expected the script to stop on its error, got: $OUT"
+  exit 2
+fi
+printf "let r = 1;\nr = (;\n" > "$SCRIPT"
+if OUT=$("$TOY" run "$SCRIPT" 2>&1) || [[ "$OUT" != Error:* ]]; then
+  echo "Test11 failed: expected a parse error, got: $OUT"
+  exit 2
+fi
+
+# Test 12: numeric literals in every base and suffix, and range errors
+expect_result "Test12" \
+  "let a: short = 0x7fffs;\nlet b: long = 9223372036854775807L;\nlet c: double = 2.5e1d;\nlet d = 0b1010 + 0xffffffff;\nlet f: float = 1.5f;\nlet ok = (a == 32767s) && (b > 0L) && (c == 25.0d) && (d == 9) && (f == 1.5);\nok = ok;\n" \
+  "Result: true" --engine=diff
+OUT=$(printf "let x = 2147483648;\n" | "$TOY" 2>&1 || true)
+if [[ "$OUT" != *"Numeric literal out of range for int: 2147483648"* ]]; then
+  echo "Test12 failed: expected a range error, got: $OUT"
+  exit 2
+fi
+
+# Test 13: a call site's cached subroutine is dropped when it is redeclared,
+# and a failed call leaves nothing behind in the caller's scope
+printf "subr f(x: int): int { return x + 1; }\nsubr g(): int { return f(1); }\nlet a = g();\nsubr f(x: int): int { return x * 10; }\nlet b = g();\nlet d = 0;\nd = a * 100 + b + f(d);\nif (d != 210) { d = d / 0; }\n" > "$SCRIPT"
+for engine in eval vm diff; do
+  if ! OUT=$("$TOY" run --engine=$engine "$SCRIPT" 2>&1) || [[ -n "$OUT" ]]; then
+    echo "Test13 failed: run --engine=$engine: $OUT"
+    exit 2
+  fi
+done
+expect_result "Test13" \
+  "let x = 1;\nsubr f(x: int): int { return x; }\nlet y = f(1 / 0);\nlet z = 2;\nz = z * 10 + x;\n" \
+  "Result: 21" --engine=diff
+
+# Test 14: tail calls reuse the frame, so they are not limited by
+# --max-depth; other calls nested past it raise a RecursionError
+printf "subr count(n: int, acc: int): int { if (n < 1) { return acc; } return count(n - 1, acc + 1); }\nlet r = count(100000, 0);\nif (r != 100000) { r = r / 0; }\n" > "$SCRIPT"
+for engine in eval vm diff; do
+  if ! OUT=$("$TOY" run --max-depth=10 --engine=$engine "$SCRIPT" 2>&1) || [[ -n "$OUT" ]]; then
+    echo "Test14 failed: run --engine=$engine: $OUT"
+    exit 2
+  fi
+done
+printf "subr down(n: int): int { if (n < 1) { return 0; } return 1 + down(n - 1); }\nlet r = down(9);\nr = down(10);\n" > "$SCRIPT"
+for engine in eval vm diff; do
+  if OUT=$("$TOY" run --max-depth=10 --engine=$engine "$SCRIPT" 2>&1) ||
+     [[ "$OUT" != "Error: Maximum recursion depth exceeded in call to: down" ]]; then
+    echo "Test14 failed: expected a RecursionError from --engine=$engine, got: $OUT"
+    exit 2
+  fi
+done
+
+# Test 15: --memo=auto memoizes pure subroutines, so exponential recursion
+# runs in linear time (unmemoized, fib(80) would take hours); `memo` asks for
+# it, by default too, for a subroutine that reads a global, and any
+# declaration drops stale results
+printf "subr fib(n: long): long { if (n < 2L) { return n; } return fib(n - 1L) + fib(n - 2L); }\nlet r = fib(80L);\nif (r != 23416728348467685L) { r = r / 0L; }\n" > "$SCRIPT"
+if ! OUT=$(timeout 10 "$TOY" run --memo=auto "$SCRIPT" 2>&1) || [[ -n "$OUT" ]]; then
+  echo "Test15 failed: fib(80): $OUT"
+  exit 2
+fi
+printf "let k = 2;\nmemo subr scaled(x: int): int { return x * k; }\nlet a = scaled(5);\nk = 3;\nlet b = scaled(5);\nsubr g(x: int): int { return x; }\nlet c = scaled(5);\nif (a * 100 + b * 10 + c != 1115) { c = c / 0; }\n" > "$SCRIPT"
+if ! OUT=$("$TOY" run "$SCRIPT" 2>&1) || [[ -n "$OUT" ]]; then
+  echo "Test15 failed: memo annotation: $OUT"
+  exit 2
+fi
+
+# Test 16: declared types are checked once before running: literal
+# mismatches fail before any statement runs, run-time values convert or
+# fail at the parameter/return they reach, and a tail call is kept when
+# the callee promises the same type
+printf "subr half(x: double): double { return x / 2.0d; }\nsubr f(n: int, acc: float): float { if (n < 1) { return acc; } return f(n - 1, acc + 1); }\nlet a: float = 3;\nlet n = 5;\nlet b = half(n) + a * 0;\nlet c = f(100000, 0);\nif ((b != 2.5d) || (c != 100000.0)) { c = c / 0; }\n" > "$SCRIPT"
+for engine in eval vm diff; do
+  if ! OUT=$("$TOY" run --max-depth=10 --engine=$engine "$SCRIPT" 2>&1) || [[ -n "$OUT" ]]; then
+    echo "Test16 failed: run --engine=$engine: $OUT"
+    exit 2
+  fi
+done
+expect_result "Test16" \
+  "let r = 1;\nr = 2;\n{ r = 3; let s: int = \"three\"; }\nr = r;\n" \
+  "Result: 2"
+for prog in "subr f(x: int): int { if (x > 0) { return x; } }\nlet r = f(0);\n|Missing return value in f: expected int" \
+            "subr f(x: int): int { return x; }\nlet r = f(1.5);\n|Type mismatch in argument x of f: expected int but got float"; do
+  printf "%b" "${prog%|*}" > "$SCRIPT"
+  for engine in eval vm; do
+    if OUT=$("$TOY" run --engine=$engine "$SCRIPT" 2>&1) || [[ "$OUT" != "Error: ${prog#*|}" ]]; then
+      echo "Test16 failed: expected '${prog#*|}' from --engine=$engine, got: $OUT"
+      exit 2
+    fi
+  done
+done
+
+# Test 17: an operator specialized for the operand types it saw first falls
+# back to the generic path when they change, including a zero divisor
+expect_result "Test17" \
+  "let r = 0;\n{ let v = 3; let s = 0; let i = 0; while (i < 4) { s = v * 2; if (i == 1) { v = 1.5; } if (i == 2) { v = 2.5d; } i++; } r = s; }\nr = r;\n" \
+  "Result: 5.000000" --engine=diff
+OUT=$(printf "{ let d = 2; let i = 0; let q = 0; while (i < 3) { q = 10 / d; d--; i++; } }\n" | "$TOY" 2>&1 || true)
+if [[ "$OUT" != *"Error: Division by zero"* ]]; then
+  echo "Test17 failed: expected a division by zero, got: $OUT"
+  exit 2
+fi
+
+# Test 18: check/recheck with many literal arms select through a table,
+# keeping `on` fall-through to later equal arms, the recheck loop, and
+# exact-type matching (a long subject misses int arms)
+expect_result "Test18" \
+  "let r = 0;\n{ check (3) on case 3: r += 1; case 4: r += 10; case 3: r += 100; case 5: r += 1000; case 3: r += 10000; then r = 7; }\n{ let s = 0; let n = 0; recheck (s) only case 0: { s = 2; n += 5; } case 1: { s = 3; n += 50; } case 2: { s = 1; n += 500; } case 3: { s = 9; } r = r * 1000 + n; }\n{ let q = 0; check (3L) only case 1: q = 1; case 2: q = 2; case 3: q = 3; case 4: q = 4; then q = 7; r = r * 10 + q; }\nr = r;\n" \
+  "Result: 101015557" --engine=diff
+
+# Test 19: a loop keeps its body's scope open across iterations: the
+# condition still sees the outer variables a body declaration shadows, each
+# recheck arm starts from an empty scope, and a redeclaration still fails
+expect_result "Test19" \
+  "let r = 0;\n{ let k = 0; while (k < 3) { let v = k; k++; let k = 7; r += k + v; } }\n{ let s = 0; let n = 0; recheck (s) only case 0: { let t = 2; s = t; n += 5; } case 2: { let t = 1; s = 9; n += t * 500; } r = r * 1000 + n; }\nr = r;\n" \
+  "Result: 24505" --engine=diff
+OUT=$(printf "{ let i = 0; while (i < 2) { i++; let a = 1; let a = 2; } }\n" | "$TOY" 2>&1 || true)
+if [[ "$OUT" != *"Error: Variable already declared in this scope: a"* ]]; then
+  echo "Test19 failed: expected a redeclaration error, got: $OUT"
+  exit 2
+fi
+
+# Test 20: --profile samples a script's subroutine calls and lines and
+# writes its folded stacks; it needs a script run by the evaluator
+printf "subr spin(n: int): int {\n  let s = 0;\n  while (n > 0) { s += n; n--; }\n  return s;\n}\nlet i = 0;\nwhile (i < 40) { spin(5000); i++; }\n" > "$SCRIPT"
+OUT=$("$TOY" run --profile="$FOLDED" "$SCRIPT" 2>&1 || true)
+if [[ "$OUT" != *"Profile: "* || "$OUT" != *"spin"* || "$OUT" != *"while (n > 0)"* ]] \
+   || ! grep -q "^<top>;spin [0-9]*$" "$FOLDED"; then
+  echo "Test20 failed: unexpected profile: $OUT"
+  exit 2
+fi
+if OUT=$(printf "let x = 1;\n" | "$TOY" --profile 2>&1) || [[ "$OUT" != *"--profile needs"* ]]; then
+  echo "Test20 failed: expected --profile to need a script, got: $OUT"
+  exit 2
+fi
+
+# Test 21: --stats reports what the evaluator did at exit: here one while
+# statement whose body reused its scope three times, and one error reported.
+# The release build has no counters and says so.
+OUT=$(printf "{ let i = 0; while (i < 3) { let a = i; i++; } }\nx = 1;\n" | "$TOY_DEBUG" --stats 2>&1 || true)
+if [[ "$OUT" != *"Statistics:"* ]] || ! grep -Eq "^ +while +1$" <<<"$OUT" \
+   || ! grep -Eq "scopes pushed +3 \(3 popped, 3 loop reuses\)" <<<"$OUT" \
+   || ! grep -Eq "^ +errors reported +1 " <<<"$OUT"; then
+  echo "Test21 failed: unexpected statistics: $OUT"
+  exit 2
+fi
+OUT=$(printf "let x = 1;\n" | "$TOY" --stats 2>&1 || true)
+if [[ "$OUT" != *"built without statistics"* ]]; then
+  echo "Test21 failed: release build printed statistics: $OUT"
+  exit 2
+fi
+
+# Test 22: `toy run` caches the parsed script next to it and loads it from
+# there while the source is unchanged: the cache is not rewritten, and the
+# cached trees give the same results, -O and --engine=diff included, and the
+# same profile lines. Any change to the source, a damaged cache, or one
+# written by another build (a different key, or build/toy-debug) means
+# parsing again; --no-cache neither reads nor writes one.
+printf "subr tri(n: int): int {\n  let s = 0;\n  while (n > 0) { s += n; n--; }\n  return s;\n}\nlet t = \"x\";\nlet d = 2.5;\nlet r = 0;\nlet i = 0;\nwhile (i < 40) { r += tri(3000 + i) / 1000; i++; }\n{ let k = 0; recheck (k) only case 0: k = 2; case 2: { k = 5; r += 1; } }\nif ((r != 182389) || (t != \"x\") || (d != 2.5)) { r = r / 0; }\n" > "$SCRIPT"
+rm -f "$SCRIPT"c
+if ! OUT=$("$TOY" run "$SCRIPT" 2>&1) || [[ -n "$OUT" ]] || [[ ! -s "$SCRIPT"c ]]; then
+  echo "Test22 failed: expected a first run to write ${SCRIPT}c: $OUT"
+  exit 2
+fi
+touch -d "2000-01-01" "$SCRIPT"c
+for args in "" "-O" "--engine=diff" "-O --engine=vm"; do
+  # shellcheck disable=SC2086
+  if ! OUT=$("$TOY" run $args "$SCRIPT" 2>&1) || [[ -n "$OUT" && "$OUT" != "Optimizer: "* ]]; then
+    echo "Test22 failed: cached run $args: $OUT"
+    exit 2
+  fi
+done
+OUT=$("$TOY" run --profile="$FOLDED" "$SCRIPT" 2>&1 || true)
+if [[ -n $(find "$SCRIPT"c -newermt "2001-01-01") ]] || [[ "$OUT" != *"while (n > 0)"* ]]; then
+  echo "Test22 failed: expected the cache to be used as it was, with its profile lines: $OUT"
+  exit 2
+fi
+sed -i 's/182389/182390/' "$SCRIPT"
+if OUT=$("$TOY" run "$SCRIPT" 2>&1) || [[ "$OUT" != "Error: Division by zero" ]] \
+   || [[ -z $(find "$SCRIPT"c -newermt "2001-01-01") ]]; then
+  echo "Test22 failed: expected an edited script to be parsed again, got: $OUT"
+  exit 2
+fi
+sed -i 's/182390/182389/' "$SCRIPT"
+"$TOY" run "$SCRIPT" >/dev/null 2>&1
+truncate -s 100 "$SCRIPT"c
+if ! OUT=$("$TOY" run "$SCRIPT" 2>&1) || [[ -n "$OUT" ]]; then
+  echo "Test22 failed: expected a damaged cache to be ignored: $OUT"
+  exit 2
+fi
+"$TOY" run "$SCRIPT" >/dev/null 2>&1
+printf '\xde\xad\xbe\xef' | dd of="$SCRIPT"c bs=1 seek=4 conv=notrunc status=none
+touch -d "2000-01-01" "$SCRIPT"c
+if ! OUT=$("$TOY" run "$SCRIPT" 2>&1) || [[ -n "$OUT" ]] \
+   || [[ -z $(find "$SCRIPT"c -newermt "2001-01-01") ]]; then
+  echo "Test22 failed: expected a cache from another build to be written again: $OUT"
+  exit 2
+fi
+"$TOY_DEBUG" run "$SCRIPT" >/dev/null 2>&1
+touch -d "2000-01-01" "$SCRIPT"c
+if ! OUT=$("$TOY" run "$SCRIPT" 2>&1) || [[ -n "$OUT" ]] \
+   || [[ -z $(find "$SCRIPT"c -newermt "2001-01-01") ]]; then
+  echo "Test22 failed: expected the debug build's cache to be a miss for the release build: $OUT"
+  exit 2
+fi
+rm -f "$SCRIPT"c
+if ! OUT=$("$TOY" run --no-cache "$SCRIPT" 2>&1) || [[ -n "$OUT" ]] || [[ -e "$SCRIPT"c ]]; then
+  echo "Test22 failed: expected --no-cache to write nothing: $OUT"
+  exit 2
+fi
+for run in 1 2; do
+  if ! OUT=$("$TOY" run --cache-dir="$CACHE_DIR/lkc" "$SCRIPT" 2>&1) || [[ -n "$OUT" ]] || [[ -e "$SCRIPT"c ]] \
+     || ! ls "$CACHE_DIR"/lkc/*.lkc >/dev/null 2>&1; then
+    echo "Test22 failed: expected the cache in --cache-dir, run $run: $OUT"
+    exit 2
+  fi
+done
+
+# Test 23: the REPL keeps what an input declares for the rest of the session:
+# a subroutine declared in one input is called from later ones, also after
+# it is redeclared and after other inputs have come and gone. Every
+# statement of an input runs, and braces in literals do not continue it.
+expect_result "Test23" \
+  "subr sq(x: int): int { return x * x; }\nlet a = 2; let b = sq(a) + 1;\nlet s = \"}\"; let c = '{';\n{ let t = sq(b); b = t; }\nsubr inc(x: int): int {\n  return sq(x) + 1;\n}\nb = inc(b) + a;\n" \
+  "Result: 628" --engine=diff
+OUT=$(for i in $(seq 1 300); do printf "subr f(x: int): int { return x + %d; }\nlet v%d = f(1);\n{ let w = 0; }\n" "$i" "$i"; done; printf "v300 = f(v150);\n")
+OUT=$(printf "%s" "$OUT" | "$TOY" --engine=diff 2>&1 | tail -n1)
+if [[ "$OUT" != "Result: 451" ]]; then
+  echo "Test23 failed: expected 'Result: 451' after 300 redeclarations, got: $OUT"
+  exit 2
+fi
+
+# Test 24: comparisons with a NaN operand give what the operator kernels
+# give, > and >= true, also once a node has specialized for doubles
+expect_result "Test24" \
+  "let n = 0.0d/0.0d;\nlet r = 0;\nlet i = 0;\nwhile (i < 3) { if (n >= 1.0d) { r += 1; } if (n > 1.0d) { r += 10; } if (n <= 1.0d) { r += 100; } let g = n >= 1.0d; if (g) { r += 1000; } i++; }\nr = r;\n" \
+  "Result: 3033" --engine=diff
+
+# Test 25: a zero divisor of every integral width is a "Division by zero" in
+# both engines, whether the node divides generically, specialized for the
+# types it saw, or as part of /=
+for zero in 0 0s 0L false; do
+  for prog in "let x = 5; x = x / $zero;" "let x = 5; x /= $zero;" \
+              "{ let d = 1; let n = 0; while (n < 3) { let q = 5 / d; d = $zero; n++; } }"; do
+    for engine in eval vm; do
+      OUT=$(printf "%s\n" "$prog" | "$TOY" --engine=$engine 2>&1 || true)
+      if [[ "$OUT" != *"Error: Division by zero"* ]]; then
+        echo "Test25 failed: expected a division by zero from '$prog' on --engine=$engine, got: $OUT"
+        exit 2
+      fi
+    done
+  done
+done
+
+# Test 26: the optimizer leaves a literal division by a zero of any integral
+# width unfolded, so it fails at run time instead of in the folder
+for prog in "let a = 10 / 0L;" "let a = 10 / 0s;" "let a = 10L / 0;"; do
+  for engine in eval vm; do
+    OUT=$(printf "%s\n" "$prog" | "$TOY" -O --engine=$engine 2>&1 || true)
+    if [[ "$OUT" != *"Error: Division by zero"* ]]; then
+      echo "Test26 failed: expected a division by zero from '$prog' with -O --engine=$engine, got: $OUT"
+      exit 2
+    fi
+  done
+done
+
+# Test 27: the VM tests a while condition again after the body, negated;
+# continue, break, a NaN operand and a plain bool condition keep the
+# evaluator's results
+expect_result "Test27" \
+  "let r = 0;\nlet n = 0.0d/0.0d;\n{ let i = 0; while (i < 10) { i++; if (i == 3) { continue; } if (i == 8) { break; } r += i; } }\n{ let k = 0; while (n >= 1.0d) { k++; r += 100; if (k > 2) { break; } } }\n{ let k = 0; while (n < 1.0d) { r += 1000; k++; } }\n{ let go = true; let k = 0; while (go) { k++; go = k < 4; r += 10000; } }\nr = r;\n" \
+  "Result: 40325" --engine=diff
+
+# Test 28: a loop body ending in i++ or i-- runs the step and the loop's
+# test as one VM instruction; every comparison, a double counter and a body
+# whose last statement is an if keep the evaluator's results
+STEP_PROG="let r = 0;\n{ let i = 0; while (i < 5) { r += i; i++; } }\n{ let i = 5; while (i > 0) { r += 10 * i; i--; } }\n{ let i = 0; while (i != 4) { r += 100; i++; } }\n{ let i = 0; while (i <= 2) { if (i == 1) { r += 1000; } i++; } }\n{ let d = 0.5d; while (d < 3.0d) { r += 10000; d++; } }\n{ let i = 0; while (i < 3) { if (i >= 0) { i++; } } r += 100000; }\n{ let i = 3; while (i >= 1) { r += 1000000; i--; } }\nr = r;\n"
+expect_result "Test28" "$STEP_PROG" "Result: 3131560" --engine=vm
+if ! printf "%b" "$STEP_PROG" | "$TOY" --engine=diff >/dev/null 2>&1; then
+  echo "Test28 failed: engines disagree on stepped loops"
+  exit 2
+fi
+
+# Test 29: a type's minimum divided by -1 is an "Integer overflow in
+# division" in both engines and through the optimizer, not a SIGFPE, for
+# int, long and short quotients, plain, as /= and inside a loop
+for prog in "let a = 0x80000000; a = a / -1;" "let a = 0x80000000; a /= -1;" \
+            "{ let d = 1; let n = 0; while (n < 3) { let q = 0x80000000 / d; d = -1; n++; } }" \
+            "let a = 0x8000000000000000L; a = a / -1L;" "let a = 0x8000000000000000L; a /= -1;" \
+            "let a = 0x8000s; let b = 0xFFFFs; a = a / b;" "let a = 0x8000s; a /= 0xFFFFs;"; do
+  for flags in "--engine=eval" "--engine=vm" "-O --engine=eval" "-O --engine=vm"; do
+    status=0
+    OUT=$(printf "%s\n" "$prog" | "$TOY" $flags 2>&1) || status=$?
+    if [[ $status -ge 128 || "$OUT" != *"Error: Integer overflow in division"* ]]; then
+      echo "Test29 failed: expected an overflow error from '$prog' with $flags, got status $status: $OUT"
+      exit 2
+    fi
+  done
+done
+
 echo "All tests passed"
@@ -41,62 +41,39 @@ void Evaluator::eval_decl(const Decl* d) {
 }
 
 void Evaluator::eval_var_decl(const VarDecl* v){
-    Value init_val; // default initialization
-    if (EvalRuntime::stringToValueType(v->type_name) == ValueType::NONE && !v->init)
-        throw RuntimeError("Variable " + v->name + " declared with void type");
-    if (EvalRuntime::is_user_type(v->type_name) && !v->init)
-        throw RuntimeError("Variable " + v->name + " of user-defined type " + v->type_name + " must be initialized");
-    init_val.type = EvalRuntime::stringToValueType(v->type_name);
-    if (init_val.type == ValueType::USERDEFINED && !EvalRuntime::is_user_type(v->type_name))
-        throw RuntimeError("Unknown type for variable " + v->name + ": " + v->type_name);
-    if (init_val.type != ValueType::USERDEFINED && v->init && EvalRuntime::stringToValueType(v->type_name) == ValueType::USERDEFINED)
-        throw RuntimeError("Type mismatch in initialization of variable " + v->name + 
-            ": expected user-defined type but got basic type");
-    if (v->init && init_val.type == ValueType::USERDEFINED) {
-        Value expr_val = eval_expr(v->init.get());
-        if (expr_val.type != ValueType::USERDEFINED || 
-            std::get<userdefined>(expr_val.value).type_name != v->type_name) {
-            throw RuntimeError("Type mismatch in initialization of variable " + v->name + 
-                ": expected user-defined type " + v->type_name + 
-                " but got " + std::get<userdefined>(expr_val.value).type_name);
+    if (v->type_name.empty()) { // `let x = expr;` takes the type of its initializer
+        if (!v->init) throw RuntimeError("Variable " + v->name.str() + " needs a type or an initializer");
+        runtime.decl_local(v->name, v->local, eval_expr(v->init));
+        return;
+    }
+    switch (v->slot.conv) {
+        case TypeConv::Unchecked: { // user-defined type, or the TypeChecker did not run
+            Value init_val;
+            if (v->init) init_val = eval_expr(v->init);
+            runtime.decl_local(v->name, v->local, EvalRuntime::typed_init(v->name, v->type_name, v->init ? &init_val : nullptr));
+            return;
         }
-        init_val = expr_val;
-    } else if (v->init) {
-        Value expr_val = eval_expr(v->init.get());
-        if (expr_val.type != init_val.type) {
-            // Allow implicit conversion from int to float/double
-            if (init_val.type == ValueType::FLOAT && expr_val.type == ValueType::INT) {
-                expr_val.promoteToFloat();
-            } else if (init_val.type == ValueType::DOUBLE && expr_val.type == ValueType::INT) {
-                double d = static_cast<double>(std::get<int>(expr_val.value));
-                expr_val = Value(d);
-                expr_val.type = ValueType::DOUBLE;
-            } else {
-                throw RuntimeError("Type mismatch in initialization of variable " + v->name + 
-                    ": expected " + runtime.valueTypeToString(init_val.type) + 
-                    " but got " + runtime.valueTypeToString(expr_val.type));
-            }
+        case TypeConv::Default:
+            runtime.decl_local(v->name, v->local, Value::defaultFor(v->slot.type));
+            return;
+        default: {
+            Value init_val = eval_expr(v->init);
+            if (!v->slot.accept(init_val))
+                EvalRuntime::type_mismatch("initialization of variable " + v->name.str(), v->slot.type, init_val.type);
+            runtime.decl_local(v->name, v->local, std::move(init_val));
         }
-        init_val = expr_val;
     }
-    // Add variable to current scope
-    runtime.decl_var(v->name, init_val);
 }
 
 void Evaluator::eval_subr_decl(const SubrDecl* s){
     // Register subroutine in the global subr registry
-    std::vector<std::string> param_names;
+    std::vector<Symbol> param_names;
     for (const auto &p : s->params) param_names.push_back(p.first);
     // Expect the body to be a BlockStmt; store pointer for calls
     const BlockStmt* body = nullptr;
-    if (s->body) {
-        body = dynamic_cast<const BlockStmt*>(s->body.get());
-        if (!body) {
-            // If body is not a BlockStmt, we still store nullptr and let calls fail later
-            body = nullptr;
-        }
-    }
-    runtime.decl_subr(s->name, param_names, body);
+    // If body is not a BlockStmt, we still store nullptr and let calls fail later
+    if (s->body && s->body->kind == StmtKind::Block) body = static_cast<const BlockStmt*>(s->body);
+    runtime.decl_subr(s->name, param_names, body, analyze_effects(s), s->memo, s->param_types, s->ret);
  }
 
 
@@ -4,6 +4,7 @@
 #include "decl.hpp"
 #include "interpret.hpp"
 #include "error.hpp"
+#include "profile.hpp"
 #include <stdexcept>
 #include <unordered_map>
 #include <memory>
@@ -14,9 +15,22 @@
 Value Evaluator::eval(const Node* node) {
     switch (node->nodeType) {
         case NodeType::Expr: return eval_expr(static_cast<const Expr*>(node));
-        case NodeType::Stmt: return eval_stmt(static_cast<const Stmt*>(node));
-        case NodeType::Decl: eval_decl(static_cast<const Decl*>(node)); return Value{};
+        case NodeType::Stmt: {
+            // The Resolver rejects return/break/continue outside a subroutine
+            // or loop, so only a normal completion reaches the top level
+            return eval_stmt(static_cast<const Stmt*>(node)).value;
+        }
+        case NodeType::Decl:
+            if (__builtin_expect(runtime.profiler != nullptr, 0)) runtime.profiler->at(node); // statements report themselves
+            eval_decl(static_cast<const Decl*>(node));
+            return Value{};
         default: throw RuntimeError("Unknown node type in evaluation");
     }
 
-}   
\ No newline at end of file
+}
+
+Completion Evaluator::eval_body(const BlockStmt* body) {
+    Completion c = eval_block(body);
+    if (c.flow == Flow::Return || c.flow == Flow::TailCall) return c;
+    return {Value(), Flow::Normal}; // fell off the end: void
+}
@@ -10,13 +10,16 @@
 #include "expr.hpp"
 #include "interpret.hpp"
 #include <algorithm>
+#include <type_traits>
 #include <stdexcept>
 #include <unordered_map>
 #include <memory>
 #include <string>
+#include <variant>
 #include <vector>
 
 Value Evaluator::eval_expr(const Expr* e) {
+    TOY_STAT(exprs[static_cast<int>(e->kind)]++);
     switch (e->kind) {
         case ExprKind::Literal:
             return eval_literal(static_cast<const LiteralExpr*>(e));
@@ -38,61 +41,194 @@ Value Evaluator::eval_literal(const LiteralExpr* l){
 }
 
 Value Evaluator::eval_ident(const IdentExpr* i){
-    // Lookup variable in current scope
-    EvalRuntime::Scope current_scope = runtime.get_current_scope();
-    auto it = std::find_if(current_scope.begin(), current_scope.end(),
-        [&](const EvalRuntime::Var& v) { return v.name == i->name; });
-    if (it != current_scope.end()) {
-        return *(it->addr); // Return the value of the found variable
+    if (i->ref.resolved()) return runtime.slot(i->ref);
+    // Unresolved (REPL global or enclosing frame): search the scopes by name
+    return runtime.get_var(i->name);
+}
+
+namespace {
+
+// The operators the Int and Double forms run inline, computing exactly
+// what the kernels for those operand types do
+bool inline_op(BinaryOp op, ValueType t) {
+    switch (op) {
+        case BinaryOp::And: case BinaryOp::Or: return false;
+        case BinaryOp::BitAnd: case BinaryOp::BitOr: return t == ValueType::INT;
+        default: return true;
     }
-    throw RuntimeError("Undefined variable: " + i->name);
 }
 
-Value Evaluator::eval_binary(const BinaryExpr* b){
-    Value left = eval_expr(b->lhs.get());
-    Value right = eval_expr(b->rhs.get());
-
-    if (b->op == "+") return left + right;
-    if (b->op == "-") return left - right;
-    if (b->op == "*") return left * right;
-    if (b->op == "/") {
-        if (right == 0) throw RuntimeError("Division by zero");
-        return left / right;
+// A comparison as the kernels make it, from < and == only: with a NaN
+// operand > and >= are true, where the native operators say false
+template <typename T>
+bool compare(BinaryOp op, T a, T b) {
+    switch (op) {
+        case BinaryOp::Eq: return a == b;
+        case BinaryOp::Ne: return !(a == b);
+        case BinaryOp::Lt: return a < b;
+        case BinaryOp::Le: return a < b || a == b;
+        case BinaryOp::Gt: return !(a < b || a == b);
+        default: return !(a < b);
     }
-    if (b->op == "==") return left == right;
-    if (b->op == "!=") return left != right;
-    if (b->op == "<") return left < right;
-    if (b->op == "<=") return left <= right;
-    if (b->op == ">") return left > right;
-    if (b->op == ">=") return left >= right;
-    if (b->op == "&&") return left && right;
-    if (b->op == "||") return left || right;
-
-    throw RuntimeError("Unknown binary operator: " + b->op);
 }
 
-Value Evaluator::eval_unary(const UnaryExpr* u){
-    Value operand = eval_expr(u->operand.get());
+template <typename T>
+Value inline_binary(BinaryOp op, T a, T b) {
+    switch (op) {
+        case BinaryOp::Add: return Value(static_cast<T>(a + b));
+        case BinaryOp::Sub: return Value(static_cast<T>(a - b));
+        case BinaryOp::Mul: return Value(static_cast<T>(a * b));
+        case BinaryOp::Div: return Value(static_cast<T>(a / b));
+        case BinaryOp::Eq: case BinaryOp::Ne: case BinaryOp::Lt:
+        case BinaryOp::Le: case BinaryOp::Gt: case BinaryOp::Ge:
+            return Value(compare(op, a, b));
+        default:
+            if constexpr (std::is_integral_v<T>) return Value(op == BinaryOp::BitAnd ? a & b : a | b);
+            else return Value();
+    }
+}
 
-    if (u->op == "-") return -operand;
-    if (u->op == "!") return !operand;
-    if (u->op == "~") return ~operand;
+bool is_leaf(const Expr* e) { return e->kind == ExprKind::Literal || e->kind == ExprKind::Ident; }
 
-    throw RuntimeError("Unknown unary operator: " + u->op);
+bool is_comparison(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::Eq: case BinaryOp::Ne: case BinaryOp::Lt:
+        case BinaryOp::Le: case BinaryOp::Gt: case BinaryOp::Ge:
+            return true;
+        default:
+            return false;
+    }
 }
 
-Value Evaluator::eval_call(const CallExpr* c){
-    Value callee = eval_expr(c->callee.get());
-    if (callee.type != ValueType::STRING) {
-        throw RuntimeError("Attempted to call a non-function value");
+} // namespace
+
+const Value& Evaluator::operand(const Expr* e, Value& tmp) {
+    if (is_leaf(e)) TOY_STAT(exprs[static_cast<int>(e->kind)]++); // eval_expr counts the rest
+    if (e->kind == ExprKind::Literal) return static_cast<const LiteralExpr*>(e)->literal;
+    if (e->kind == ExprKind::Ident) {
+        auto* i = static_cast<const IdentExpr*>(e);
+        return i->ref.resolved() ? runtime.slot(i->ref) : runtime.get_var_ref(i->name);
+    }
+    return tmp = eval_expr(e);
+}
+
+Value Evaluator::eval_binary(const BinaryExpr* b){
+    // Leaf operands are read in place. Evaluating anything else may grow
+    // the stack, so the left one is copied out first unless the right is a leaf.
+    Value ltmp, rtmp;
+    const Value& left = is_leaf(b->rhs) ? operand(b->lhs, ltmp) : (ltmp = eval_expr(b->lhs));
+    const Value& right = operand(b->rhs, rtmp);
+
+    switch (b->form) {
+        case BinaryForm::Int:
+            if (left.type == ValueType::INT && right.type == ValueType::INT) {
+                int r = right.unchecked<int>();
+                if (b->op == BinaryOp::Div) {
+                    if (r == 0) throw RuntimeError("Division by zero");
+                    if (r == -1 && left.unchecked<int>() == std::numeric_limits<int>::min())
+                        throw RuntimeError("Integer overflow in division");
+                }
+                return inline_binary(b->op, left.unchecked<int>(), r);
+            }
+            break;
+        case BinaryForm::Double:
+            if (left.type == ValueType::DOUBLE && right.type == ValueType::DOUBLE)
+                return inline_binary(b->op, left.unchecked<double>(), right.unchecked<double>());
+            break;
+        case BinaryForm::Mono:
+            if (left.type == b->seen_lhs && right.type == b->seen_rhs) {
+                if (b->op == BinaryOp::Div) check_divisor(left, right);
+                return b->kernel(left, right);
+            }
+            break;
+        case BinaryForm::Unseen: {
+            // First run: specialize for these operand types
+            ValueType lt = left.type, rt = right.type;
+            if (lt == rt && (lt == ValueType::INT || lt == ValueType::DOUBLE) && inline_op(b->op, lt))
+                b->form = lt == ValueType::INT ? BinaryForm::Int : BinaryForm::Double;
+            else
+                b->form = BinaryForm::Mono;
+            b->seen_lhs = lt;
+            b->seen_rhs = rt;
+            b->kernel = binary_kernel(b->op, lt, rt);
+            return eval_binary_generic(b->op, left, right);
+        }
+        case BinaryForm::Generic:
+            return eval_binary_generic(b->op, left, right);
     }
-    std::string func_name = callee.get<std::string>();
+    // A guard failed: the node has now seen more than one pair of operand types
+    b->form = BinaryForm::Generic;
+    return eval_binary_generic(b->op, left, right);
+}
 
-    std::vector<Value> arg_values;
-    for (const auto& arg : c->args) {
-        arg_values.push_back(eval_expr(arg.get()));
+bool Evaluator::eval_cond(const Expr* e) {
+    if (e->kind == ExprKind::Binary) {
+        // A comparison in the Int or Double form, on operands read in place
+        auto* b = static_cast<const BinaryExpr*>(e);
+        if ((b->form == BinaryForm::Int || b->form == BinaryForm::Double) && is_comparison(b->op)
+            && is_leaf(b->lhs) && is_leaf(b->rhs)) {
+            Value ltmp, rtmp;
+            const Value& left = operand(b->lhs, ltmp);
+            const Value& right = operand(b->rhs, rtmp);
+            if (b->form == BinaryForm::Int && left.type == ValueType::INT && right.type == ValueType::INT) {
+                TOY_STAT(exprs[static_cast<int>(ExprKind::Binary)]++);
+                return compare(b->op, left.unchecked<int>(), right.unchecked<int>());
+            }
+            if (b->form == BinaryForm::Double && left.type == ValueType::DOUBLE && right.type == ValueType::DOUBLE) {
+                TOY_STAT(exprs[static_cast<int>(ExprKind::Binary)]++);
+                return compare(b->op, left.unchecked<double>(), right.unchecked<double>());
+            }
+            // Otherwise eval_binary takes the guard failure
+        }
     }
+    Value tmp;
+    const Value& cond = operand(e, tmp);
+    if (cond.type != ValueType::BOOL) throw std::bad_variant_access();
+    return cond.unchecked<bool>();
+}
+
+Value Evaluator::eval_binary_generic(BinaryOp op, const Value& left, const Value& right) {
+    if (op == BinaryOp::Div) check_divisor(left, right);
+    return apply(op, left, right);
+}
+
+Value Evaluator::eval_unary(const UnaryExpr* u){
+    return apply(u->op, eval_expr(u->operand));
+}
 
-    return runtime.call_subr(func_name, arg_values, *this);
+Value Evaluator::eval_call(const CallExpr* c){
+    Symbol name;
+    size_t base = runtime.args_base();
+    const Subr* subr = push_call(c, base, name);
+    return runtime.call_subr(name, *subr, base, *this);
+}
 
-}
\ No newline at end of file
+// Evaluates the arguments of `c` onto the stack at `base` and returns the
+// subroutine to call with them; on error nothing is left on the stack
+const Subr* Evaluator::push_call(const CallExpr* c, size_t base, Symbol& name){
+    const bool named = c->callee->kind == ExprKind::Ident;
+    if (named) {
+        // Subroutines live in their own namespace, not in variable scopes
+        name = static_cast<const IdentExpr*>(c->callee)->name;
+    } else {
+        Value callee = eval_expr(c->callee);
+        if (callee.type != ValueType::STRING) {
+            throw RuntimeError("Attempted to call a non-function value");
+        }
+        name = intern(callee.get<std::string>());
+    }
+
+    const Subr* subr = c->cache.subr;
+    try {
+        for (const Expr* arg : c->args) runtime.push_arg(eval_expr(arg));
+        if (!named || c->cache.epoch != EvalRuntime::subr_epoch) {
+            subr = &runtime.lookup_subr(name, c->args.size());
+            // A computed callee may name a different subroutine next time
+            if (named) c->cache = {subr, EvalRuntime::subr_epoch};
+        }
+    } catch (...) {
+        runtime.drop_args(base);
+        throw;
+    }
+    return subr;
+}
@@ -4,13 +4,25 @@
 #include "expr.hpp"
 #include "decl.hpp"
 #include "interpret.hpp"
+#include "profile.hpp"
 #include <iostream>
 #include <stdexcept>
 
-Value Evaluator::eval_stmt(const Stmt* s) {
+Completion Evaluator::eval_stmt(const Stmt* s) {
+    if (__builtin_expect(runtime.profiler != nullptr, 0)) runtime.profiler->at(s);
+    TOY_STAT(stmts[static_cast<int>(s->kind)]++);
     switch (s->kind) {
         case StmtKind::ExprStmt:
-            return eval_expr_stmt(static_cast<const ExprStmt*>(s));
+            return {eval_expr_stmt(static_cast<const ExprStmt*>(s))};
+        case StmtKind::Assign:
+            return {eval_assign(static_cast<const AssignStmt*>(s))};
+        case StmtKind::AssignOp:
+            return {eval_assign_op(static_cast<const AssignOpStmt*>(s))};
+        case StmtKind::IncDec:
+            return {eval_inc_dec(static_cast<const IncDecStmt*>(s))};
+        case StmtKind::Decl:
+            eval_decl(static_cast<const DeclStmt*>(s)->decl);
+            return {};
         case StmtKind::Block:
             return eval_block(static_cast<const BlockStmt*>(s));
         case StmtKind::If:
@@ -19,100 +31,200 @@ Value Evaluator::eval_stmt(const Stmt* s) {
             return eval_while(static_cast<const WhileStmt*>(s));
         case StmtKind::Return:
             return eval_return(static_cast<const ReturnStmt*>(s));
+        case StmtKind::Break:
+            return {Value(), Flow::Break};
+        case StmtKind::Continue:
+            return {Value(), Flow::Continue};
         case StmtKind::Check:
             return eval_check(static_cast<const CheckStmt*>(s));
         case StmtKind::Recheck:
             return eval_recheck(static_cast<const RecheckStmt*>(s));
     }
-    return Value{}; // Default return if no case matches
+    return {}; // Default return if no case matches
 }
 
-Value Evaluator::eval_block(const BlockStmt* b){
+Completion Evaluator::eval_block(const BlockStmt* b){
     // Create a new scope for the block
-    Value ret;
     runtime.push_scope();
+    Completion ret = eval_block_body(b);
+    runtime.pop_scope();
+    return ret;
+}
+
+Completion Evaluator::eval_block_body(const BlockStmt* b){
+    Completion ret;
     // Add any declarations to the current scope
     for (const auto& decl : b->decl) {
-        if (decl) eval_decl(decl.get());
+        if (decl) eval_decl(decl);
     }
-    // Evaluate each statement in the block
-    // If there's a return statement at the end, evaluate it and return its value
-    // Ensure the return type matches the block's expected type if specified
+    // The block's value is its last statement's; a return/break/continue
+    // ends it early and is handed to the enclosing loop or call
     for (const auto& stmt : b->stmts) {
-        ret = eval_stmt(stmt.get());
-    } 
-    runtime.pop_scope();
+        ret = eval_stmt(stmt);
+        if (ret.flow != Flow::Normal) break;
+    }
+    return ret;
+}
+
+// A loop whose body is a block opens the block's scope once and empties it
+// after each run, instead of pushing and popping it every iteration (see
+// WhileStmt::scoped)
+Completion Evaluator::eval_loop_body(const Stmt* body, bool scoped){
+    if (!scoped) return eval_stmt(body);
+    Completion ret = eval_block_body(static_cast<const BlockStmt*>(body));
+    TOY_STAT(scope_clears++);
+    runtime.clear_scope();
     return ret;
 }
 
 Value Evaluator::eval_expr_stmt(const ExprStmt* es){
     // Evaluate expression and discard result, but return void-equivalent Value
-    (void)eval_expr(es->expr.get());
+    (void)eval_expr(es->expr);
     return Value(); // void
 }
 
-Value Evaluator::eval_if(const IfStmt* i){
-    Value ret;
-    Value cond = eval_expr(i->cond.get());
-    if (cond.get<bool>()) {
-        ret = eval_stmt(i->then_branch.get());
-    } else if (i->else_branch) {
-        ret = eval_stmt(i->else_branch.get());
+Value Evaluator::eval_assign(const AssignStmt* a){
+    Value val = eval_expr(a->rhs);
+    if (a->ref.resolved()) runtime.slot(a->ref) = val;
+    else runtime.set_var(a->identifier, val);
+    return val;
+}
+
+Value Evaluator::eval_assign_op(const AssignOpStmt* a){
+    Value rhs = eval_expr(a->rhs);
+    Value& target = a->ref.resolved() ? runtime.slot(a->ref) : runtime.get_var_ref(a->identifier);
+    switch (a->op) {
+        case '+': target = target + rhs; break;
+        case '-': target = target - rhs; break;
+        case '*': target = target * rhs; break;
+        case '/':
+            check_divisor(target, rhs);
+            target = target / rhs;
+            break;
+        default: throw RuntimeError(std::string("Unknown assignment operator: ") + a->op + "=");
     }
-    return ret;
-}   
+    return target;
+}
+
+Value Evaluator::eval_inc_dec(const IncDecStmt* i){
+    Value& target = i->ref.resolved() ? runtime.slot(i->ref) : runtime.get_var_ref(i->identifier);
+    target = (i->op == '+') ? target + Value(1) : target - Value(1);
+    return target;
+}
 
-Value Evaluator::eval_while(const WhileStmt* w){
-    Value ret;
-    while (eval_expr(w->cond.get()).get<bool>()) {
-        ret = eval_stmt(w->body.get());
+Completion Evaluator::eval_if(const IfStmt* i){
+    if (eval_cond(i->cond)) return eval_stmt(i->then_branch);
+    if (i->else_branch) return eval_stmt(i->else_branch);
+    return {};
+}
+
+Completion Evaluator::eval_while(const WhileStmt* w){
+    Value ret; // value of the last body run that completed normally
+    if (w->scoped) runtime.push_scope();
+    while (eval_cond(w->cond)) {
+        Completion body = eval_loop_body(w->body, w->scoped);
+        if (body.flow == Flow::Normal) ret = std::move(body.value);
+        else if (body.flow == Flow::Break) break;
+        else if (body.flow == Flow::Return || body.flow == Flow::TailCall) {
+            if (w->scoped) runtime.pop_scope();
+            return body;
+        }
     }
-    return ret;
+    if (w->scoped) runtime.pop_scope();
+    return {ret};
 }
 
-Value Evaluator::eval_check(const CheckStmt* c){
-    Value expr_val = eval_expr(c->expr.get());
-    Value ret; bool matched = false;
-    for (const auto& arm : c->arms.arms) {
-        Value arm_val = eval_expr(arm.first.get());
-        if (expr_val == arm_val) {
-            matched = true; 
-            ret = eval_stmt(arm.second.get());
-            if (c->execute_first_match) return ret; // Exit after first match if "only" mode
+Completion Evaluator::eval_check(const CheckStmt* c){
+    Value expr_val = eval_expr(c->expr);
+    Completion ret; bool matched = false;
+    if (const ArmTable* table = c->arms.dispatch()) {
+        // Literal arms: jump straight to the matching ones
+        for (std::uint32_t i = table->first(expr_val); i != ArmTable::kNoArm; i = table->next(i)) {
+            matched = true;
+            ret = eval_stmt(c->arms.arms[i].second);
+            if (ret.flow != Flow::Normal) return ret;
+            if (c->execute_first_match) return ret;
+        }
+    } else {
+        for (const auto& arm : c->arms.arms) {
+            Value arm_val = eval_expr(arm.first);
+            if (expr_val == arm_val) {
+                matched = true; 
+                ret = eval_stmt(arm.second);
+                if (ret.flow != Flow::Normal) return ret;
+                if (c->execute_first_match) return ret; // Exit after first match if "only" mode
+            }
         }
     }
     if (c->arms.else_arm && !matched) { // Execute else arm if no match found
-        ret = eval_stmt(c->arms.else_arm.get());
+        ret = eval_stmt(c->arms.else_arm);
     }
     return ret;
 }   
 
-Value Evaluator::eval_recheck(const RecheckStmt* r){
-    // Re-evaluate the expression and re-check the arms
-    Value expr_val = eval_expr(r->expr.get());
-    Value ret; bool matched = false;
-    for (const auto& arm : r->arms.arms) {
-        Value arm_val = eval_expr(arm.first.get());
-        if (expr_val == arm_val) {
-            matched = true;
-            ret = eval_stmt(arm.second.get());
-            if (r->execute_first_match) return ret; // Exit after first match if "only" mode
+// recheck re-evaluates its subject and arms until no arm matches. A `then`
+// arm runs whenever nothing matched and keeps the loop going, so it needs a
+// `break` to end it.
+Completion Evaluator::eval_recheck(const RecheckStmt* r){
+    Value ret; // value of the last matched arm that completed normally
+    const ArmTable* table = r->arms.dispatch();
+    const bool scoped = r->arms.scoped;
+    if (scoped) runtime.push_scope();
+    while (true) {
+        Value expr_val = eval_expr(r->expr);
+        Completion arm_ret; bool matched = false;
+        if (table) {
+            for (std::uint32_t i = table->first(expr_val); i != ArmTable::kNoArm; i = table->next(i)) {
+                matched = true;
+                arm_ret = eval_loop_body(r->arms.arms[i].second, scoped);
+                if (arm_ret.flow != Flow::Normal) break;
+                ret = arm_ret.value;
+                if (r->execute_first_match) break;
+            }
+        } else {
+            for (const auto& arm : r->arms.arms) {
+                Value arm_val = eval_expr(arm.first);
+                if (expr_val == arm_val) {
+                    matched = true;
+                    arm_ret = eval_loop_body(arm.second, scoped);
+                    if (arm_ret.flow != Flow::Normal) break;
+                    ret = arm_ret.value;
+                    if (r->execute_first_match) break; // Only the first match in "only" mode
+                }
+            }
+        }
+        if (!matched) {
+            if (!r->arms.else_arm) break;
+            arm_ret = eval_loop_body(r->arms.else_arm, scoped);
+        }
+        if (arm_ret.flow == Flow::Break) break;
+        if (arm_ret.flow == Flow::Return || arm_ret.flow == Flow::TailCall) {
+            if (scoped) runtime.pop_scope();
+            return arm_ret;
         }
     }
-    if (r->arms.else_arm && !matched) { // Execute else arm if no match found 
-                            // should never exist in recheck unless it contains a break statement (loop ends on no matches found)
-        eval_stmt(r->arms.else_arm.get());
-    }
-    return ret;
+    if (scoped) runtime.pop_scope();
+    return {ret};
 }
 
-
-
-Value Evaluator::eval_return(const ReturnStmt* r){
-    if (r->expr) {
-        throw EvalRuntime::ReturnException(eval_expr(r->expr.get()));
+Completion Evaluator::eval_return(const ReturnStmt* r){
+    if (!r->expr) return {Value(), Flow::Return};
+    Value result;
+    if (r->expr->kind == ExprKind::Call) {
+        // `return f(...)`: evaluate f's arguments here, then let call_subr
+        // run f in place of the current call instead of nesting a new one,
+        // unless f's result still needs converting here
+        Symbol name;
+        size_t base = runtime.args_base();
+        const Subr* subr = push_call(static_cast<const CallExpr*>(r->expr), base, name);
+        if (EvalRuntime::tail_callable(r->slot, subr->ret)) {
+            runtime.tail_call(name, *subr, base);
+            return {Value(), Flow::TailCall};
+        }
+        result = runtime.call_subr(name, *subr, base, *this);
+    } else {
+        result = eval_expr(r->expr);
     }
-    else throw EvalRuntime::ReturnException(Value()); // or std::monostate{} if Value is a variant including monostate
+    if (!r->slot.accept(result)) EvalRuntime::type_mismatch("return from " + r->subr.str(), r->slot.type, result.type);
+    return {std::move(result), Flow::Return};
 }
-
-
@@ -1,26 +1,127 @@
+#include <charconv>
+#include <fstream>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <vector>
+#include <unistd.h>
+#include "error.hpp"
 #include "interpret.hpp"
 #include "lexer.hpp"
 #include "parser.hpp"
 #include "eval.hpp"
+#include "resolver.hpp"
+#include "typecheck.hpp"
+#include "vm.hpp"
+#include "optimizer.hpp"
+#include "source.hpp"
+#include "profile.hpp"
+#include "stats.hpp"
+#include "cache.hpp"
 
-void reploop(){
+enum class Engine { Eval, VM, Diff };
+
+struct Options {
+    Engine engine = Engine::Eval;
+    bool optimize = false; // -O
+    std::size_t max_depth = kDefaultMaxDepth; // --max-depth=N
+    MemoMode memo = MemoMode::Annotated;      // --memo=auto|annotated|off
+    std::string profile; // --profile[=FILE]: where the folded stacks go
+    bool stats = false;  // --stats
+    bool cache = true;     // off with --no-cache
+    std::string cache_dir; // --cache-dir=DIR; empty: next to the script
+};
+
+// Outcome of running one input on one engine, for --engine=diff
+struct Outcome {
+    bool ok;
+    std::string text; // result or error message
+    Value value;
+};
+
+template <typename F>
+static Outcome attempt(F&& run) {
+    try {
+        Value v = run();
+        return {true, v.toString(), v};
+    } catch (const std::exception& e) {
+        return {false, e.what(), Value()};
+    }
+}
+
+// Engines and state shared by every top-level node of a session
+struct Session {
+    Engine engine;
     EvalRuntime runtime;
+    VM vm;
+    bool agreed = true; // false once --engine=diff saw the engines disagree
+
+    explicit Session(const Options& opts) : engine(opts.engine) {
+        runtime.push_scope();
+        runtime.max_depth = opts.max_depth;
+        vm.max_depth = opts.max_depth;
+        EvalRuntime::memo_mode = opts.memo;
+    }
+
+    // Runs one resolved top-level node; throws what the evaluator throws
+    Value execute(const Node* tree) {
+        auto eval = [&] { return Evaluator(runtime).eval(tree); };
+        if (engine == Engine::Eval) return eval();
+        if (engine == Engine::VM) return vm.run(tree);
+
+        Outcome expected = attempt(eval);
+        if (!expected.ok) runtime.unwind_scopes(1);
+        Outcome actual = attempt([&] { return vm.run(tree); });
+        if (expected.ok != actual.ok || expected.text != actual.text) {
+            agreed = false;
+            std::cerr << "Mismatch: eval " << (expected.ok ? "returned " : "failed with ") << expected.text
+                      << ", vm " << (actual.ok ? "returned " : "failed with ") << actual.text << "\n";
+        }
+        if (!expected.ok) throw RuntimeError(expected.text);
+        return expected.value;
+    }
+};
+
+// How many more braces `line` opens than it closes, not counting those in
+// string and character literals
+static int brace_delta(const std::string& line) {
+    int delta = 0;
+    char quote = 0;
+    for (std::size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quote) {
+            if (c == '\\') ++i;
+            else if (c == quote) quote = 0;
+        }
+        else if (c == '"' || c == '\'') quote = c;
+        else if (c == '{') delta++;
+        else if (c == '}') delta--;
+    }
+    return delta;
+}
+
+// Returns false if --engine=diff saw the engines disagree
+bool reploop(const Options& opts){
+    Session session(opts);
+    Optimizer optimizer;
     std::string line, source;
     int brace_balance = 0;
     Lexer lex;
+    const bool interactive = isatty(STDIN_FILENO);
+    // Nodes of the inputs. The evaluator calls a subroutine's body where it
+    // was parsed, so an input that declares one keeps its nodes for the rest
+    // of the session; any other input's are released once it has run, and a
+    // long session only grows with the subroutines it declares.
+    AstArena nodes;
 
     while (true) {
-        std::cout << "> ";
+        if (interactive) std::cout << "> ";
         if (!std::getline(std::cin, line) || line.empty()) break;
 
+        // Only the new line is scanned; the input is parsed once its braces
+        // balance
         source += line + "\n";
-        for (char c : line) {
-            if (c == '{') brace_balance++;
-            else if (c == '}') brace_balance--;
-        }
-
+        brace_balance += brace_delta(line);
         if (brace_balance > 0) continue; // keep reading until closed
         if (brace_balance < 0) {
             std::cerr << "Unmatched closing brace!\n";
@@ -29,26 +130,155 @@ void reploop(){
             continue;
         }
 
-        // Only parse when braces are balanced
-        lex.reset_lexer(source);
-        Parser parser(lex);
-        std::unique_ptr<Node> tree = parser.parse();
-        Evaluator evaluator(runtime);
-        // Initialize runtime if needed
-        if (runtime.is_scope_empty()) runtime.push_scope();
-        Value result = evaluator.eval(static_cast<const Node*>(tree.get()));
-        std::cout << "Result: " << result.toString() << "\n";
+        // Every declaration and statement of the input, in order
+        AstArena::Mark start = nodes.mark();
+        bool keep = false;
+        try {
+            lex.reset_lexer(source);
+            Parser parser(lex, nodes);
+            while (true) {
+                TOY_STAT(phase = Phase::Parse);
+                Node* tree = parser.parse();
+                keep = parser.subr_decls > 0;
+                if (!tree) break;
+                TOY_STAT(phase = Phase::Check);
+                Resolver().resolve(tree);
+                TypeChecker().check(tree);
+                if (opts.optimize) optimizer.optimize(tree, nodes);
+                TOY_STAT(phase = Phase::Eval);
+                Value result = session.execute(tree);
+                std::cout << "Result: " << result.toString() << "\n";
+            }
+            TOY_STAT(phase = Phase::Other);
+        } catch (const std::exception& e) {
+            TOY_STAT(errors++);
+            TOY_STAT(phase = Phase::Other);
+            std::cerr << "Error: " << e.what() << "\n";
+            session.runtime.unwind_scopes(1); // back to the global scope
+        }
+        if (!keep) nodes.release(start);
         source.clear();
-    }       
-    runtime.cleanup_scopes();
-    
+    }
+    if (opts.optimize) std::cerr << "Optimizer: " << optimizer.eliminated() << " nodes eliminated\n";
+    return session.agreed;
+}
+
+// Stops `profiler` and reports on stderr, with the folded stacks in `path`
+void write_profile(Profiler& profiler, const std::string& path) {
+    profiler.stop();
+    profiler.report(std::cerr);
+    std::ofstream out(path);
+    profiler.write_folded(out);
+    if (!out) std::cerr << "toy: cannot write " << path << "\n";
+    else std::cerr << "Folded stacks written to " << path << "\n";
 }
 
-int main() {
-    
-    reploop();
+// `toy run file.lk`: parses and resolves the whole file before running any
+// of it, then runs its top-level declarations and statements in order with
+// no per-line I/O. The first error stops the script. The parsed trees are
+// cached (cache.hpp), and a script that has not changed since is loaded
+// from its cache instead of being parsed again.
+int run_script(const std::string& path, const Options& opts) {
+    Optimizer optimizer;
+    try {
+        TOY_STAT(phase = Phase::Parse);
+        MappedFile file(path);
+        AstArena nodes; // the whole program, freed at exit
+        std::vector<Node*> program;
+        auto check = [&](Node* tree) {
+            TOY_STAT(phase = Phase::Check);
+            Resolver().resolve(tree);
+            TypeChecker().check(tree);
+            if (opts.optimize) optimizer.optimize(tree, nodes);
+            program.push_back(tree);
+            TOY_STAT(phase = Phase::Parse);
+        };
 
+        std::string cache = opts.cache ? cache_path(path, opts.cache_dir) : std::string();
+        std::vector<Node*> cached;
+        if (!cache.empty() && load_cache(cache, file.view(), nodes, cached)) {
+            for (Node* tree : cached) check(tree);
+        } else {
+            Lexer lex(file.view());
+            Parser parser(lex, nodes);
+            CacheWriter writer;
+            while (Node* tree = parser.parse()) {
+                if (!cache.empty()) writer.add(tree); // before -O rewrites it
+                check(tree);
+            }
+            if (!cache.empty()) writer.save(cache, file.view());
+        }
+        TOY_STAT(phase = Phase::Eval);
 
-    return 0;
+        Session session(opts);
+        std::optional<Profiler> profiler;
+        if (!opts.profile.empty()) {
+            profiler.emplace(file.view(), session.runtime.call_stack);
+            session.runtime.profiler = &*profiler;
+            profiler->start();
+        }
+        try {
+            for (const Node* tree : program) session.execute(tree);
+        } catch (...) {
+            if (profiler) write_profile(*profiler, opts.profile);
+            throw;
+        }
+        if (profiler) write_profile(*profiler, opts.profile);
+        if (opts.optimize) std::cerr << "Optimizer: " << optimizer.eliminated() << " nodes eliminated\n";
+        TOY_STAT(phase = Phase::Other);
+        return session.agreed ? 0 : 1;
+    } catch (const std::exception& e) {
+        TOY_STAT(errors++);
+        TOY_STAT(phase = Phase::Other);
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
 }
 
+int main(int argc, char** argv) {
+    Options opts;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--engine=eval") opts.engine = Engine::Eval;
+        else if (arg == "--engine=vm") opts.engine = Engine::VM;
+        else if (arg == "--engine=diff") opts.engine = Engine::Diff;
+        else if (arg == "-O") opts.optimize = true;
+        else if (arg == "--memo=auto") opts.memo = MemoMode::Auto;
+        else if (arg == "--memo=annotated") opts.memo = MemoMode::Annotated;
+        else if (arg == "--memo=off") opts.memo = MemoMode::Off;
+        else if (arg == "--stats") opts.stats = true;
+        else if (arg == "--no-cache") opts.cache = false;
+        else if (arg.rfind("--cache-dir=", 0) == 0 && arg.size() > 12) opts.cache_dir = arg.substr(12);
+        else if (arg == "--profile") opts.profile = "profile.folded";
+        else if (arg.rfind("--profile=", 0) == 0 && arg.size() > 10) opts.profile = arg.substr(10);
+        else if (arg.rfind("--max-depth=", 0) == 0) {
+            const char* digits = arg.c_str() + 12;
+            auto [end, ec] = std::from_chars(digits, arg.c_str() + arg.size(), opts.max_depth);
+            if (ec != std::errc() || *end || *digits == '\0') {
+                std::cerr << "toy: invalid " << arg << "\n";
+                return 64;
+            }
+        }
+        else args.push_back(arg);
+    }
+
+    // Statement offsets point into the script, and only the evaluator
+    // reports the statements it runs
+    bool script = args.size() == 2 && args[0] == "run";
+    if (!opts.profile.empty() && (!script || opts.engine != Engine::Eval)) {
+        std::cerr << "toy: --profile needs `run file.lk` with --engine=eval\n";
+        return 64;
+    }
+    if (!args.empty() && !script) {
+        std::cerr << "usage: toy [-O] [--engine=eval|vm|diff] [--max-depth=N] [--memo=auto|annotated|off]\n"
+                     "           [--profile[=FILE]] [--stats] [--no-cache | --cache-dir=DIR] [run file.lk]\n";
+        return 64;
+    }
+    int status = script ? run_script(args[1], opts) : (reploop(opts) ? 0 : 1);
+    if (opts.stats) {
+        if (TOY_STATS) stats.print(std::cerr);
+        else std::cerr << "toy: built without statistics (NDEBUG); --stats needs build/toy-debug\n";
+    }
+    return status;
+}
@@ -1,11 +1,19 @@
 #include "lexer.hpp"
-#include <cctype>
+#include <array>
+#include <charconv>
 #include <iostream>
 #include <optional>
-#include <unordered_map>
+#include <utility>
 
 
-const std::unordered_map<std::string, TokenType> Lexer::keywords = {
+namespace {
+
+struct Keyword {
+    std::string_view text;
+    TokenType type = TokenType::Ident;
+};
+
+constexpr Keyword keywords[] = {
     {"int", TokenType::KwType},        {"short", TokenType::KwType},
     {"long", TokenType::KwType},       {"char", TokenType::KwType},
     {"bool", TokenType::KwType},       {"float", TokenType::KwType},
@@ -21,94 +29,108 @@ const std::unordered_map<std::string, TokenType> Lexer::keywords = {
     {"union", TokenType::KwUnion},     {"tool", TokenType::KwTool},
     {"kit", TokenType::KwKit},         {"import", TokenType::KwImport},
     {"typeof", TokenType::KwTypeof},   {"sizeof", TokenType::Sizeof},
-    {"true", TokenType::KwTrue},       {"false", TokenType::KwFalse}
+    {"true", TokenType::KwTrue},       {"false", TokenType::KwFalse},
+    {"break", TokenType::KwBreak},     {"continue", TokenType::KwContinue},
+    {"memo", TokenType::KwMemo}
 };
 
+// Keywords are found with a perfect hash: the first and last character and
+// the length select one of kSlots slots, and a single compare confirms it.
+// kSeed is a multiplier under which no two keywords share a slot; if a new
+// keyword breaks the static_assert, search for another odd seed with
+// collision_free().
+constexpr unsigned kSlotBits = 7;
+constexpr unsigned kSlots = 1u << kSlotBits;
+constexpr std::uint32_t kSeed = 824215;
+
+constexpr unsigned keyword_slot(std::string_view s, std::uint32_t seed) {
+    std::uint32_t key = (std::uint32_t(static_cast<unsigned char>(s.front())) << 16) ^
+                        (std::uint32_t(static_cast<unsigned char>(s.back())) << 8) ^
+                        std::uint32_t(s.size());
+    return (key * seed) >> (32 - kSlotBits);
+}
+
+constexpr bool collision_free(std::uint32_t seed) {
+    bool used[kSlots] = {};
+    for (const Keyword& kw : keywords) {
+        unsigned slot = keyword_slot(kw.text, seed);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+static_assert(collision_free(kSeed), "keyword hash has a collision; pick another kSeed");
+
+constexpr std::array<Keyword, kSlots> keyword_table = [] {
+    std::array<Keyword, kSlots> table{};
+    for (const Keyword& kw : keywords) table[keyword_slot(kw.text, kSeed)] = kw;
+    return table;
+}();
+
+// Symbols of the keywords by slot, interned once on first use
+const std::array<Symbol, kSlots>& keyword_symbols() {
+    static const std::array<Symbol, kSlots> symbols = [] {
+        std::array<Symbol, kSlots> syms{};
+        for (unsigned i = 0; i < kSlots; ++i)
+            if (!keyword_table[i].text.empty()) syms[i] = intern(keyword_table[i].text);
+        return syms;
+    }();
+    return symbols;
+}
+
+} // namespace
+
 
 Token Lexer::get_next_token() {
     skip_whitespace();
+    size_t start = pos;
+    Token tok = scan_token();
+    tok.offset = static_cast<std::uint32_t>(start);
+    tok.length = static_cast<std::uint32_t>(pos - start);
+    return tok;
+}
+
+Token Lexer::scan_token() {
     if (pos >= src.size()) {
-        return {TokenType::End, 0, ""};
+        return {TokenType::End};
     }
 
     char c = src[pos];
 
-    Token literal = literal_check();
-    if (literal.type == TokenType::Literal) return literal;
+    if (char_is(c, CharDigit) || c == '\'' || c == '"') return literal_check();
 
     // identifiers / keywords
     if (is_ident_start(c)) {
-        std::string ident;
-        while (pos < src.size() && is_ident_char(src[pos])) {
-            ident.push_back(src[pos++]);
+        size_t start = pos;
+        while (pos < src.size() && is_ident_char(src[pos])) pos++;
+        Token tok = ident_check(src.substr(start, pos - start));
+        if (tok.type == TokenType::KwTrue || tok.type == TokenType::KwFalse) {
+            Value val;
+            val.set<bool>(tok.type == TokenType::KwTrue);
+            return literal_token(val);
         }
-        return ident_check(ident);
+        return tok;
     }
 
-    // access chars and operators
-    Token access_return = access_check();
-    if(access_return.type != TokenType::End) { return access_return; }
-    // single char tokens...
     Token op_return = op_check();
-
-    if(op_return.type != TokenType::End) { return op_return; }
+    if (op_return.type != TokenType::End) { return op_return; }
 
     std::cerr << "Unknown character: " << c << "\n";
-    return {TokenType::End, 0, ""};
+    return {TokenType::End};
 }
 
-Token Lexer::ident_check(const std::string& ident){
-
-     // keyword checks...
-
-        auto it = keywords.find(ident);
-        if (it != keywords.end()) {
-            if (it->first == "true") return {it->second, true, ident};
-            if (it->first == "false") return {it->second, false, ident};
-            return {it->second, 0, ident};
-        }
-
-        return {TokenType::Ident, 0, ident};
+Token Lexer::ident_check(std::string_view ident){
+    unsigned slot = keyword_slot(ident, kSeed);
+    const Keyword& kw = keyword_table[slot];
+    if (kw.text == ident) return {kw.type, 0, 0, keyword_symbols()[slot].id};
+    return {TokenType::Ident, 0, 0, intern(ident).id};
 }
 
 Token Lexer::literal_check(){
     char c = src[pos];
 
-    if (isdigit(c)) {
-    // Number literal
-    int start = pos;
-    bool isFloat = false;
-
-    while (pos < src.size() && isdigit(src[pos])) pos++;
-
-    if (pos < src.size() && src[pos] == '.') {
-        isFloat = true;
-        pos++;
-        while (pos < src.size() && isdigit(src[pos])) pos++;
-    }
-
-    std::string numStr = src.substr(start, pos - start);
-    Value val;
-
-    if (isFloat)
-        val.set<float>(std::stof(numStr));
-    else
-        val.set<int>(std::stoi(numStr));
-
-    return Token{TokenType::Literal, val, ""};
-    }
-
-    // Boolean literals
-    if (match_str("true")) {
-        Value val;
-        val.set<bool>(true);
-        return Token{TokenType::Literal, val, "true"};
-    }
-    if (match_str("false")) {
-        Value val;
-        val.set<bool>(false);
-        return Token{TokenType::Literal, val, "false"};
-    }
+    if (char_is(c, CharDigit)) return number_check();
 
     // Character literal
     if (c == '\'') {
@@ -136,7 +158,7 @@ Token Lexer::literal_check(){
 
         Value val;
         val.set<char>(ch);
-        return Token{TokenType::Literal, val, ""};
+        return literal_token(val);
     }
 
     // String literal
@@ -165,72 +187,180 @@ Token Lexer::literal_check(){
 
         Value val;
         val.set<std::string>(s);
-        return Token{TokenType::Literal, val, ""};
+        return literal_token(val);
     }
 
-    return Token{TokenType::End, 0, ""};
+    return {TokenType::End};
 
 }
 
 
-Token Lexer::op_check() {
-
+// Numeric literals are parsed in place with std::from_chars:
+//   123  0x7f  0b1010     int; suffix s/S for short, l/L for long
+//   1.5  2e3  1.5e-3      float (as before); suffix f/F for float, d/D for double
+// An integer with a float suffix (2d) is a floating literal. Hex and binary
+// literals may use every bit of their type, so 0xffffffff is the int -1.
+// Values that do not fit their type are lexing errors.
+Token Lexer::number_check() {
+    size_t start = pos;
+    int base = 10;
+    if (src[pos] == '0' && pos + 1 < src.size()) {
+        char x = src[pos + 1] | 0x20; // lower case
+        if (x == 'x') base = 16;
+        else if (x == 'b') base = 2;
+    }
 
+    size_t digits = pos;
+    bool floating = false;
+    if (base != 10) {
+        pos += 2;
+        digits = pos;
+        auto is_digit = [base](char d) {
+            if (base == 2) return d == '0' || d == '1';
+            return char_is(d, CharDigit) || ((d | 0x20) >= 'a' && (d | 0x20) <= 'f');
+        };
+        while (pos < src.size() && is_digit(src[pos])) pos++;
+        if (pos == digits)
+            throw std::runtime_error("Missing digits in numeric literal: " + std::string(src.substr(start, pos - start)));
+    } else {
+        while (pos < src.size() && char_is(src[pos], CharDigit)) pos++;
+        if (pos < src.size() && src[pos] == '.') {
+            floating = true;
+            pos++;
+            while (pos < src.size() && char_is(src[pos], CharDigit)) pos++;
+        }
+        if (pos < src.size() && (src[pos] | 0x20) == 'e') {
+            size_t exp = pos + 1;
+            if (exp < src.size() && (src[exp] == '+' || src[exp] == '-')) exp++;
+            if (exp < src.size() && char_is(src[exp], CharDigit)) {
+                floating = true;
+                pos = exp;
+                while (pos < src.size() && char_is(src[pos], CharDigit)) pos++;
+            }
+        }
+    }
+    const char* first = src.data() + digits;
+    const char* last = src.data() + pos;
+
+    ValueType type = floating ? ValueType::FLOAT : ValueType::INT;
+    const char* type_name = floating ? "float" : "int";
+    if (pos < src.size() && is_ident_char(src[pos])) {
+        switch (src[pos++]) {
+            case 's': case 'S': type = ValueType::SHORT; type_name = "short"; break;
+            case 'l': case 'L': type = ValueType::LONG; type_name = "long"; break;
+            case 'f': case 'F': type = ValueType::FLOAT; type_name = "float"; break;
+            case 'd': case 'D': type = ValueType::DOUBLE; type_name = "double"; break;
+            default: type = ValueType::NONE; break;
+        }
+        bool integral_suffix = type == ValueType::SHORT || type == ValueType::LONG;
+        if (type == ValueType::NONE || (floating && integral_suffix) ||
+            (pos < src.size() && is_ident_char(src[pos]))) {
+            while (pos < src.size() && is_ident_char(src[pos])) pos++;
+            throw std::runtime_error("Invalid suffix on numeric literal: " + std::string(src.substr(start, pos - start)));
+        }
+    }
 
-    // Multi-character operators (longest match first)
-    struct OpMap {
-        const char* str;
-        TokenType type;
-    };
-    static const OpMap ops[] = {
-        {"++", TokenType::Increment},   {"+=", TokenType::PlusEq},   {"+", TokenType::Plus},
-        {"--", TokenType::Decrement},   {"-=", TokenType::MinusEq},  {"**", TokenType::Pow}, {"-", TokenType::Minus},
-        {"*=", TokenType::StarEq},      {"*", TokenType::Star},
-        {"/=", TokenType::SlashEq},     {"/", TokenType::Slash},
-        {"&&", TokenType::BoolAnd},     {"&=", TokenType::AmpEq},    {"&", TokenType::Amp},
-        {"||", TokenType::BoolOr},      {"|=", TokenType::PipeEq},   {"|", TokenType::Pipe},
-        {"^=", TokenType::CaretEq},     {"^", TokenType::Caret},
-        {"~", TokenType::Tilde},
-        {"<=", TokenType::Le},          {"<", TokenType::Lt},
-        {">=", TokenType::Ge},          {">", TokenType::Gt},
-        {"==", TokenType::EqEq},        {"=", TokenType::Eq},
-        {"!=", TokenType::NotEq},       {"!", TokenType::Not},
-        {";", TokenType::Semi},
-        {"(", TokenType::LParen},       {")", TokenType::RParen},
-        {"{", TokenType::LBrace},       {"}", TokenType::RBrace}
+    auto out_of_range = [&]() {
+        return std::runtime_error(std::string("Numeric literal out of range for ") + type_name +
+                                  ": " + std::string(src.substr(start, pos - start)));
     };
 
-    for (const auto& op : ops) {
-        if (match_str(op.str, false)) {
-            return Token{op.type, 0, op.str};
+    if (type == ValueType::FLOAT || type == ValueType::DOUBLE) {
+        Value val;
+        std::from_chars_result res;
+        if (type == ValueType::FLOAT) {
+            float f = 0;
+            res = std::from_chars(first, last, f);
+            val = Value(f);
+        } else {
+            double d = 0;
+            res = std::from_chars(first, last, d);
+            val = Value(d);
         }
+        if (res.ec == std::errc::result_out_of_range) throw out_of_range();
+        return literal_token(val);
     }
 
-    return {TokenType::End, 0, ""};
-
+    std::uint64_t u = 0;
+    auto res = std::from_chars(first, last, u, base);
+    // Decimal literals are non-negative values of the signed type; hex and
+    // binary ones are bit patterns of its full width.
+    int bits = type == ValueType::SHORT ? 16 : type == ValueType::LONG ? 64 : 32;
+    std::uint64_t max = base == 10 ? (std::uint64_t(1) << (bits - 1)) - 1
+                                   : bits == 64 ? UINT64_MAX : (std::uint64_t(1) << bits) - 1;
+    if (res.ec == std::errc::result_out_of_range || u > max) throw out_of_range();
+
+    switch (type) {
+        case ValueType::SHORT: return literal_token(Value(static_cast<short>(static_cast<std::uint16_t>(u))));
+        case ValueType::LONG: return literal_token(Value(static_cast<long>(u)));
+        default: return literal_token(Value(static_cast<int>(static_cast<std::uint32_t>(u))));
+    }
 }
 
-Token Lexer::access_check(){
-    if (match_str("->", false)) {
-        return Token{TokenType::Arrow, 0, "->"};
-    }
-    if (match_str(".", false)) {
-        return Token{TokenType::Dot, 0, "."};
-    }
-    if (match_str("?.", false)) {
-        return Token{TokenType::QuestionDot, 0, "?."};
-    }
-    if (match_str("?", false)) {
-        return Token{TokenType::Question, 0, "?"};
-    }
-    if (match_str("::", false)) {
-        return Token{TokenType::DoubleColon, 0, "::"};
-    }
-    if(match_str("$", false)) {
-        return Token{TokenType::Perm, 0, "$"};
-    }
-    if(match_str(":", false)) {
-        return Token{TokenType::Colon, 0, ":"};
+// One switch on the first character, then a peek at the next one; the
+// longer operator wins.
+Token Lexer::op_check() {
+    char c = src[pos];
+    char next = pos + 1 < src.size() ? src[pos + 1] : '\0';
+    auto one = [&](TokenType t) -> Token { pos += 1; return {t}; };
+    auto two = [&](TokenType t) -> Token { pos += 2; return {t}; };
+
+    switch (c) {
+        case '+':
+            if (next == '+') return two(TokenType::Increment);
+            if (next == '=') return two(TokenType::PlusEq);
+            return one(TokenType::Plus);
+        case '-':
+            if (next == '>') return two(TokenType::Arrow);
+            if (next == '-') return two(TokenType::Decrement);
+            if (next == '=') return two(TokenType::MinusEq);
+            return one(TokenType::Minus);
+        case '*':
+            if (next == '*') return two(TokenType::Pow);
+            if (next == '=') return two(TokenType::StarEq);
+            return one(TokenType::Star);
+        case '/':
+            if (next == '=') return two(TokenType::SlashEq);
+            return one(TokenType::Slash);
+        case '&':
+            if (next == '&') return two(TokenType::BoolAnd);
+            if (next == '=') return two(TokenType::AmpEq);
+            return one(TokenType::Amp);
+        case '|':
+            if (next == '|') return two(TokenType::BoolOr);
+            if (next == '=') return two(TokenType::PipeEq);
+            return one(TokenType::Pipe);
+        case '^':
+            if (next == '=') return two(TokenType::CaretEq);
+            return one(TokenType::Caret);
+        case '~': return one(TokenType::Tilde);
+        case '<':
+            if (next == '=') return two(TokenType::Le);
+            return one(TokenType::Lt);
+        case '>':
+            if (next == '=') return two(TokenType::Ge);
+            return one(TokenType::Gt);
+        case '=':
+            if (next == '=') return two(TokenType::EqEq);
+            return one(TokenType::Eq);
+        case '!':
+            if (next == '=') return two(TokenType::NotEq);
+            return one(TokenType::Not);
+        case ';': return one(TokenType::Semi);
+        case ',': return one(TokenType::Comma);
+        case '(': return one(TokenType::LParen);
+        case ')': return one(TokenType::RParen);
+        case '{': return one(TokenType::LBrace);
+        case '}': return one(TokenType::RBrace);
+        // member access and type annotations
+        case '.': return one(TokenType::Dot);
+        case '?':
+            if (next == '.') return two(TokenType::QuestionDot);
+            return one(TokenType::Question);
+        case ':':
+            if (next == ':') return two(TokenType::DoubleColon);
+            return one(TokenType::Colon);
+        case '$': return one(TokenType::Perm);
+        default: return {TokenType::End};
     }
-    return {TokenType::End, 0, ""};
-}
\ No newline at end of file
+}
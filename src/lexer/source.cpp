@@ -0,0 +1,34 @@
+#include "source.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error("Cannot read " + path + ": " + std::strerror(err));
+    }
+    size = static_cast<std::size_t>(st.st_size);
+    if (size > 0) { // mmap rejects empty mappings; an empty file is an empty view
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            int err = errno;
+            close(fd);
+            throw std::runtime_error("Cannot map " + path + ": " + std::strerror(err));
+        }
+        data = static_cast<const char*>(p);
+    }
+    close(fd); // the mapping keeps the file alive
+}
+
+MappedFile::~MappedFile() {
+    if (data) munmap(const_cast<char*>(data), size);
+}
@@ -0,0 +1,15 @@
+#include "symbol.hpp"
+
+SymbolTable& SymbolTable::global() {
+    static SymbolTable table;
+    return table;
+}
+
+Symbol SymbolTable::intern(std::string_view text) {
+    auto it = ids.find(text);
+    if (it != ids.end()) return it->second;
+    Symbol s{static_cast<std::uint32_t>(names.size())};
+    const std::string& stored = names.emplace_back(text);
+    ids.emplace(stored, s);
+    return s;
+}
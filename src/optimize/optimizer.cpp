@@ -0,0 +1,330 @@
+#include "optimizer.hpp"
+#include <exception>
+#include <vector>
+
+namespace {
+
+std::size_t count(const Node* n);
+
+std::size_t count_expr(const Expr* e) {
+    if (!e) return 0;
+    switch (e->kind) {
+        case ExprKind::Literal:
+        case ExprKind::Ident:
+            return 1;
+        case ExprKind::Binary: {
+            auto* b = static_cast<const BinaryExpr*>(e);
+            return 1 + count_expr(b->lhs) + count_expr(b->rhs);
+        }
+        case ExprKind::Unary:
+            return 1 + count_expr(static_cast<const UnaryExpr*>(e)->operand);
+        case ExprKind::Call: {
+            auto* c = static_cast<const CallExpr*>(e);
+            std::size_t n = 1 + count_expr(c->callee);
+            for (const auto& arg : c->args) n += count_expr(arg);
+            return n;
+        }
+    }
+    return 1;
+}
+
+std::size_t count_arms(const CheckArms& arms) {
+    std::size_t n = count(arms.else_arm);
+    for (const auto& arm : arms.arms) n += count_expr(arm.first) + count(arm.second);
+    return n;
+}
+
+std::size_t count_stmt(const Stmt* s) {
+    switch (s->kind) {
+        case StmtKind::ExprStmt: return 1 + count_expr(static_cast<const ExprStmt*>(s)->expr);
+        case StmtKind::Assign: return 1 + count_expr(static_cast<const AssignStmt*>(s)->rhs);
+        case StmtKind::AssignOp: return 1 + count_expr(static_cast<const AssignOpStmt*>(s)->rhs);
+        case StmtKind::Decl: return 1 + count(static_cast<const DeclStmt*>(s)->decl);
+        case StmtKind::Block: {
+            auto* b = static_cast<const BlockStmt*>(s);
+            std::size_t n = 1;
+            for (const auto& d : b->decl) n += count(d);
+            for (const auto& st : b->stmts) n += count(st);
+            return n;
+        }
+        case StmtKind::If: {
+            auto* i = static_cast<const IfStmt*>(s);
+            return 1 + count_expr(i->cond) + count(i->then_branch) + count(i->else_branch);
+        }
+        case StmtKind::While: {
+            auto* w = static_cast<const WhileStmt*>(s);
+            return 1 + count_expr(w->cond) + count(w->body);
+        }
+        case StmtKind::Return: return 1 + count_expr(static_cast<const ReturnStmt*>(s)->expr);
+        case StmtKind::Check: {
+            auto* c = static_cast<const CheckStmt*>(s);
+            return 1 + count_expr(c->expr) + count_arms(c->arms);
+        }
+        case StmtKind::Recheck: {
+            auto* r = static_cast<const RecheckStmt*>(s);
+            return 1 + count_expr(r->expr) + count_arms(r->arms);
+        }
+        case StmtKind::IncDec:
+        case StmtKind::Break:
+        case StmtKind::Continue:
+            return 1;
+    }
+    return 1;
+}
+
+std::size_t count(const Node* n) {
+    if (!n) return 0;
+    switch (n->nodeType) {
+        case NodeType::Expr: return count_expr(static_cast<const Expr*>(n));
+        case NodeType::Stmt: return count_stmt(static_cast<const Stmt*>(n));
+        case NodeType::Decl: {
+            auto* d = static_cast<const Decl*>(n);
+            if (d->kind == DeclKind::Var) return 1 + count_expr(static_cast<const VarDecl*>(d)->init);
+            if (d->kind == DeclKind::Subr) return 1 + count(static_cast<const SubrDecl*>(d)->body);
+            return 1;
+        }
+    }
+    return 1;
+}
+
+const Value* literal(const Expr* e) {
+    if (e && e->kind == ExprKind::Literal) return &static_cast<const LiteralExpr*>(e)->literal;
+    return nullptr;
+}
+
+bool is_comparison(BinaryOp op) {
+    return op == BinaryOp::Eq || op == BinaryOp::Ne || op == BinaryOp::Lt ||
+           op == BinaryOp::Le || op == BinaryOp::Gt || op == BinaryOp::Ge;
+}
+
+// True when every value `e` can produce is a bool (or it throws)
+bool yields_bool(const Expr* e) {
+    switch (e->kind) {
+        case ExprKind::Literal: return static_cast<const LiteralExpr*>(e)->literal.type == ValueType::BOOL;
+        case ExprKind::Binary: {
+            BinaryOp op = static_cast<const BinaryExpr*>(e)->op;
+            return is_comparison(op) || op == BinaryOp::And || op == BinaryOp::Or;
+        }
+        case ExprKind::Unary: return static_cast<const UnaryExpr*>(e)->op == UnaryOp::Not;
+        default: return false;
+    }
+}
+
+// Value defines >= as !(<), > as !(<=) and != as !(==), so each of these is
+// exactly the negation of the other
+BinaryOp negated(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::Eq: return BinaryOp::Ne;
+        case BinaryOp::Ne: return BinaryOp::Eq;
+        case BinaryOp::Lt: return BinaryOp::Ge;
+        case BinaryOp::Ge: return BinaryOp::Lt;
+        case BinaryOp::Le: return BinaryOp::Gt;
+        case BinaryOp::Gt: return BinaryOp::Le;
+        default: return op;
+    }
+}
+
+bool is_bool(const Value* v, bool b) {
+    return v && v->type == ValueType::BOOL && v->get<bool>() == b;
+}
+
+} // namespace
+
+void Optimizer::optimize(Node*& node, AstArena& nodes) {
+    if (!node) return;
+    arena = &nodes;
+    std::size_t before = count(node);
+    switch (node->nodeType) {
+        case NodeType::Expr: {
+            auto* e = static_cast<Expr*>(node);
+            expr(e);
+            node = e;
+            break;
+        }
+        case NodeType::Stmt: {
+            auto* s = static_cast<Stmt*>(node);
+            stmt(s);
+            node = s;
+            break;
+        }
+        case NodeType::Decl:
+            decl(static_cast<Decl*>(node));
+            break;
+    }
+    removed += before - count(node);
+}
+
+void Optimizer::expr(Expr*& e) {
+    switch (e->kind) {
+        case ExprKind::Literal:
+        case ExprKind::Ident:
+            return;
+        case ExprKind::Call:
+            for (auto& arg : static_cast<CallExpr*>(e)->args) expr(arg);
+            return;
+        case ExprKind::Unary: {
+            auto* u = static_cast<UnaryExpr*>(e);
+            expr(u->operand);
+            if (const Value* v = literal(u->operand)) {
+                try {
+                    e = arena->make<LiteralExpr>(apply(u->op, *v));
+                } catch (const std::exception&) {
+                    // Leave the error to be raised when (and if) this runs
+                }
+                return;
+            }
+            if (u->op != UnaryOp::Not) return;
+            if (u->operand->kind == ExprKind::Binary) {
+                auto* b = static_cast<BinaryExpr*>(u->operand);
+                if (is_comparison(b->op)) { // !(a < b) -> a >= b
+                    b->op = negated(b->op);
+                    e = u->operand;
+                }
+            } else if (u->operand->kind == ExprKind::Unary) {
+                auto* inner = static_cast<UnaryExpr*>(u->operand);
+                if (inner->op == UnaryOp::Not && yields_bool(inner->operand)) // !!b -> b
+                    e = inner->operand;
+            }
+            return;
+        }
+        case ExprKind::Binary: {
+            auto* b = static_cast<BinaryExpr*>(e);
+            expr(b->lhs);
+            expr(b->rhs);
+            const Value* l = literal(b->lhs);
+            const Value* r = literal(b->rhs);
+            if (l && r) {
+                // Same guard as Evaluator::eval_binary: the error is left to
+                // run time
+                if (b->op == BinaryOp::Div && (r->is_integral_zero() || l->divides_out_of_range(*r))) return;
+                try {
+                    e = arena->make<LiteralExpr>(apply(b->op, *l, *r));
+                } catch (const std::exception&) {
+                }
+                return;
+            }
+            // b && true, true && b, b || false, false || b -> b
+            bool unit = b->op == BinaryOp::And;
+            if (b->op == BinaryOp::And || b->op == BinaryOp::Or) {
+                if (is_bool(r, unit) && yields_bool(b->lhs)) e = b->lhs;
+                else if (is_bool(l, unit) && yields_bool(b->rhs)) e = b->rhs;
+            }
+            return;
+        }
+    }
+}
+
+void Optimizer::stmt(Stmt*& s) {
+    if (!s) return;
+    switch (s->kind) {
+        case StmtKind::ExprStmt:
+            expr(static_cast<ExprStmt*>(s)->expr);
+            break;
+        case StmtKind::Assign:
+            expr(static_cast<AssignStmt*>(s)->rhs);
+            break;
+        case StmtKind::AssignOp:
+            expr(static_cast<AssignOpStmt*>(s)->rhs);
+            break;
+        case StmtKind::Decl:
+            decl(static_cast<DeclStmt*>(s)->decl);
+            break;
+        case StmtKind::Block: {
+            auto* b = static_cast<BlockStmt*>(s);
+            for (auto& d : b->decl) if (d) decl(d);
+            for (auto& st : b->stmts) stmt(st);
+            break;
+        }
+        case StmtKind::If: {
+            auto* i = static_cast<IfStmt*>(s);
+            expr(i->cond);
+            stmt(i->then_branch);
+            stmt(i->else_branch);
+            const Value* cond = literal(i->cond);
+            if (!cond || cond->type != ValueType::BOOL) break;
+            // An if is not a scope, so the branch can take its place as is
+            Stmt* taken = cond->get<bool>() ? i->then_branch : i->else_branch;
+            s = taken ? taken : arena->make<BlockStmt>();
+            break;
+        }
+        case StmtKind::While: {
+            auto* w = static_cast<WhileStmt*>(s);
+            expr(w->cond);
+            stmt(w->body);
+            if (is_bool(literal(w->cond), false)) s = arena->make<BlockStmt>();
+            break;
+        }
+        case StmtKind::Return: {
+            auto* r = static_cast<ReturnStmt*>(s);
+            if (r->expr) expr(r->expr);
+            break;
+        }
+        case StmtKind::Check:
+            check(s);
+            break;
+        case StmtKind::Recheck: {
+            auto* r = static_cast<RecheckStmt*>(s);
+            expr(r->expr);
+            for (auto& arm : r->arms.arms) {
+                expr(arm.first);
+                stmt(arm.second);
+            }
+            stmt(r->arms.else_arm);
+            break;
+        }
+        case StmtKind::IncDec:
+        case StmtKind::Break:
+        case StmtKind::Continue:
+            break;
+    }
+}
+
+// A check whose subject and arms are all literals always runs the same arm.
+// It is replaced by that arm when at most one arm can run; an `on` check
+// with several matches would need a block, i.e. a new scope, and is kept.
+void Optimizer::check(Stmt*& s) {
+    auto* c = static_cast<CheckStmt*>(s);
+    expr(c->expr);
+    bool constant = literal(c->expr) != nullptr;
+    for (auto& arm : c->arms.arms) {
+        expr(arm.first);
+        stmt(arm.second);
+        constant = constant && literal(arm.first);
+    }
+    stmt(c->arms.else_arm);
+    if (!constant) return;
+
+    const Value& subject = *literal(c->expr);
+    std::vector<Stmt**> runs;
+    for (auto& arm : c->arms.arms) {
+        if (subject == *literal(arm.first)) {
+            runs.push_back(&arm.second);
+            if (c->execute_first_match) break;
+        }
+    }
+    if (runs.size() > 1) return;
+    Stmt* taken = runs.empty() ? c->arms.else_arm : *runs.front();
+    s = taken ? taken : arena->make<BlockStmt>();
+}
+
+void Optimizer::decl(Decl* d) {
+    switch (d->kind) {
+        case DeclKind::Var: {
+            auto* v = static_cast<VarDecl*>(d);
+            if (v->init) expr(v->init);
+            break;
+        }
+        case DeclKind::Subr:
+            // The body must stay a BlockStmt; only its contents change
+            stmt(static_cast<SubrDecl*>(d)->body);
+            break;
+        case DeclKind::Tool:
+            for (auto& m : static_cast<ToolDecl*>(d)->methods) decl(m);
+            break;
+        case DeclKind::Kit:
+            for (auto& e : static_cast<KitDecl*>(d)->exports) decl(e);
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,39 @@
+#include "arena.hpp"
+#include <cstdint>
+
+void* AstArena::allocate(std::size_t size, std::size_t align) {
+    auto aligned = [&](std::byte* p) {
+        auto addr = reinterpret_cast<std::uintptr_t>(p);
+        return reinterpret_cast<std::byte*>((addr + align - 1) & ~(std::uintptr_t(align) - 1));
+    };
+    std::byte* p = next ? aligned(next) : nullptr;
+    if (!p || p + size > end) {
+        std::size_t chunk = size > kChunkSize ? size : kChunkSize;
+        chunks.emplace_back(new std::byte[chunk]);
+        p = chunks.back().get(); // new[] is aligned for any node type
+        end = p + chunk;
+    }
+    next = p + size;
+    used += size;
+    return p;
+}
+
+void AstArena::clear() {
+    // Later nodes may point at earlier ones but never own them, so the order
+    // does not matter
+    for (const Finalizer& f : finalizers) f.destroy(f.node);
+    finalizers.clear();
+    chunks.clear();
+    next = end = nullptr;
+    count = used = 0;
+}
+
+void AstArena::release(const Mark& m) {
+    for (std::size_t i = m.finalizers; i < finalizers.size(); ++i) finalizers[i].destroy(finalizers[i].node);
+    finalizers.resize(m.finalizers);
+    chunks.resize(m.chunks);
+    next = m.next;
+    end = m.end;
+    count = m.count;
+    used = m.used;
+}
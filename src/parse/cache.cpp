@@ -0,0 +1,639 @@
+#include "cache.hpp"
+#include "expr.hpp"
+#include "stmt.hpp"
+#include "decl.hpp"
+#include "source.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout, all integers little-endian as the host writes them:
+//
+//   header   "TOYC", build key u32, source hash u64, source length u64,
+//            name count u32, tree count u32
+//   names    per name: length, bytes
+//   trees    one node per top-level tree, in order
+//
+// after the header every integer is an unsigned LEB128. A node is its tag
+// (0 for a null child, else 1 + NodeType * 16 + kind), for a statement or
+// declaration its source offset (0 for none, else 1 + the zigzagged
+// distance from the last one written), and then its fields, children first where the reader needs them to make
+// the node; a symbol is 0 for none or 1 + its index among the names.
+
+namespace {
+
+constexpr char kMagic[4] = {'T', 'O', 'Y', 'C'};
+
+struct Header {
+    char magic[4];
+    std::uint32_t build;
+    std::uint64_t hash;
+    std::uint64_t length;
+    std::uint32_t names;
+    std::uint32_t trees;
+};
+static_assert(sizeof(Header) == 32, "no padding in the header");
+
+void put_uint(std::string& out, std::uint64_t n) {
+    while (n >= 0x80) {
+        out += static_cast<char>(n | 0x80);
+        n >>= 7;
+    }
+    out += static_cast<char>(n);
+}
+
+unsigned tag(NodeType type, unsigned kind) { return 1 + static_cast<unsigned>(type) * 16 + kind; }
+
+std::uint64_t zigzag(std::int64_t n) { return (static_cast<std::uint64_t>(n) << 1) ^ (n < 0 ? ~0ULL : 0); }
+std::int64_t unzigzag(std::uint64_t n) { return static_cast<std::int64_t>(n >> 1) ^ -static_cast<std::int64_t>(n & 1); }
+
+} // namespace
+
+// FNV-1a over 8-byte words rather than bytes, which is plenty to tell one
+// version of a script from another and runs at memory speed
+std::uint64_t source_hash(std::string_view source) {
+    constexpr std::uint64_t kPrime = 0x100000001b3ULL;
+    std::uint64_t h = 0xcbf29ce484222325ULL;
+    std::size_t i = 0;
+    for (; i + 8 <= source.size(); i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, source.data() + i, 8);
+        h = (h ^ word) * kPrime;
+    }
+    for (; i < source.size(); ++i) h = (h ^ static_cast<unsigned char>(source[i])) * kPrime;
+    return h;
+}
+
+std::uint32_t cache_build_key() {
+    static const std::uint32_t key = [] {
+        std::string id = std::to_string(sizeof(Expr)) + " " + std::to_string(sizeof(Stmt)) + " " +
+                         std::to_string(sizeof(Decl)) + " ";
+        struct stat st;
+        if (stat("/proc/self/exe", &st) == 0)
+            id += std::to_string(st.st_size) + " " + std::to_string(st.st_mtim.tv_sec) + "." +
+                  std::to_string(st.st_mtim.tv_nsec);
+        else
+            id += __DATE__ " " __TIME__;
+        std::uint64_t h = source_hash(id);
+        return static_cast<std::uint32_t>(h ^ (h >> 32));
+    }();
+    return key;
+}
+
+std::string cache_path(const std::string& source_path, const std::string& dir) {
+    if (dir.empty()) return source_path + "c";
+    char resolved[PATH_MAX];
+    std::string absolute = realpath(source_path.c_str(), resolved) ? resolved : source_path;
+    std::string stem = absolute.substr(absolute.find_last_of('/') + 1);
+    if (std::size_t dot = stem.rfind('.'); dot != std::string::npos && dot > 0) stem.resize(dot);
+    char hex[17];
+    std::snprintf(hex, sizeof hex, "%016llx", static_cast<unsigned long long>(source_hash(absolute)));
+    return dir + "/" + stem + "-" + hex + ".lkc";
+}
+
+void CacheWriter::add(const Node* tree) {
+    node(tree);
+    ++trees;
+}
+
+void CacheWriter::uint(std::uint64_t n) { put_uint(body, n); }
+
+void CacheWriter::offset(std::uint32_t at) {
+    if (!at) return uint(0);
+    uint(zigzag(std::int64_t(at) - last_offset) + 1);
+    last_offset = at;
+}
+
+void CacheWriter::symbol(Symbol s) {
+    if (s.empty()) return uint(0);
+    auto [it, added] = indexes.emplace(s, static_cast<std::uint32_t>(names.size()));
+    if (added) names.push_back(s);
+    uint(it->second + 1);
+}
+
+void CacheWriter::value(const Value& v) {
+    uint(static_cast<unsigned>(v.type));
+    switch (v.type) {
+        case ValueType::INT: return uint(zigzag(v.unchecked<int>()));
+        case ValueType::SHORT: return uint(zigzag(v.unchecked<short>()));
+        case ValueType::LONG: return uint(zigzag(v.unchecked<long>()));
+        case ValueType::CHAR: return uint(zigzag(v.unchecked<char>()));
+        case ValueType::BOOL: return uint(v.unchecked<bool>());
+        case ValueType::FLOAT: {
+            float f = v.unchecked<float>();
+            return bytes(&f, sizeof f);
+        }
+        case ValueType::DOUBLE: {
+            double d = v.unchecked<double>();
+            return bytes(&d, sizeof d);
+        }
+        case ValueType::STRING: {
+            std::string s = v.unchecked<std::string>();
+            uint(s.size());
+            return bytes(s.data(), s.size());
+        }
+        case ValueType::NONE: return;
+        case ValueType::USERDEFINED: ok = false; return; // the parser never makes one
+    }
+}
+
+void CacheWriter::node(const Node* n) {
+    if (!n) return uint(0);
+    switch (n->nodeType) {
+        case NodeType::Expr: return expr(static_cast<const Expr*>(n));
+        case NodeType::Stmt: return stmt(static_cast<const Stmt*>(n));
+        case NodeType::Decl: return decl(static_cast<const Decl*>(n));
+    }
+}
+
+void CacheWriter::expr(const Expr* e) {
+    uint(tag(NodeType::Expr, static_cast<unsigned>(e->kind))); // no offset: the parser records none
+    switch (e->kind) {
+        case ExprKind::Literal: return value(static_cast<const LiteralExpr*>(e)->literal);
+        case ExprKind::Ident: return symbol(static_cast<const IdentExpr*>(e)->name);
+        case ExprKind::Binary: {
+            auto b = static_cast<const BinaryExpr*>(e);
+            uint(static_cast<unsigned>(b->op));
+            node(b->lhs);
+            return node(b->rhs);
+        }
+        case ExprKind::Unary: {
+            auto u = static_cast<const UnaryExpr*>(e);
+            uint(static_cast<unsigned>(u->op));
+            return node(u->operand);
+        }
+        case ExprKind::Call: {
+            auto c = static_cast<const CallExpr*>(e);
+            node(c->callee);
+            uint(c->args.size());
+            for (const Expr* arg : c->args) node(arg);
+            return;
+        }
+    }
+}
+
+void CacheWriter::arms(const CheckArms& a) {
+    uint(a.arms.size());
+    for (const auto& [match, body] : a.arms) {
+        node(match);
+        node(body);
+    }
+    node(a.else_arm);
+}
+
+void CacheWriter::stmt(const Stmt* s) {
+    uint(tag(NodeType::Stmt, static_cast<unsigned>(s->kind)));
+    offset(s->offset);
+    switch (s->kind) {
+        case StmtKind::ExprStmt: return node(static_cast<const ExprStmt*>(s)->expr);
+        case StmtKind::Assign: {
+            auto a = static_cast<const AssignStmt*>(s);
+            node(a->rhs);
+            return symbol(a->identifier);
+        }
+        case StmtKind::AssignOp: {
+            auto a = static_cast<const AssignOpStmt*>(s);
+            node(a->rhs);
+            symbol(a->identifier);
+            return uint(static_cast<unsigned char>(a->op));
+        }
+        case StmtKind::IncDec: {
+            auto i = static_cast<const IncDecStmt*>(s);
+            symbol(i->identifier);
+            return uint(static_cast<unsigned char>(i->op));
+        }
+        case StmtKind::Decl: return node(static_cast<const DeclStmt*>(s)->decl);
+        case StmtKind::Block: {
+            auto b = static_cast<const BlockStmt*>(s);
+            uint(b->stmts.size());
+            for (const Stmt* st : b->stmts) node(st);
+            node(b->rturn_stmt);
+            symbol(b->type_name);
+            uint(b->decl.size());
+            for (const Decl* d : b->decl) node(d);
+            return;
+        }
+        case StmtKind::If: {
+            auto i = static_cast<const IfStmt*>(s);
+            node(i->cond);
+            node(i->then_branch);
+            return node(i->else_branch);
+        }
+        case StmtKind::While: {
+            auto w = static_cast<const WhileStmt*>(s);
+            node(w->cond);
+            return node(w->body);
+        }
+        case StmtKind::Return: return node(static_cast<const ReturnStmt*>(s)->expr);
+        case StmtKind::Break:
+        case StmtKind::Continue: return;
+        case StmtKind::Check: {
+            auto c = static_cast<const CheckStmt*>(s);
+            node(c->expr);
+            arms(c->arms);
+            return uint(c->execute_first_match);
+        }
+        case StmtKind::Recheck: {
+            auto r = static_cast<const RecheckStmt*>(s);
+            node(r->expr);
+            arms(r->arms);
+            return uint(r->execute_first_match);
+        }
+    }
+}
+
+void CacheWriter::decl(const Decl* d) {
+    uint(tag(NodeType::Decl, static_cast<unsigned>(d->kind)));
+    offset(d->offset);
+    auto pairs = [&](const std::vector<std::pair<Symbol, Symbol>>& list) {
+        uint(list.size());
+        for (const auto& [name, type] : list) {
+            symbol(name);
+            symbol(type);
+        }
+    };
+    auto decls = [&](const std::vector<Decl*>& list) {
+        uint(list.size());
+        for (const Decl* member : list) node(member);
+    };
+    switch (d->kind) {
+        case DeclKind::Var: {
+            auto v = static_cast<const VarDecl*>(d);
+            node(v->init);
+            symbol(v->name);
+            return symbol(v->type_name);
+        }
+        case DeclKind::Subr: {
+            auto s = static_cast<const SubrDecl*>(d);
+            node(s->body);
+            symbol(s->name);
+            symbol(s->return_type);
+            pairs(s->params);
+            return uint(s->memo);
+        }
+        case DeclKind::Struct: {
+            auto s = static_cast<const StructDecl*>(d);
+            symbol(s->name);
+            return pairs(s->fields);
+        }
+        case DeclKind::Enum: {
+            auto e = static_cast<const EnumDecl*>(d);
+            symbol(e->name);
+            uint(e->values.size());
+            for (Symbol v : e->values) symbol(v);
+            return;
+        }
+        case DeclKind::Union: {
+            auto u = static_cast<const UnionDecl*>(d);
+            symbol(u->name);
+            return pairs(u->variants);
+        }
+        case DeclKind::Tool: {
+            auto t = static_cast<const ToolDecl*>(d);
+            symbol(t->name);
+            return decls(t->methods);
+        }
+        case DeclKind::Kit: {
+            auto k = static_cast<const KitDecl*>(d);
+            symbol(k->name);
+            return decls(k->exports);
+        }
+    }
+}
+
+bool CacheWriter::save(const std::string& path, std::string_view source) const {
+    if (!ok) return false;
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof kMagic);
+    header.build = cache_build_key();
+    header.hash = source_hash(source);
+    header.length = source.size();
+    header.names = static_cast<std::uint32_t>(names.size());
+    header.trees = trees;
+
+    std::string head(reinterpret_cast<const char*>(&header), sizeof header);
+    for (Symbol s : names) {
+        const std::string& text = s.str();
+        put_uint(head, text.size());
+        head += text;
+    }
+
+    std::string temp = path + ".tmp" + std::to_string(getpid());
+    std::FILE* f = std::fopen(temp.c_str(), "wb");
+    if (!f && errno == ENOENT) { // a --cache-dir not made yet
+        std::size_t slash = path.find_last_of('/');
+        if (slash != std::string::npos && slash > 0) mkdir(path.substr(0, slash).c_str(), 0777);
+        f = std::fopen(temp.c_str(), "wb");
+    }
+    if (!f) return false;
+    bool written = std::fwrite(head.data(), 1, head.size(), f) == head.size() &&
+                   std::fwrite(body.data(), 1, body.size(), f) == body.size();
+    if (std::fclose(f) != 0) written = false;
+    if (written && std::rename(temp.c_str(), path.c_str()) == 0) return true;
+    std::remove(temp.c_str());
+    return false;
+}
+
+namespace {
+
+// Walks the mapped file; every read is bounds-checked and anything that does
+// not decode throws, which load_cache turns into a miss
+struct CacheReader {
+    CacheReader(std::string_view data, AstArena& arena)
+        : p(reinterpret_cast<const unsigned char*>(data.data())), end(p + data.size()), arena(arena) {}
+
+    const unsigned char* p;
+    const unsigned char* end;
+    AstArena& arena;
+    std::vector<Symbol> names;
+    std::int64_t last_offset = 0;
+
+    [[noreturn]] static void fail() { throw std::runtime_error("damaged cache"); }
+
+    std::uint64_t uint() {
+        std::uint64_t n = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p == end) fail();
+            unsigned char byte = *p++;
+            n |= std::uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return n;
+        }
+        fail();
+    }
+
+    std::uint64_t below(std::uint64_t limit) {
+        std::uint64_t n = uint();
+        if (n >= limit) fail();
+        return n;
+    }
+
+    // One of the operator characters in `valid`
+    char op(const char* valid) {
+        std::uint64_t c = uint();
+        if (c == 0 || c > 0x7f || !std::strchr(valid, static_cast<int>(c))) fail();
+        return static_cast<char>(c);
+    }
+
+    // A count of things that take at least a byte each
+    std::size_t count() {
+        std::uint64_t n = uint();
+        if (n > std::uint64_t(end - p)) fail();
+        return static_cast<std::size_t>(n);
+    }
+
+    std::string_view text() {
+        std::size_t n = count();
+        std::string_view s(reinterpret_cast<const char*>(p), n);
+        p += n;
+        return s;
+    }
+
+    template <typename T>
+    T raw() {
+        if (std::size_t(end - p) < sizeof(T)) fail();
+        T v;
+        std::memcpy(&v, p, sizeof v);
+        p += sizeof v;
+        return v;
+    }
+
+    std::uint32_t offset() {
+        std::uint64_t n = uint();
+        if (!n) return 0;
+        last_offset += unzigzag(n - 1);
+        if (last_offset <= 0 || last_offset > UINT32_MAX) fail();
+        return static_cast<std::uint32_t>(last_offset);
+    }
+
+    Symbol symbol() {
+        std::uint64_t i = uint();
+        if (i == 0) return Symbol{};
+        if (i > names.size()) fail();
+        return names[i - 1];
+    }
+
+    std::vector<std::pair<Symbol, Symbol>> pairs() {
+        std::vector<std::pair<Symbol, Symbol>> list(count());
+        for (auto& [name, type] : list) {
+            name = symbol();
+            type = symbol();
+        }
+        return list;
+    }
+
+    Value value() {
+        switch (static_cast<ValueType>(uint())) {
+            case ValueType::INT: return Value(static_cast<int>(unzigzag(uint())));
+            case ValueType::SHORT: return Value(static_cast<short>(unzigzag(uint())));
+            case ValueType::LONG: return Value(static_cast<long>(unzigzag(uint())));
+            case ValueType::CHAR: return Value(static_cast<char>(unzigzag(uint())));
+            case ValueType::BOOL: return Value(uint() != 0);
+            case ValueType::FLOAT: return Value(raw<float>());
+            case ValueType::DOUBLE: return Value(raw<double>());
+            case ValueType::STRING: return Value(std::string(text()));
+            case ValueType::NONE: return Value();
+            default: fail();
+        }
+    }
+
+    // A node of type `want`, or null if `optional`
+    Node* node(NodeType want, bool optional) {
+        unsigned t = static_cast<unsigned>(uint());
+        if (t == 0) {
+            if (!optional) fail();
+            return nullptr;
+        }
+        --t;
+        if (t / 16 != static_cast<unsigned>(want)) fail();
+        if (want == NodeType::Expr) return expr(t % 16);
+        std::uint32_t at = offset();
+        Node* n = want == NodeType::Stmt ? static_cast<Node*>(stmt(t % 16)) : decl(t % 16);
+        n->offset = at;
+        return n;
+    }
+    Expr* expr(bool optional = false) { return static_cast<Expr*>(node(NodeType::Expr, optional)); }
+    Stmt* stmt(bool optional = false) { return static_cast<Stmt*>(node(NodeType::Stmt, optional)); }
+    Decl* decl(bool optional = false) { return static_cast<Decl*>(node(NodeType::Decl, optional)); }
+
+    Expr* expr(unsigned kind) {
+        switch (static_cast<ExprKind>(kind)) {
+            case ExprKind::Literal: return arena.make<LiteralExpr>(value());
+            case ExprKind::Ident: return arena.make<IdentExpr>(symbol());
+            case ExprKind::Binary: {
+                auto op = static_cast<BinaryOp>(below(kBinaryOpCount));
+                Expr* lhs = expr();
+                return arena.make<BinaryExpr>(op, lhs, expr());
+            }
+            case ExprKind::Unary: {
+                auto op = static_cast<UnaryOp>(below(kUnaryOpCount));
+                return arena.make<UnaryExpr>(op, expr());
+            }
+            case ExprKind::Call: {
+                Expr* callee = expr();
+                std::vector<Expr*> args(count());
+                for (Expr*& arg : args) arg = expr();
+                return arena.make<CallExpr>(callee, std::move(args));
+            }
+        }
+        fail();
+    }
+
+    CheckArms arms() {
+        CheckArms a;
+        a.arms.resize(count());
+        for (auto& [match, body] : a.arms) {
+            match = expr();
+            body = stmt();
+        }
+        a.else_arm = stmt(true);
+        return a;
+    }
+
+    Stmt* stmt(unsigned kind) {
+        switch (static_cast<StmtKind>(kind)) {
+            case StmtKind::ExprStmt: return arena.make<ExprStmt>(expr());
+            case StmtKind::Assign: {
+                Expr* rhs = expr();
+                return arena.make<AssignStmt>(rhs, symbol());
+            }
+            case StmtKind::AssignOp: {
+                Expr* rhs = expr();
+                Symbol id = symbol();
+                return arena.make<AssignOpStmt>(id, rhs, op("+-*/"));
+            }
+            case StmtKind::IncDec: {
+                Symbol id = symbol();
+                return arena.make<IncDecStmt>(id, op("+-"));
+            }
+            case StmtKind::Decl: return arena.make<DeclStmt>(decl());
+            case StmtKind::Block: {
+                auto b = arena.make<BlockStmt>();
+                b->stmts.resize(count());
+                for (Stmt*& s : b->stmts) s = stmt();
+                Stmt* r = stmt(true);
+                if (r && r->kind != StmtKind::Return) fail();
+                b->rturn_stmt = static_cast<ReturnStmt*>(r);
+                b->type_name = symbol();
+                b->decl.resize(count());
+                for (Decl*& d : b->decl) d = decl(true);
+                return b;
+            }
+            case StmtKind::If: {
+                Expr* cond = expr();
+                Stmt* then_branch = stmt();
+                return arena.make<IfStmt>(cond, then_branch, stmt(true));
+            }
+            case StmtKind::While: {
+                Expr* cond = expr();
+                return arena.make<WhileStmt>(cond, stmt());
+            }
+            case StmtKind::Return: return arena.make<ReturnStmt>(expr(true));
+            case StmtKind::Break: return arena.make<BreakStmt>();
+            case StmtKind::Continue: return arena.make<ContinueStmt>();
+            case StmtKind::Check: {
+                Expr* subject = expr();
+                auto c = arena.make<CheckStmt>(subject, arms());
+                c->execute_first_match = uint() != 0;
+                return c;
+            }
+            case StmtKind::Recheck: {
+                Expr* subject = expr();
+                auto r = arena.make<RecheckStmt>(subject, arms());
+                r->execute_first_match = uint() != 0;
+                return r;
+            }
+        }
+        fail();
+    }
+
+    Decl* decl(unsigned kind) {
+        auto decls = [&] {
+            std::vector<Decl*> list(count());
+            for (Decl*& d : list) d = decl();
+            return list;
+        };
+        switch (static_cast<DeclKind>(kind)) {
+            case DeclKind::Var: {
+                Expr* init = expr(true);
+                Symbol name = symbol();
+                return arena.make<VarDecl>(name, symbol(), init);
+            }
+            case DeclKind::Subr: {
+                Stmt* body = stmt(true);
+                Symbol name = symbol();
+                auto s = arena.make<SubrDecl>(name, symbol());
+                s->body = body;
+                s->params = pairs();
+                s->memo = uint() != 0;
+                return s;
+            }
+            case DeclKind::Struct: {
+                auto s = arena.make<StructDecl>(symbol());
+                s->fields = pairs();
+                return s;
+            }
+            case DeclKind::Enum: {
+                auto e = arena.make<EnumDecl>(symbol());
+                e->values.resize(count());
+                for (Symbol& v : e->values) v = symbol();
+                return e;
+            }
+            case DeclKind::Union: {
+                auto u = arena.make<UnionDecl>(symbol());
+                u->variants = pairs();
+                return u;
+            }
+            case DeclKind::Tool: {
+                auto t = arena.make<ToolDecl>(symbol());
+                t->methods = decls();
+                return t;
+            }
+            case DeclKind::Kit: {
+                auto k = arena.make<KitDecl>(symbol());
+                k->exports = decls();
+                return k;
+            }
+        }
+        fail();
+    }
+
+    // The top-level trees the parser returned: declarations or statements
+    Node* tree() {
+        if (p == end || *p == 0 || *p >= 0x80) fail();
+        return node(static_cast<NodeType>((*p - 1) / 16), false); // every tag fits in a byte
+    }
+};
+
+} // namespace
+
+bool load_cache(const std::string& path, std::string_view source, AstArena& arena, std::vector<Node*>& program) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false; // the usual miss, without an exception
+    try {
+        MappedFile file(path);
+        std::string_view data = file.view();
+        Header header;
+        if (data.size() < sizeof header) return false;
+        std::memcpy(&header, data.data(), sizeof header);
+        if (std::memcmp(header.magic, kMagic, sizeof kMagic) != 0 || header.build != cache_build_key() ||
+            header.length != source.size() || header.hash != source_hash(source))
+            return false;
+
+        CacheReader in(data.substr(sizeof header), arena);
+        in.names.reserve(header.names);
+        for (std::uint32_t i = 0; i < header.names; ++i) in.names.push_back(intern(in.text()));
+        std::vector<Node*> trees;
+        trees.reserve(header.trees);
+        for (std::uint32_t i = 0; i < header.trees; ++i) trees.push_back(in.tree());
+        if (in.p != in.end) return false;
+        program.insert(program.end(), trees.begin(), trees.end());
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
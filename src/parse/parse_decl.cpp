@@ -4,10 +4,10 @@
 #include "parser.hpp"
 #include "lexer.hpp"
 
-std::unique_ptr<Decl> Parser::parse_var_decl() {
+Decl* Parser::parse_var_decl() {
     advance(); // consume 'let'
     expect(TokenType::Ident);
-    std::string name = current.lexeme;
+    Symbol name = current.symbol();
     advance();
         
     if (current.type == TokenType::Eq) {
@@ -15,51 +15,48 @@ std::unique_ptr<Decl> Parser::parse_var_decl() {
         auto init = parse_expr();
         expect(TokenType::Semi);
         advance();
-        return std::make_unique<VarDecl>(name, "", std::move(init)); 
+        return arena.make<VarDecl>(name, Symbol(), init); 
     } else if (current.type == TokenType::Colon) {
         advance(); // consume ':'
-        expect(TokenType::Ident);
-        std::string type = current.lexeme;
-        advance();
+        Symbol type = expect_type_name();
         if (current.type == TokenType::Eq) {
             advance();
             auto init = parse_expr();
             expect(TokenType::Semi);
             advance();
-            return std::make_unique<VarDecl>(name, type, std::move(init)); 
+            return arena.make<VarDecl>(name, type, init); 
         } else if (current.type == TokenType::Semi) {
             advance(); // consume ';'
-            return std::make_unique<VarDecl>(name, type, nullptr); 
+            return arena.make<VarDecl>(name, type, nullptr); 
         } else {
             throw std::runtime_error("Expected '=' or ';' after variable declaration");
         }
     } else if (current.type == TokenType::Semi) {
         advance(); // consume ';'
-        return std::make_unique<VarDecl>(name, "", nullptr); 
+        return arena.make<VarDecl>(name, Symbol(), nullptr); 
     } else {
         throw std::runtime_error("Expected ':', '=', or ';' after variable name");
     }
 }
 
-std::unique_ptr<Decl> Parser::parse_subr_decl() {
+Decl* Parser::parse_subr_decl() {
+    ++subr_decls;
     advance(); // consume 'subr'
     expect(TokenType::Ident);
-    std::string name = current.lexeme;
+    Symbol name = current.symbol();
     advance();
     expect(TokenType::LParen);
     advance(); // consume '('
     
-    std::vector<std::pair<std::string, std::string>> params;
+    std::vector<std::pair<Symbol, Symbol>> params;
     if (current.type != TokenType::RParen) {
         while (true) {
             expect(TokenType::Ident);
-            std::string param_name = current.lexeme;
+            Symbol param_name = current.symbol();
             advance();
             expect(TokenType::Colon);
             advance(); // consume ':'
-            expect(TokenType::Ident);
-            std::string param_type = current.lexeme;
-            advance();
+            Symbol param_type = expect_type_name();
             params.emplace_back(param_name, param_type);
             if (current.type == TokenType::Comma) {
                 advance(); // consume ','
@@ -71,40 +68,36 @@ std::unique_ptr<Decl> Parser::parse_subr_decl() {
     expect(TokenType::RParen);
     advance(); // consume ')'
     
-    std::string return_type = "void"; // default return type
+    Symbol return_type = intern("void"); // default return type
     if (current.type == TokenType::Colon) {
-        advance(); // consume '->'
-        expect(TokenType::Ident);
-        return_type = current.lexeme;
-        advance();
+        advance(); // consume ':'
+        return_type = expect_type_name();
     }
     
     auto body = parse_block();
     
-    auto subr = std::make_unique<SubrDecl>(name, return_type);
+    auto subr = arena.make<SubrDecl>(name, return_type);
     subr->params = std::move(params);
-    subr->body = std::move(body);
+    subr->body = body;
     return subr;
 }   
 
-std::unique_ptr<Decl> Parser::parse_struct_decl() {
+Decl* Parser::parse_struct_decl() {
     advance(); // consume 'struct'
     expect(TokenType::Ident);
-    std::string name = current.lexeme;
+    Symbol name = current.symbol();
     advance();
     expect(TokenType::LBrace);
     advance(); // consume '{'
     
-    std::vector<std::pair<std::string, std::string>> fields;
+    std::vector<std::pair<Symbol, Symbol>> fields;
     while (current.type != TokenType::RBrace) {
         expect(TokenType::Ident);
-        std::string field_name = current.lexeme;
+        Symbol field_name = current.symbol();
         advance();
         expect(TokenType::Colon);
         advance(); // consume ':'
-        expect(TokenType::Ident);
-        std::string field_type = current.lexeme;
-        advance();
+        Symbol field_type = expect_type_name();
         expect(TokenType::Semi);
         advance(); // consume ';'
         fields.emplace_back(field_name, field_type);
@@ -112,23 +105,23 @@ std::unique_ptr<Decl> Parser::parse_struct_decl() {
     expect(TokenType::RBrace);
     advance(); // consume '}'
     
-    auto struct_decl = std::make_unique<StructDecl>(name);
+    auto struct_decl = arena.make<StructDecl>(name);
     struct_decl->fields = std::move(fields);
     return struct_decl;
 }
 
-std::unique_ptr<Decl> Parser::parse_enum_decl() {
+Decl* Parser::parse_enum_decl() {
     advance(); // consume 'enum'
     expect(TokenType::Ident);
-    std::string name = current.lexeme;
+    Symbol name = current.symbol();
     advance();
     expect(TokenType::LBrace);
     advance(); // consume '{'
     
-    std::vector<std::string> values;
+    std::vector<Symbol> values;
     while (current.type != TokenType::RBrace) {
         expect(TokenType::Ident);
-        values.push_back(current.lexeme);
+        values.push_back(current.symbol());
         advance();
         if (current.type == TokenType::Comma) {
             advance(); // consume ','
@@ -138,28 +131,26 @@ std::unique_ptr<Decl> Parser::parse_enum_decl() {
     }
     expect(TokenType::RBrace);
     advance(); // consume '}'
-    auto enum_decl = std::make_unique<EnumDecl>(name);
+    auto enum_decl = arena.make<EnumDecl>(name);
     enum_decl->values = std::move(values);
     return enum_decl;
 }  
-std::unique_ptr<Decl> Parser::parse_union_decl() {
+Decl* Parser::parse_union_decl() {
     advance(); // consume 'union'
     expect(TokenType::Ident);
-    std::string name = current.lexeme;
+    Symbol name = current.symbol();
     advance();
     expect(TokenType::LBrace);
     advance(); // consume '{'
     
-    std::vector<std::pair<std::string, std::string>> variants;
+    std::vector<std::pair<Symbol, Symbol>> variants;
     while (current.type != TokenType::RBrace) {
         expect(TokenType::Ident);
-        std::string variant_name = current.lexeme;
+        Symbol variant_name = current.symbol();
         advance();
         expect(TokenType::Colon);
         advance(); // consume ':'
-        expect(TokenType::Ident);
-        std::string variant_type = current.lexeme;
-        advance();
+        Symbol variant_type = expect_type_name();
         expect(TokenType::Semi);
         advance(); // consume ';'
         variants.emplace_back(variant_name, variant_type);
@@ -167,19 +158,19 @@ std::unique_ptr<Decl> Parser::parse_union_decl() {
     expect(TokenType::RBrace);
     advance(); // consume '}'
     
-    auto union_decl = std::make_unique<UnionDecl>(name);
+    auto union_decl = arena.make<UnionDecl>(name);
     union_decl->variants = std::move(variants);
     return union_decl;
 }   
-std::unique_ptr<Decl> Parser::parse_tool_decl() {
+Decl* Parser::parse_tool_decl() {
     advance(); // consume 'tool'
     expect(TokenType::Ident);
-    std::string name = current.lexeme;
+    Symbol name = current.symbol();
     advance();
     expect(TokenType::LBrace);
     advance(); // consume '{'
     
-    std::vector<std::unique_ptr<Decl>> methods;
+    std::vector<Decl*> methods;
     while (current.type != TokenType::RBrace) {
         if (current.type == TokenType::KwSubr) {
             methods.push_back(parse_subr_decl());
@@ -190,20 +181,20 @@ std::unique_ptr<Decl> Parser::parse_tool_decl() {
     expect(TokenType::RBrace);
     advance(); // consume '}'
     
-    auto tool_decl = std::make_unique<ToolDecl>(name);
+    auto tool_decl = arena.make<ToolDecl>(name);
     tool_decl->methods = std::move(methods);
     return tool_decl;
 }
 
-std::unique_ptr<Decl> Parser::parse_kit_decl() {
+Decl* Parser::parse_kit_decl() {
     advance(); // consume 'kit'
     expect(TokenType::Ident);
-    std::string name = current.lexeme;
+    Symbol name = current.symbol();
     advance();
     expect(TokenType::LBrace);
     advance(); // consume '{'
     
-    std::vector<std::unique_ptr<Decl>> exports;
+    std::vector<Decl*> exports;
     while (current.type != TokenType::RBrace) {
         if (current.type == TokenType::KwSubr || current.type == TokenType::KwStruct ||
             current.type == TokenType::KwEnum || current.type == TokenType::KwUnion ||
@@ -216,14 +207,28 @@ std::unique_ptr<Decl> Parser::parse_kit_decl() {
     expect(TokenType::RBrace);
     advance(); // consume '}'
     
-    auto kit_decl = std::make_unique<KitDecl>(name);
+    auto kit_decl = arena.make<KitDecl>(name);
     kit_decl->exports = std::move(exports);
     return kit_decl;
 }
 
-std::unique_ptr<Decl> Parser::parse_decl() {
+Decl* Parser::parse_decl() {
+    std::uint32_t at = current.offset;
+    Decl* d = parse_decl_kind();
+    d->offset = at;
+    return d;
+}
+
+Decl* Parser::parse_decl_kind() {
     if (current.type == TokenType::KwLet) return parse_var_decl();
     if (current.type == TokenType::KwSubr) return parse_subr_decl();
+    if (current.type == TokenType::KwMemo) {
+        advance(); // consume 'memo'
+        expect(TokenType::KwSubr);
+        auto subr = static_cast<SubrDecl*>(parse_subr_decl());
+        subr->memo = true;
+        return subr;
+    }
     if (current.type == TokenType::KwStruct) return parse_struct_decl();
     if (current.type == TokenType::KwEnum) return parse_enum_decl();
     if (current.type == TokenType::KwUnion) return parse_union_decl();
@@ -6,21 +6,21 @@
 #include "stmt.hpp"
 #include "expr.hpp"
 
-std::unique_ptr<Expr> Parser::parse_literal() {
+Expr* Parser::parse_literal() {
     if (current.type != TokenType::Literal)
         throw std::runtime_error("Expected literal");
 
-    auto lit = std::make_unique<LiteralExpr>(current.value);
+    auto lit = arena.make<LiteralExpr>(lexer.literal(current));
     advance();
     return lit;
 }
 
-std::unique_ptr<Expr> Parser::parse_factor() {
+Expr* Parser::parse_factor() {
     if (current.type == TokenType::Literal) {
         return parse_literal();
     }
     if (current.type == TokenType::Ident) {
-        auto ident = std::make_unique<IdentExpr>(current.lexeme);
+        auto ident = arena.make<IdentExpr>(current.symbol());
         advance();
         return ident;
     }
@@ -34,87 +34,93 @@ std::unique_ptr<Expr> Parser::parse_factor() {
     throw std::runtime_error("Unexpected token in factor");
 }    
         
-std::unique_ptr<Expr> Parser::parse_unary() {
+Expr* Parser::parse_unary() {
     if (current.type == TokenType::Tilde) {
         advance();
         auto expr = parse_unary();
-        return std::make_unique<UnaryExpr>("~", std::move(expr));
+        return arena.make<UnaryExpr>(UnaryOp::BitNot, expr);
     }
     if (current.type == TokenType::Minus) {
         advance();
         auto expr = parse_unary();
-        return std::make_unique<UnaryExpr>("neg", std::move(expr));
+        return arena.make<UnaryExpr>(UnaryOp::Neg, expr);
+    }
+    if (current.type == TokenType::Not) {
+        advance();
+        auto expr = parse_unary();
+        return arena.make<UnaryExpr>(UnaryOp::Not, expr);
     }
 
-    return parse_factor();
+    return parse_call();
 }
 
-std::unique_ptr<Expr> Parser::parse_term() {
+Expr* Parser::parse_term() {
     auto n = parse_unary();
     while (current.type == TokenType::Star || current.type == TokenType::Slash) {
-        std::string op = (current.type == TokenType::Star) ? "*" : "/";
+        BinaryOp op = (current.type == TokenType::Star) ? BinaryOp::Mul : BinaryOp::Div;
         advance();
         auto right = parse_unary();
-        n = std::make_unique<BinaryExpr>(op, std::move(n), std::move(right));
+        n = arena.make<BinaryExpr>(op, n, right);
     }
     return n;
 }
 
-std::unique_ptr<Expr> Parser::parse_additive() {
+Expr* Parser::parse_additive() {
     auto n = parse_term();
     while ( current.type == TokenType::Plus || current.type == TokenType::Minus) {
-        std::string op = (current.type == TokenType::Plus) ? "+" : "-";
+        BinaryOp op = (current.type == TokenType::Plus) ? BinaryOp::Add : BinaryOp::Sub;
         advance();
         auto right = parse_term();
-        n = std::make_unique<BinaryExpr>(op, std::move(n), std::move(right));
+        n = arena.make<BinaryExpr>(op, n, right);
     }
     return n;
 }
 
-std::unique_ptr<Expr> Parser::parse_bitwise_and() {
+Expr* Parser::parse_bitwise_and() {
     auto n = parse_additive();
     while (current.type == TokenType::Amp) {
         advance();
         auto right = parse_additive();
-        n = std::make_unique<BinaryExpr>("&", std::move(n), std::move(right));
+        n = arena.make<BinaryExpr>(BinaryOp::BitAnd, n, right);
     }
     return n;
 }
 
-std::unique_ptr<Expr> Parser::parse_bitwise_or() {
+Expr* Parser::parse_bitwise_or() {
     auto n = parse_bitwise_and();
     while (current.type == TokenType::Pipe) {
         advance();
         auto right = parse_bitwise_and();
-        n = std::make_unique<BinaryExpr>("|", std::move(n), std::move(right));
+        n = arena.make<BinaryExpr>(BinaryOp::BitOr, n, right);
     }
     return n;
 }   
 
-std::unique_ptr<Expr> Parser::parse_comparison() {
+Expr* Parser::parse_comparison() {
     auto n = parse_bitwise_or();
     while (current.type == TokenType::Lt || current.type == TokenType::Le ||
            current.type == TokenType::Gt || current.type == TokenType::Ge ||
-           current.type == TokenType::EqEq || current.type == TokenType::NotEq) {
-        std::string op;
+           current.type == TokenType::EqEq || current.type == TokenType::NotEq ||
+           current.type == TokenType::BoolAnd || current.type == TokenType::BoolOr) {
+        BinaryOp op;
         switch (current.type) {
-            case TokenType::Lt: op = "<"; break;
-            case TokenType::Le: op = "<="; break;
-            case TokenType::Gt: op = ">"; break;
-            case TokenType::Ge: op = ">="; break;
-            case TokenType::EqEq: op = "=="; break;
-            case TokenType::NotEq: op = "!="; break;
-            case TokenType::BoolAnd: op = "&&"; break;
-            case TokenType::BoolOr: op = "||"; break;
+            case TokenType::Lt: op = BinaryOp::Lt; break;
+            case TokenType::Le: op = BinaryOp::Le; break;
+            case TokenType::Gt: op = BinaryOp::Gt; break;
+            case TokenType::Ge: op = BinaryOp::Ge; break;
+            case TokenType::EqEq: op = BinaryOp::Eq; break;
+            case TokenType::NotEq: op = BinaryOp::Ne; break;
+            case TokenType::BoolAnd: op = BinaryOp::And; break;
+            case TokenType::BoolOr: op = BinaryOp::Or; break;
             default: throw std::runtime_error("Invalid comparison operator");
         }  
         advance();
         auto right = parse_bitwise_or();
-        n = std::make_unique<BinaryExpr>(op, std::move(n), std::move(right));
+        n = arena.make<BinaryExpr>(op, n, right);
     }
     return n;
 }
 
-std::unique_ptr<Expr> Parser::parse_expr() {
+Expr* Parser::parse_expr() {
     return parse_comparison();
 }
\ No newline at end of file
@@ -11,7 +11,17 @@ void Parser::expect(TokenType type) {
     }
 }
 
-std::unique_ptr<Node> Parser::parse() {
+// Type names are either builtin type keywords or user-defined identifiers
+Symbol Parser::expect_type_name() {
+    if (current.type != TokenType::KwType && current.type != TokenType::Ident) {
+        throw ParseError(std::string("Expected type name but got ") + token_type_to_string(current.type));
+    }
+    Symbol name = current.symbol();
+    advance();
+    return name;
+}
+
+Node* Parser::parse() {
     if (is_decl_kind(current.type)) return parse_decl();
     else if (current.type == TokenType::End) return nullptr;
     else return parse_stmt();
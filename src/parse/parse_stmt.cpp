@@ -6,73 +6,96 @@
 #include "stmt.hpp"
 #include "expr.hpp"
 
-std::unique_ptr<Stmt> Parser::parse_check() {
+// Arms shared by check and recheck: `case expr: stmt ...` with an optional
+// trailing `then stmt` that runs when no arm matched
+CheckArms Parser::parse_check_arms() {
+    CheckArms arms;
+    while (current.type == TokenType::KwCase) {
+        advance(); // consume 'case'
+        auto case_expr = parse_expr();
+        expect(TokenType::Colon);
+        advance(); // consume ':'
+        auto case_stmt = parse_stmt();
+        arms.arms.emplace_back(case_expr, case_stmt);
+    }
+    if (current.type == TokenType::KwThen) {
+        advance(); // consume 'then'
+        arms.else_arm = parse_stmt();
+    }
+    return arms;
+}
+
+Stmt* Parser::parse_check() {
     advance(); // consume 'check'
     expect(TokenType::LParen);
+    advance(); // consume '('
     auto expr = parse_expr(); // full precedence
     expect(TokenType::RParen);
+    advance(); // consume ')'
 
-    CheckArms arms;
-    if (current.type == TokenType::KwOnly) {
-        advance(); // consume 'only'
-        arms.else_arm = nullptr;
-        arms.arms.emplace_back(nullptr, parse_stmt());
-        return std::make_unique<CheckStmt>(std::move(expr), std::move(arms));
-    } else if (current.type == TokenType::KwOn) {
-        advance(); // consume 'on'
-        while (current.type != TokenType::KwThen && current.type != TokenType::End) {
-            expect(TokenType::KwCase);
-            auto case_expr = parse_expr();
-            expect(TokenType::Colon);
-            auto case_stmt = parse_stmt();
-            arms.arms.emplace_back(std::move(case_expr), std::move(case_stmt));
-        }
-        if (current.type == TokenType::KwThen) {
-            advance(); // consume 'else'
-            arms.else_arm = parse_stmt();
-        }
-        return std::make_unique<CheckStmt>(std::move(expr), std::move(arms));
-    } else {
-        throw std::runtime_error("Expected 'only' or 'on' after check(expr)");
-    }
+    bool first_match;
+    if (current.type == TokenType::KwOnly) first_match = true;
+    else if (current.type == TokenType::KwOn) first_match = false;
+    else throw std::runtime_error("Expected 'only' or 'on' after check(expr)");
+    advance(); // consume 'only' / 'on'
+
+    auto check = arena.make<CheckStmt>(expr, parse_check_arms());
+    check->execute_first_match = first_match;
+    return check;
 }
 
-std::unique_ptr<Stmt> Parser::parse_recheck() {
+Stmt* Parser::parse_recheck() {
     advance(); // consume 'recheck'
     expect(TokenType::LParen);
+    advance(); // consume '('
     auto expr = parse_expr(); // full precedence
     expect(TokenType::RParen);
+    advance(); // consume ')'
 
-    CheckArms arms;
-    while (current.type != TokenType::End) {
-        expect(TokenType::KwCase);
-        auto case_expr = parse_expr();
-        expect(TokenType::Colon);
-        auto case_stmt = parse_stmt();
-        arms.arms.emplace_back(std::move(case_expr), std::move(case_stmt));
+    bool first_match = false;
+    if (current.type == TokenType::KwOnly || current.type == TokenType::KwOn) {
+        first_match = current.type == TokenType::KwOnly;
+        advance(); // consume 'only' / 'on'
     }
-    return std::make_unique<RecheckStmt>(std::move(expr), std::move(arms));
+    auto recheck = arena.make<RecheckStmt>(expr, parse_check_arms());
+    recheck->execute_first_match = first_match;
+    return recheck;
 }
 
-std::unique_ptr<Stmt> Parser::parse_block() {
+Stmt* Parser::parse_block() {
+    expect(TokenType::LBrace);
     advance(); // consume '{'
-    auto block = std::make_unique<BlockStmt>();
+    auto block = arena.make<BlockStmt>();
     while (current.type != TokenType::RBrace && current.type != TokenType::End) {
-        block->stmts.push_back(parse_stmt());
+        if (is_decl_kind(current.type)) {
+            Decl* d = parse_decl();
+            Stmt* s = arena.make<DeclStmt>(d);
+            s->offset = d->offset;
+            block->add_stmt(s);
+        } else {
+            block->add_stmt(parse_stmt());
+        }
     }
     expect(TokenType::RBrace);
+    advance(); // consume '}'
     return block;
 }
 
-std::unique_ptr<Stmt> Parser::parse_assign() {
-    std::string name = current.lexeme;
+Stmt* Parser::parse_assign() {
+    Symbol name = current.symbol();
     advance();
+    if (current.type == TokenType::LParen) { // call statement: name(args);
+        auto call = parse_call_args(arena.make<IdentExpr>(name));
+        expect(TokenType::Semi);
+        advance();
+        return arena.make<ExprStmt>(call);
+    }
     if (current.type == TokenType::Eq) {
         advance();
         auto rhs = parse_expr(); // full precedence
         expect(TokenType::Semi);
         advance(); 
-        return std::make_unique<AssignStmt>(std::move(rhs), name);
+        return arena.make<AssignStmt>(rhs, name);
     }
     if(current.type == TokenType::PlusEq || current.type == TokenType::MinusEq ||
        current.type == TokenType::StarEq || current.type == TokenType::SlashEq) {
@@ -83,47 +106,53 @@ std::unique_ptr<Stmt> Parser::parse_assign() {
         advance(); 
         auto rhs = parse_expr();
         expect(TokenType::Semi);
-        return std::make_unique<AssignOpStmt>(name, std::move(rhs), op);
+        advance();
+        return arena.make<AssignOpStmt>(name, rhs, op);
     }  
 
     if (current.type == TokenType::Increment || current.type == TokenType::Decrement) {
         char op = (current.type == TokenType::Increment) ? '+' : '-';
         advance();
         expect(TokenType::Semi);
-        return std::make_unique<IncDecStmt>(name, op);
+        advance();
+        return arena.make<IncDecStmt>(name, op);
     }    
     throw std::runtime_error("Expected assignment operator");
 }
 
-std::unique_ptr<Stmt> Parser::parse_if() {
+Stmt* Parser::parse_if() {
     advance(); // consume 'if'
     expect(TokenType::LParen);
+    advance(); // consume '('
     auto cond = parse_expr(); // full precedence
     expect(TokenType::RParen);
+    advance(); // consume ')'
     auto then_branch = parse_stmt(); // single statement or a block
-    std::unique_ptr<Stmt> else_branch = nullptr;
+    Stmt* else_branch = nullptr;
     if (current.type == TokenType::KwElse) {
         advance(); // consume 'else'
         else_branch = parse_stmt();
     }
-    return std::make_unique<IfStmt>(std::move(cond), std::move(then_branch), std::move(else_branch));
+    return arena.make<IfStmt>(cond, then_branch, else_branch);
 }
 
-std::unique_ptr<Stmt> Parser::parse_while() {
+Stmt* Parser::parse_while() {
     advance(); // consume 'while'
     expect(TokenType::LParen);
+    advance(); // consume '('
     auto cond = parse_expr(); // full precedence
     expect(TokenType::RParen);
+    advance(); // consume ')'
     auto body = parse_stmt(); // single statement or a block
-    return std::make_unique<WhileStmt>(std::move(cond), std::move(body));
+    return arena.make<WhileStmt>(cond, body);
 }
 
-std::unique_ptr<Stmt> Parser::parse_for() {
+Stmt* Parser::parse_for() {
     advance(); // consume 'for'
     expect(TokenType::LParen);
-    std::string var_name;
+    Symbol var_name;
     if (current.type == TokenType::Ident) {
-        var_name = current.lexeme;
+        var_name = current.symbol();
         advance();
     } else {
         throw std::runtime_error("Expected identifier in for-each");
@@ -132,37 +161,71 @@ std::unique_ptr<Stmt> Parser::parse_for() {
     auto iterable = parse_expr(); // full precedence
     expect(TokenType::RParen);
     auto body = parse_stmt(); // single statement or a block
-    return std::make_unique<ForEachStmt>(var_name, std::move(iterable), std::move(body));
+    return arena.make<ForEachStmt>(var_name, iterable, body);
 }
 
 
 
-std::unique_ptr<Stmt> Parser::parse_stmt() {
+Stmt* Parser::parse_return() {
+    advance(); // consume 'return'
+    Expr* expr = nullptr;
+    if (current.type != TokenType::Semi) expr = parse_expr();
+    expect(TokenType::Semi);
+    advance();
+    return arena.make<ReturnStmt>(expr);
+}
+
+Stmt* Parser::parse_loop_jump() {
+    bool is_break = current.type == TokenType::KwBreak;
+    advance(); // consume 'break' / 'continue'
+    expect(TokenType::Semi);
+    advance();
+    if (is_break) return arena.make<BreakStmt>();
+    return arena.make<ContinueStmt>();
+}
+
+Stmt* Parser::parse_stmt() {
+    std::uint32_t at = current.offset;
+    Stmt* s = parse_stmt_kind();
+    s->offset = at;
+    return s;
+}
+
+Stmt* Parser::parse_stmt_kind() {
     if (current.type == TokenType::KwCheck) return parse_check();
     if (current.type == TokenType::LBrace) return parse_block();
     if (current.type == TokenType::KwRecheck) return parse_recheck();
+    if (current.type == TokenType::KwIf) return parse_if();
+    if (current.type == TokenType::KwWhile) return parse_while();
+    if (current.type == TokenType::KwReturn) return parse_return();
+    if (current.type == TokenType::KwBreak || current.type == TokenType::KwContinue) return parse_loop_jump();
     if (current.type == TokenType::Ident) return parse_assign();
     throw std::runtime_error("Invalid statement");
 }
 
 
-std::unique_ptr<Expr> Parser::parse_call() {
+Expr* Parser::parse_call() {
     auto callee = parse_factor();
     while (current.type == TokenType::LParen) {
-        advance(); // consume '('
-        std::vector<std::unique_ptr<Expr>> args;
-        if (current.type != TokenType::RParen) {
-            while (true) {
-                args.push_back(parse_expr());
-                if (current.type == TokenType::Comma) {
-                    advance(); // consume ','
-                } else {
-                    break;
-                }
+        callee = parse_call_args(callee);
+    }
+    return callee;
+}
+
+Expr* Parser::parse_call_args(Expr* callee) {
+    advance(); // consume '('
+    std::vector<Expr*> args;
+    if (current.type != TokenType::RParen) {
+        while (true) {
+            args.push_back(parse_expr());
+            if (current.type == TokenType::Comma) {
+                advance(); // consume ','
+            } else {
+                break;
             }
         }
-        expect(TokenType::RParen);
-        callee = std::make_unique<CallExpr>(std::move(callee), std::move(args));
     }
-    return callee;
-}
\ No newline at end of file
+    expect(TokenType::RParen);
+    advance(); // consume ')'
+    return arena.make<CallExpr>(callee, std::move(args));
+}
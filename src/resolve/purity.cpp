@@ -0,0 +1,132 @@
+#include "purity.hpp"
+#include "expr.hpp"
+#include "stmt.hpp"
+#include <algorithm>
+
+namespace {
+
+void walk_stmt(const Stmt* s, SubrEffects& fx);
+
+void touch(const SlotRef& ref, SubrEffects& fx) {
+    if (!ref.resolved()) fx.local = false; // a global or an enclosing frame's variable
+}
+
+void walk_expr(const Expr* e, SubrEffects& fx) {
+    if (!e) return;
+    switch (e->kind) {
+        case ExprKind::Literal:
+            break;
+        case ExprKind::Ident:
+            touch(static_cast<const IdentExpr*>(e)->ref, fx);
+            break;
+        case ExprKind::Binary: {
+            auto* b = static_cast<const BinaryExpr*>(e);
+            walk_expr(b->lhs, fx);
+            walk_expr(b->rhs, fx);
+            break;
+        }
+        case ExprKind::Unary:
+            walk_expr(static_cast<const UnaryExpr*>(e)->operand, fx);
+            break;
+        case ExprKind::Call: {
+            auto* c = static_cast<const CallExpr*>(e);
+            if (c->callee->kind == ExprKind::Ident) {
+                Symbol name = static_cast<const IdentExpr*>(c->callee)->name;
+                if (std::find(fx.callees.begin(), fx.callees.end(), name) == fx.callees.end())
+                    fx.callees.push_back(name);
+            } else {
+                fx.local = false; // the callee is only known at run time
+            }
+            for (const Expr* arg : c->args) walk_expr(arg, fx);
+            break;
+        }
+    }
+}
+
+void walk_decl(const Decl* d, SubrEffects& fx) {
+    if (d->kind == DeclKind::Var) {
+        walk_expr(static_cast<const VarDecl*>(d)->init, fx);
+        return;
+    }
+    fx.local = false; // declares a subroutine or type for everyone
+}
+
+void walk_arms(const CheckArms& arms, SubrEffects& fx) {
+    for (const auto& [value, body] : arms.arms) {
+        walk_expr(value, fx);
+        walk_stmt(body, fx);
+    }
+    walk_stmt(arms.else_arm, fx);
+}
+
+void walk_stmt(const Stmt* s, SubrEffects& fx) {
+    if (!s || !fx.local) return;
+    switch (s->kind) {
+        case StmtKind::ExprStmt:
+            walk_expr(static_cast<const ExprStmt*>(s)->expr, fx);
+            break;
+        case StmtKind::Assign: {
+            auto* a = static_cast<const AssignStmt*>(s);
+            touch(a->ref, fx);
+            walk_expr(a->rhs, fx);
+            break;
+        }
+        case StmtKind::AssignOp: {
+            auto* a = static_cast<const AssignOpStmt*>(s);
+            touch(a->ref, fx);
+            walk_expr(a->rhs, fx);
+            break;
+        }
+        case StmtKind::IncDec:
+            touch(static_cast<const IncDecStmt*>(s)->ref, fx);
+            break;
+        case StmtKind::Decl:
+            walk_decl(static_cast<const DeclStmt*>(s)->decl, fx);
+            break;
+        case StmtKind::Block: {
+            auto* b = static_cast<const BlockStmt*>(s);
+            for (const Decl* d : b->decl) if (d) walk_decl(d, fx);
+            for (const Stmt* st : b->stmts) walk_stmt(st, fx);
+            break;
+        }
+        case StmtKind::If: {
+            auto* i = static_cast<const IfStmt*>(s);
+            walk_expr(i->cond, fx);
+            walk_stmt(i->then_branch, fx);
+            walk_stmt(i->else_branch, fx);
+            break;
+        }
+        case StmtKind::While: {
+            auto* w = static_cast<const WhileStmt*>(s);
+            walk_expr(w->cond, fx);
+            walk_stmt(w->body, fx);
+            break;
+        }
+        case StmtKind::Return:
+            walk_expr(static_cast<const ReturnStmt*>(s)->expr, fx);
+            break;
+        case StmtKind::Break:
+        case StmtKind::Continue:
+            break;
+        case StmtKind::Check: {
+            auto* c = static_cast<const CheckStmt*>(s);
+            walk_expr(c->expr, fx);
+            walk_arms(c->arms, fx);
+            break;
+        }
+        case StmtKind::Recheck: {
+            auto* r = static_cast<const RecheckStmt*>(s);
+            walk_expr(r->expr, fx);
+            walk_arms(r->arms, fx);
+            break;
+        }
+    }
+}
+
+} // namespace
+
+SubrEffects analyze_effects(const SubrDecl* s) {
+    SubrEffects fx;
+    walk_stmt(s->body, fx);
+    return fx;
+}
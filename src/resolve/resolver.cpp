@@ -0,0 +1,229 @@
+#include "resolver.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+void Resolver::resolve(Node* node) {
+    if (!node) return;
+    switch (node->nodeType) {
+        case NodeType::Expr: resolve_expr(static_cast<Expr*>(node)); break;
+        case NodeType::Stmt: resolve_stmt(static_cast<Stmt*>(node)); break;
+        case NodeType::Decl: resolve_decl(static_cast<Decl*>(node)); break;
+    }
+}
+
+int Resolver::declare(Symbol name) {
+    // Top-level declarations go to the REPL's global scope, which is dynamic
+    if (scopes.empty()) return -1;
+    auto& names = scopes.back().names;
+    // A redeclaration fails at run time, where decl_var finds the first one
+    bool fresh = std::find(names.begin(), names.end(), name) == names.end();
+    names.push_back(name);
+    return fresh ? static_cast<int>(names.size() - 1) : -1;
+}
+
+SlotRef Resolver::lookup(Symbol name) const {
+    SlotRef ref;
+    int depth = 0;
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope, ++depth) {
+        const auto& names = scope->names;
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (names[i] == name) {
+                ref.depth = depth;
+                ref.slot = static_cast<int>(i);
+                return ref;
+            }
+        }
+        if (scope->frame_base) break; // don't look past the current call frame
+    }
+    return ref;
+}
+
+void Resolver::resolve_expr(Expr* e) {
+    switch (e->kind) {
+        case ExprKind::Literal:
+            break;
+        case ExprKind::Ident: {
+            auto* i = static_cast<IdentExpr*>(e);
+            i->ref = lookup(i->name);
+            break;
+        }
+        case ExprKind::Binary: {
+            auto* b = static_cast<BinaryExpr*>(e);
+            resolve_expr(b->lhs);
+            resolve_expr(b->rhs);
+            break;
+        }
+        case ExprKind::Unary:
+            resolve_expr(static_cast<UnaryExpr*>(e)->operand);
+            break;
+        case ExprKind::Call: {
+            auto* c = static_cast<CallExpr*>(e);
+            // A plain name callee is a subroutine, not a variable
+            if (c->callee->kind != ExprKind::Ident) resolve_expr(c->callee);
+            for (auto& arg : c->args) resolve_expr(arg);
+            break;
+        }
+    }
+}
+
+void Resolver::resolve_block(BlockStmt* b) {
+    scopes.push_back({});
+    resolve_block_body(b);
+    scopes.pop_back();
+}
+
+void Resolver::resolve_block_body(BlockStmt* b) {
+    for (auto& d : b->decl) if (d) resolve_decl(d);
+    for (auto& s : b->stmts) resolve_stmt(s);
+    if (b->rturn_stmt) resolve_stmt(b->rturn_stmt);
+}
+
+void Resolver::resolve_stmt(Stmt* s) {
+    if (!s) return;
+    switch (s->kind) {
+        case StmtKind::ExprStmt:
+            resolve_expr(static_cast<ExprStmt*>(s)->expr);
+            break;
+        case StmtKind::Assign: {
+            auto* a = static_cast<AssignStmt*>(s);
+            resolve_expr(a->rhs);
+            a->ref = lookup(a->identifier);
+            break;
+        }
+        case StmtKind::AssignOp: {
+            auto* a = static_cast<AssignOpStmt*>(s);
+            resolve_expr(a->rhs);
+            a->ref = lookup(a->identifier);
+            break;
+        }
+        case StmtKind::IncDec: {
+            auto* i = static_cast<IncDecStmt*>(s);
+            i->ref = lookup(i->identifier);
+            break;
+        }
+        case StmtKind::Decl:
+            resolve_decl(static_cast<DeclStmt*>(s)->decl);
+            break;
+        case StmtKind::Block:
+            resolve_block(static_cast<BlockStmt*>(s));
+            break;
+        case StmtKind::If: {
+            auto* i = static_cast<IfStmt*>(s);
+            resolve_expr(i->cond);
+            resolve_stmt(i->then_branch);
+            resolve_stmt(i->else_branch);
+            break;
+        }
+        case StmtKind::While: {
+            auto* w = static_cast<WhileStmt*>(s);
+            w->scoped = w->body->kind == StmtKind::Block;
+            // The evaluator keeps a block body's scope open, emptied, while
+            // it tests the condition
+            if (w->scoped) scopes.push_back({});
+            resolve_expr(w->cond);
+            ++loop_depth;
+            if (w->scoped) resolve_block_body(static_cast<BlockStmt*>(w->body));
+            else resolve_stmt(w->body);
+            --loop_depth;
+            if (w->scoped) scopes.pop_back();
+            break;
+        }
+        case StmtKind::Return: {
+            auto* r = static_cast<ReturnStmt*>(s);
+            if (!in_subr) throw ParseError("return outside of a subroutine");
+            if (r->expr) resolve_expr(r->expr);
+            break;
+        }
+        case StmtKind::Break:
+            if (loop_depth == 0) throw ParseError("break outside of a loop");
+            break;
+        case StmtKind::Continue:
+            if (loop_depth == 0) throw ParseError("continue outside of a loop");
+            break;
+        case StmtKind::Check:
+        case StmtKind::Recheck: {
+            // CheckStmt and RecheckStmt share their layout of expr + arms
+            Expr* expr;
+            CheckArms* arms;
+            if (s->kind == StmtKind::Check) {
+                auto* c = static_cast<CheckStmt*>(s);
+                expr = c->expr; arms = &c->arms;
+            } else {
+                auto* r = static_cast<RecheckStmt*>(s);
+                expr = r->expr; arms = &r->arms;
+            }
+            // recheck repeats until no arm matches, so its arms are a loop
+            // body; when they are all blocks, they share one open scope
+            bool loop = s->kind == StmtKind::Recheck;
+            arms->scoped = loop && all_blocks(*arms);
+            if (arms->scoped) scopes.push_back({});
+            resolve_expr(expr);
+            loop_depth += loop;
+            for (auto& arm : arms->arms) {
+                if (arm.first) resolve_expr(arm.first);
+                resolve_arm(arm.second, arms->scoped);
+            }
+            resolve_arm(arms->else_arm, arms->scoped);
+            loop_depth -= loop;
+            if (arms->scoped) scopes.pop_back();
+            break;
+        }
+    }
+}
+
+bool Resolver::all_blocks(const CheckArms& arms) {
+    for (const auto& arm : arms.arms)
+        if (!arm.second || arm.second->kind != StmtKind::Block) return false;
+    return !arms.else_arm || arms.else_arm->kind == StmtKind::Block;
+}
+
+void Resolver::resolve_arm(Stmt* arm, bool scoped) {
+    if (!arm) return;
+    if (!scoped) return resolve_stmt(arm);
+    // Each arm starts from the empty shared scope
+    scopes.back().names.clear();
+    resolve_block_body(static_cast<BlockStmt*>(arm));
+    scopes.back().names.clear();
+}
+
+void Resolver::resolve_decl(Decl* d) {
+    switch (d->kind) {
+        case DeclKind::Var: {
+            auto* v = static_cast<VarDecl*>(d);
+            if (v->init) resolve_expr(v->init); // initializer sees the outer binding
+            v->local = declare(v->name);
+            break;
+        }
+        case DeclKind::Subr: {
+            auto* s = static_cast<SubrDecl*>(d);
+            // call_subr pushes the parameters as a scope of their own, then
+            // the body block pushes another
+            Scope params;
+            params.frame_base = true;
+            for (const auto& p : s->params) params.names.push_back(p.first);
+            scopes.push_back(std::move(params));
+            // Loops around the declaration are not loops of the body
+            int outer_loops = loop_depth;
+            bool outer_in_subr = in_subr;
+            loop_depth = 0;
+            in_subr = true;
+            resolve_stmt(s->body);
+            loop_depth = outer_loops;
+            in_subr = outer_in_subr;
+            scopes.pop_back();
+            break;
+        }
+        case DeclKind::Tool:
+            for (auto& m : static_cast<ToolDecl*>(d)->methods) resolve_decl(m);
+            break;
+        case DeclKind::Kit:
+            for (auto& e : static_cast<KitDecl*>(d)->exports) resolve_decl(e);
+            break;
+        case DeclKind::Struct:
+        case DeclKind::Enum:
+        case DeclKind::Union:
+            break;
+    }
+}
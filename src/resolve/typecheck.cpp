@@ -0,0 +1,163 @@
+#include "typecheck.hpp"
+#include "interpret.hpp"
+#include "ops.hpp"
+#include "error.hpp"
+#include <string>
+
+namespace {
+
+// The builtin type `name` names, or nullopt for a user-defined one
+std::optional<ValueType> builtin_type(Symbol name, const std::string& what) {
+    auto it = EvalRuntime::types.find(name);
+    if (it != EvalRuntime::types.end()) return it->second;
+    if (EvalRuntime::is_user_type(name)) return std::nullopt;
+    throw TypeError("Unknown type for " + what + ": " + name.str());
+}
+
+// How a value of static type `from` (nullopt: not known) is stored in a slot
+// of type `to`; the same widening typed_init allows
+TypeConv conversion(ValueType to, std::optional<ValueType> from, const std::string& what) {
+    if (!from) return TypeConv::Check;
+    if (*from == to) return TypeConv::Store;
+    if (*from == ValueType::INT && to == ValueType::FLOAT) return TypeConv::IntToFloat;
+    if (*from == ValueType::INT && to == ValueType::DOUBLE) return TypeConv::IntToDouble;
+    EvalRuntime::type_mismatch(what, to, *from);
+}
+
+} // namespace
+
+std::optional<ValueType> TypeChecker::static_type(const Expr* e) {
+    // An operator's result type is what its kernel returns for operands of
+    // the same types; one that throws leaves the error to run time
+    try {
+        switch (e->kind) {
+            case ExprKind::Literal:
+                return static_cast<const LiteralExpr*>(e)->literal.type;
+            case ExprKind::Unary: {
+                auto* u = static_cast<const UnaryExpr*>(e);
+                auto t = static_type(u->operand);
+                if (!t) return std::nullopt;
+                return apply(u->op, Value::defaultFor(*t)).type;
+            }
+            case ExprKind::Binary: {
+                auto* b = static_cast<const BinaryExpr*>(e);
+                auto l = static_type(b->lhs), r = static_type(b->rhs);
+                if (!l || !r) return std::nullopt;
+                // Division by the zero operand would trap; it types like Mul
+                BinaryOp op = b->op == BinaryOp::Div ? BinaryOp::Mul : b->op;
+                return apply(op, Value::defaultFor(*l), Value::defaultFor(*r)).type;
+            }
+            case ExprKind::Ident:
+            case ExprKind::Call:
+                return std::nullopt;
+        }
+    } catch (const std::exception&) {
+    }
+    return std::nullopt;
+}
+
+void TypeChecker::check(Node* node) {
+    if (!node) return;
+    if (node->nodeType == NodeType::Stmt) check_stmt(static_cast<Stmt*>(node));
+    else if (node->nodeType == NodeType::Decl) check_decl(static_cast<Decl*>(node));
+}
+
+void TypeChecker::check_stmt(Stmt* s) {
+    if (!s) return;
+    switch (s->kind) {
+        case StmtKind::Decl:
+            check_decl(static_cast<DeclStmt*>(s)->decl);
+            break;
+        case StmtKind::Block: {
+            auto* b = static_cast<BlockStmt*>(s);
+            for (auto& d : b->decl) if (d) check_decl(d);
+            for (auto& st : b->stmts) check_stmt(st);
+            check_stmt(b->rturn_stmt);
+            break;
+        }
+        case StmtKind::If: {
+            auto* i = static_cast<IfStmt*>(s);
+            check_stmt(i->then_branch);
+            check_stmt(i->else_branch);
+            break;
+        }
+        case StmtKind::While:
+            check_stmt(static_cast<WhileStmt*>(s)->body);
+            break;
+        case StmtKind::Check:
+        case StmtKind::Recheck: {
+            CheckArms& arms = s->kind == StmtKind::Check ? static_cast<CheckStmt*>(s)->arms
+                                                         : static_cast<RecheckStmt*>(s)->arms;
+            for (auto& arm : arms.arms) check_stmt(arm.second);
+            check_stmt(arms.else_arm);
+            break;
+        }
+        case StmtKind::Return:
+            check_return(static_cast<ReturnStmt*>(s));
+            break;
+        case StmtKind::ExprStmt:
+        case StmtKind::Assign:
+        case StmtKind::AssignOp:
+        case StmtKind::IncDec:
+        case StmtKind::Break:
+        case StmtKind::Continue:
+            break; // assignments are dynamically typed
+    }
+}
+
+void TypeChecker::check_decl(Decl* d) {
+    // Struct/enum/union/tool/kit are not evaluated yet, so nothing to type
+    if (d->kind == DeclKind::Var) check_var(static_cast<VarDecl*>(d));
+    else if (d->kind == DeclKind::Subr) check_subr(static_cast<SubrDecl*>(d));
+}
+
+void TypeChecker::check_var(VarDecl* v) {
+    if (v->type_name.empty()) return; // takes the type of its initializer
+    const std::string& name = v->name.str();
+    auto type = builtin_type(v->type_name, "variable " + name);
+    if (!type) return; // user-defined: typed_init checks it at run time
+    if (!v->init) {
+        if (*type == ValueType::NONE) throw TypeError("Variable " + name + " declared with void type");
+        v->slot = {*type, TypeConv::Default};
+        return;
+    }
+    v->slot = {*type, conversion(*type, static_type(v->init), "initialization of variable " + name)};
+}
+
+void TypeChecker::check_subr(SubrDecl* s) {
+    const std::string& name = s->name.str();
+    s->param_types.clear();
+    for (const auto& [param, type_name] : s->params) {
+        TypeSlot slot;
+        auto type = type_name.empty() ? std::nullopt
+                                      : builtin_type(type_name, "parameter " + param.str() + " of " + name);
+        if (type == ValueType::NONE)
+            throw TypeError("Parameter " + param.str() + " of " + name + " declared with void type");
+        if (type) slot = {*type, TypeConv::Check};
+        s->param_types.push_back(slot);
+    }
+    s->ret = {};
+    if (!s->return_type.empty()) {
+        if (auto type = builtin_type(s->return_type, "result of " + name)) s->ret = {*type, TypeConv::Check};
+    }
+    if (!s->body) return;
+    if (s->body->kind == StmtKind::Block) static_cast<BlockStmt*>(s->body)->type_name = s->return_type;
+    subrs.push_back(s);
+    check_stmt(s->body);
+    subrs.pop_back();
+}
+
+void TypeChecker::check_return(ReturnStmt* r) {
+    if (subrs.empty()) return; // the Resolver rejects it
+    const SubrDecl* s = subrs.back();
+    r->type_name = s->return_type;
+    r->subr = s->name;
+    r->slot = {};
+    if (!s->ret.checked()) return;
+    if (!r->expr) {
+        if (s->ret.type != ValueType::NONE) EvalRuntime::missing_return(s->name, s->ret.type);
+        r->slot = {ValueType::NONE, TypeConv::Store};
+        return;
+    }
+    r->slot = {s->ret.type, conversion(s->ret.type, static_type(r->expr), "return from " + s->name.str())};
+}
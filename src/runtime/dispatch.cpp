@@ -0,0 +1,94 @@
+#include "dispatch.hpp"
+#include "stmt.hpp"
+#include <algorithm>
+#include <type_traits>
+
+namespace {
+
+bool tabulable(ValueType t) {
+    switch (t) {
+        case ValueType::INT: case ValueType::SHORT: case ValueType::LONG:
+        case ValueType::BOOL: case ValueType::CHAR: case ValueType::STRING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The payload of an integral or bool value, widened
+long scalar(const Value& v) {
+    return v.visit([](const auto& x) -> long {
+        if constexpr (std::is_integral_v<std::decay_t<decltype(x)>>) return static_cast<long>(x);
+        else return 0;
+    });
+}
+
+} // namespace
+
+std::unique_ptr<ArmTable> ArmTable::build(const CheckArms& arms) {
+    if (arms.arms.size() < kMinArms || arms.arms.size() >= kNoArm) return nullptr;
+    for (const auto& arm : arms.arms) {
+        if (arm.first->kind != ExprKind::Literal) return nullptr;
+        if (!tabulable(static_cast<const LiteralExpr*>(arm.first)->literal.type)) return nullptr;
+    }
+
+    auto table = std::make_unique<ArmTable>();
+    std::size_t count = arms.arms.size();
+    table->next_same.assign(count, kNoArm);
+    // Each key maps to its first arm; later arms with the same value are
+    // chained from the previous one
+    std::unordered_map<std::uint32_t, std::uint32_t> last; // first arm -> last arm of its chain
+    long lo = 0, hi = 0;
+    std::size_t ints = 0;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        const Value& v = static_cast<const LiteralExpr*>(arms.arms[i].first)->literal;
+        std::uint32_t first;
+        if (v.type == ValueType::STRING) {
+            first = table->strings.try_emplace(v.get<std::string>(), i).first->second;
+        } else {
+            first = table->scalars.try_emplace(ScalarKey{v.type, scalar(v)}, i).first->second;
+            if (v.type == ValueType::INT) {
+                long x = scalar(v);
+                lo = ints ? std::min(lo, x) : x;
+                hi = ints ? std::max(hi, x) : x;
+                ++ints;
+            }
+        }
+        if (first != i) table->next_same[last[first]] = i;
+        last[first] = i;
+    }
+
+    // Ints that fit a table at most about four times as large as their
+    // count are looked up by index
+    if (ints && static_cast<unsigned long>(hi - lo) < 4 * ints + 16) {
+        table->dense_min = lo;
+        table->dense.assign(static_cast<std::size_t>(hi - lo + 1), kNoArm);
+        for (auto it = table->scalars.begin(); it != table->scalars.end();) {
+            if (it->first.type != ValueType::INT) { ++it; continue; }
+            table->dense[static_cast<std::size_t>(it->first.value - lo)] = it->second;
+            it = table->scalars.erase(it);
+        }
+    }
+    return table;
+}
+
+std::uint32_t ArmTable::first(const Value& subject) const {
+    if (subject.type == ValueType::INT && !dense.empty()) {
+        unsigned long i = static_cast<unsigned long>(static_cast<long>(subject.unchecked<int>()) - dense_min);
+        return i < dense.size() ? dense[i] : kNoArm;
+    }
+    if (subject.type == ValueType::STRING) {
+        if (strings.empty()) return kNoArm;
+        return subject.visit([&](const auto& x) -> std::uint32_t {
+            if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) {
+                auto it = strings.find(x);
+                return it == strings.end() ? kNoArm : it->second;
+            } else {
+                return kNoArm;
+            }
+        });
+    }
+    if (!tabulable(subject.type) || scalars.empty()) return kNoArm;
+    auto it = scalars.find(ScalarKey{subject.type, scalar(subject)});
+    return it == scalars.end() ? kNoArm : it->second;
+}
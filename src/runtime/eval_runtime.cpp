@@ -5,80 +5,334 @@
 #include "expr.hpp"
 #include "stmt.hpp"
 #include "decl.hpp"
+#include "error.hpp"
 #include <stdexcept>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <sys/resource.h>
 
 
-void EvalRuntime::push_scope() { scopes.push_back({}); }
 void EvalRuntime::pop_scope() {
-    for (auto& v : scopes.back()) delete v.addr;
-    scopes.pop_back();
-}
-void EvalRuntime::push_scope(Var v) {
-    scopes.push_back({v});
+    TOY_STAT(scope_pops++);
+    clear_scope();
+    scope_base.pop_back();
 }
 
 void EvalRuntime::cleanup_scopes() {
-    while (!scopes.empty()) pop_scope();
+    while (!scope_base.empty()) pop_scope();
 }
 
-Value EvalRuntime::call_subr(const std::string& name, const std::vector<Value>& args, Evaluator& evaluator) {
-    auto it = subrs.find(name);
-    if (it == subrs.end())
-        throw std::runtime_error("Undefined subroutine: " + name);
+const Subr& EvalRuntime::lookup_subr(Symbol name, size_t argc) {
+    if (name.id >= subrs.size() || !subrs[name.id].defined)
+        throw std::runtime_error("Undefined subroutine: " + name.str());
 
-    const Subr& subr = it->second;
-    if (args.size() != subr.params.size())
-        throw std::runtime_error("Argument count mismatch in call to: " + name);
+    const Subr& subr = subrs[name.id];
+    if (argc != subr.params.size())
+        throw std::runtime_error("Argument count mismatch in call to: " + name.str());
+    // What decl_var would have caught when parameters were declared one by one
+    for (auto p = subr.params.begin(); p != subr.params.end(); ++p) {
+        if (std::find(subr.params.begin(), p, *p) != p)
+            throw std::runtime_error("Variable already declared in this scope: " + p->str());
+    }
+    return subr;
+}
 
-    push_scope();
-    for (size_t i = 0; i < args.size(); ++i)
-        decl_var(subr.params[i], args[i]);
+// Native stack the evaluator may use for nested calls: the soft limit less
+// room for whatever runs below the outermost call
+static size_t native_stack_budget() {
+    static const size_t budget = [] {
+        constexpr size_t fallback = size_t(8) << 20, reserve = size_t(256) << 10;
+        rlimit rl;
+        size_t limit = fallback;
+        if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) limit = rl.rlim_cur;
+        return limit > 2 * reserve ? limit - reserve : limit / 2;
+    }();
+    return budget;
+}
 
-    Value ret = Value(); // default void return
-    try{ evaluator.eval(subr.body); }
-     catch (const ReturnException& re) { ret = re.value; }
-    pop_scope();
-    return ret;
+namespace {
+
+// Memo keys: arguments are equal when they have the same type and the same
+// payload, bit for bit for floating point (so -0.0 and 0.0 differ, and a NaN
+// matches itself)
+std::size_t hash_value(const Value& v) {
+    std::size_t h = v.visit([](const auto& x) -> std::size_t {
+        using T = std::decay_t<decltype(x)>;
+        if constexpr (std::is_same_v<T, std::string>) return std::hash<std::string>()(x);
+        else if constexpr (std::is_floating_point_v<T>) {
+            std::uint64_t bits = 0;
+            std::memcpy(&bits, &x, sizeof x);
+            return std::hash<std::uint64_t>()(bits);
+        }
+        else if constexpr (std::is_arithmetic_v<T>) return std::hash<long>()(static_cast<long>(x));
+        else return 0; // void, user-defined: told apart by same_value
+    });
+    return h ^ (static_cast<std::size_t>(v.type) * 0x9e3779b97f4a7c15ull);
 }
 
-Value EvalRuntime::get_var(const std::string& name) {
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-        for (auto& v : *it) if (v.name == name) return *(v.addr);
-    }
-    throw std::runtime_error(std::string("Undefined variable: ") + name);
+bool same_value(const Value& a, const Value& b) {
+    if (a.type != b.type) return false;
+    return a.visit([&](const auto& x) {
+        return b.visit([&](const auto& y) {
+            using T = std::decay_t<decltype(x)>;
+            if constexpr (!std::is_same_v<T, std::decay_t<decltype(y)>>) return false;
+            else if constexpr (std::is_floating_point_v<T>) return std::memcmp(&x, &y, sizeof x) == 0;
+            else if constexpr (std::is_same_v<T, std::monostate>) return true;
+            else return x == y;
+        });
+    });
 }
 
-void EvalRuntime::set_var(const std::string& name, const Value& value) {
-    for (auto scope  = scopes.rbegin(); scope != scopes.rend(); ++scope) {
-        for (auto& v : *scope) {
-            if (v.name == name) {
-                *(v.addr) = value;
-                return;
+// Rough heap footprint of a memo entry, for memo_limit
+std::size_t entry_bytes(const std::vector<Value>& args, const Value& result) {
+    std::size_t bytes = sizeof(MemoTable::Entry) + 4 * sizeof(void*) + args.size() * sizeof(Value);
+    auto payload = [](const Value& v) {
+        return v.type == ValueType::STRING ? v.visit([](const auto& x) -> std::size_t {
+            if constexpr (std::is_same_v<std::decay_t<decltype(x)>, std::string>) return x.capacity();
+            else return 0;
+        }) : 0;
+    };
+    for (const Value& v : args) bytes += payload(v);
+    return bytes + payload(result);
+}
+
+} // namespace
+
+Value EvalRuntime::call_subr(Symbol name, const Subr& subr, size_t args_base, Evaluator& evaluator) {
+    // Non-tail calls still nest on the native stack, so a --max-depth larger
+    // than it can hold stops at the native limit with the same error
+    char here;
+    if (call_stack.empty()) native_base = &here;
+    if (call_stack.size() >= max_depth || size_t(native_base - &here) > native_stack_budget()) {
+        drop_args(args_base);
+        throw RecursionError("Maximum recursion depth exceeded in call to: " + name.str());
+    }
+
+    try {
+        convert_args(name, subr, args_base);
+    } catch (...) {
+        drop_args(args_base);
+        throw;
+    }
+
+    // A memoized subroutine answers from its table, or records what it is
+    // called with so its result can be stored when it returns
+    std::vector<Value> memo_args;
+    std::size_t memo_hash = 0;
+    const std::uint32_t epoch = subr_epoch;
+    const bool memoizing = subr.memoize;
+    if (memoizing) {
+        for (size_t i = args_base; i < top; ++i) memo_hash = memo_hash * 31 + hash_value(stack[i].value);
+        auto [first, last] = subr.memo.entries.equal_range(memo_hash);
+        for (auto it = first; it != last; ++it) {
+            const std::vector<Value>& key = it->second.args;
+            bool same = key.size() == top - args_base;
+            for (size_t i = 0; same && i < key.size(); ++i) same = same_value(key[i], stack[args_base + i].value);
+            if (same) {
+                ++subr.memo.hits;
+                drop_args(args_base);
+                return it->second.result;
             }
         }
+        ++subr.memo.misses;
+        memo_args.reserve(top - args_base);
+        for (size_t i = args_base; i < top; ++i) memo_args.push_back(stack[i].value);
+    }
+
+    TOY_STAT(calls++);
+    TOY_STAT(scope_pushes++);
+    call_stack.push_back(name);
+    scope_base.push_back(args_base);
+
+    const Subr* callee = &subr;
+    try {
+        for (;;) {
+            for (size_t i = 0; i < callee->params.size(); ++i)
+                stack[args_base + i].name = callee->params[i];
+            // A declaration in the body may move `callee`: not used past this point
+            const TypeSlot ret = callee->ret;
+            Completion c = evaluator.eval_body(callee->body);
+            if (c.flow == Flow::Normal && ret.checked() && ret.type != ValueType::NONE)
+                missing_return(call_stack.back(), ret.type);
+            if (c.flow != Flow::TailCall) {
+                pop_scope();
+                call_stack.pop_back();
+                // Unless the call declared a subroutine, which empties the
+                // tables and may have moved `subr`
+                if (memoizing && subr_epoch == epoch) memo_store(subr, memo_hash, std::move(memo_args), c.value);
+                return c.value;
+            }
+            // Reuse the frame: the tail callee's arguments replace its locals
+            for (size_t i = args_base; i < top; ++i) stack[i].value = Value();
+            top = args_base;
+            for (Value& arg : pending.args) push_arg(std::move(arg));
+            pending.args.clear();
+            TOY_STAT(tail_calls++);
+            callee = pending.subr;
+            call_stack.back() = pending.name;
+            convert_args(pending.name, *callee, args_base);
+        }
+    } catch (...) {
+        TOY_STAT(unwound_calls++);
+        call_stack.pop_back(); // the scopes are unwound by the caller
+        throw;
+    }
+}
+
+void EvalRuntime::convert_args(Symbol name, const Subr& subr, size_t args_base) {
+    for (size_t i = 0; i < subr.param_types.size(); ++i) {
+        Value& arg = stack[args_base + i].value;
+        if (!subr.param_types[i].accept(arg))
+            type_mismatch("argument " + subr.params[i].str() + " of " + name.str(), subr.param_types[i].type, arg.type);
+    }
+}
+
+void EvalRuntime::tail_call(Symbol name, const Subr& subr, size_t args_base) {
+    pending.name = name;
+    pending.subr = &subr;
+    for (size_t i = args_base; i < top; ++i) pending.args.push_back(std::move(stack[i].value));
+    drop_args(args_base);
+}
+
+Value& EvalRuntime::get_var_ref(Symbol name) {
+    // Innermost binding first
+    TOY_STAT(name_lookups++);
+    for (size_t i = top; i-- > 0;) {
+        TOY_STAT(names_scanned++);
+        if (stack[i].name == name) return stack[i].value;
     }
-    throw std::runtime_error(std::string("Undefined variable: ") + name);
+    throw std::runtime_error(std::string("Undefined variable: ") + name.str());
+}
+
+Value EvalRuntime::get_var(Symbol name) {
+    return get_var_ref(name);
 }
 
+void EvalRuntime::set_var(Symbol name, const Value& value) {
+    get_var_ref(name) = value;
+}
+
+
+void EvalRuntime::decl_subr(Symbol name, const std::vector<Symbol>& params, const BlockStmt* body,
+                            SubrEffects effects, bool annotated,
+                            std::vector<TypeSlot> param_types, TypeSlot ret) {
+    if (name.id >= subrs.size()) subrs.resize(name.id + 1);
+    Subr& subr = subrs[name.id];
+    subr = Subr();
+    subr.params = params;
+    subr.body = body;
+    subr.defined = true;
+    subr.param_types = std::move(param_types);
+    subr.ret = ret;
+    subr.effects = std::move(effects);
+    subr.annotated = annotated;
+    ++subr_epoch;
+    update_memo();
+}
+
+// Recomputes which subroutines are pure, as the largest set whose bodies are
+// local and call only subroutines of the set (so recursion stays pure), and
+// empties every table
+void EvalRuntime::update_memo() {
+    for (Subr& s : subrs) s.pure = s.defined && s.effects.local;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (Subr& s : subrs) {
+            if (!s.pure) continue;
+            for (Symbol callee : s.effects.callees) {
+                if (callee.id >= subrs.size() || !subrs[callee.id].pure) {
+                    s.pure = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+    for (Subr& s : subrs) {
+        s.memo.entries.clear();
+        s.memoize = s.defined && ((s.annotated && memo_mode != MemoMode::Off) ||
+                                  (s.pure && memo_mode == MemoMode::Auto));
+    }
+    memo_bytes = 0;
+}
 
-void EvalRuntime::decl_subr(const std::string& name, const std::vector<std::string>& params, const BlockStmt* body) {
-    subrs[name] = Subr{params, body};
-}  
+void EvalRuntime::memo_store(const Subr& subr, std::size_t hash, std::vector<Value> args, const Value& result) {
+    // A subroutine memoized only for being pure stops when its calls rarely
+    // repeat: the table would cost more than it saves
+    if (!subr.annotated && subr.memo.misses >= 1024 && subr.memo.hits * 8 < subr.memo.misses) {
+        subr.memoize = false;
+        for (const auto& [h, entry] : subr.memo.entries) memo_bytes -= entry_bytes(entry.args, entry.result);
+        subr.memo.entries.clear();
+        return;
+    }
+    std::size_t bytes = entry_bytes(args, result);
+    if (bytes > memo_limit) return;
+    if (memo_bytes + bytes > memo_limit) {
+        for (Subr& s : subrs) s.memo.entries.clear();
+        memo_bytes = 0;
+        ++memo_resets;
+    }
+    subr.memo.entries.emplace(hash, MemoTable::Entry{std::move(args), result});
+    memo_bytes += bytes;
+}
 
-void EvalRuntime::decl_var(const std::string& name, const Value& value) {
+void EvalRuntime::decl_var(Symbol name, const Value& value) {
     // Check if variable already exists in current scope
-    for (const auto& v : scopes.back()) {
-        if (v.name == name) {
-            throw std::runtime_error("Variable already declared in this scope: " + name);
+    for (size_t i = scope_base.back(); i < top; ++i) {
+        if (stack[i].name == name) {
+            throw std::runtime_error("Variable already declared in this scope: " + name.str());
         }
     }
-    // Add new variable to current scope
-    Value* val_ptr = new Value(value);
-    scopes.back().push_back(Var{name, val_ptr});
+    // Add new variable to current scope, reusing a dead slot when there is one
+    if (top == stack.size()) stack.emplace_back();
+    stack[top].name = name;
+    stack[top].value = value;
+    ++top;
+}
+
+Value EvalRuntime::typed_init(Symbol name_sym, Symbol type_sym, const Value* init) {
+    const std::string& name = name_sym.str();
+    const std::string& type_name = type_sym.str();
+    Value init_val; // default initialization
+    if (stringToValueType(type_sym) == ValueType::NONE && !init)
+        throw RuntimeError("Variable " + name + " declared with void type");
+    if (is_user_type(type_sym) && !init)
+        throw RuntimeError("Variable " + name + " of user-defined type " + type_name + " must be initialized");
+    init_val = Value::defaultFor(stringToValueType(type_sym));
+    if (init_val.type == ValueType::USERDEFINED && !is_user_type(type_sym))
+        throw RuntimeError("Unknown type for variable " + name + ": " + type_name);
+    if (init_val.type != ValueType::USERDEFINED && init && stringToValueType(type_sym) == ValueType::USERDEFINED)
+        throw RuntimeError("Type mismatch in initialization of variable " + name + 
+            ": expected user-defined type but got basic type");
+    if (init && init_val.type == ValueType::USERDEFINED) {
+        if (init->type != ValueType::USERDEFINED || 
+            init->get<userdefined>().type_name != type_name) {
+            throw RuntimeError("Type mismatch in initialization of variable " + name + 
+                ": expected user-defined type " + type_name + 
+                " but got " + init->get<userdefined>().type_name);
+        }
+        init_val = *init;
+    } else if (init) {
+        Value expr_val = *init;
+        if (expr_val.type != init_val.type) {
+            // Allow implicit conversion from int to float/double
+            if (init_val.type == ValueType::FLOAT && expr_val.type == ValueType::INT) {
+                expr_val.promoteToFloat();
+            } else if (init_val.type == ValueType::DOUBLE && expr_val.type == ValueType::INT) {
+                expr_val = Value(static_cast<double>(expr_val.get<int>()));
+            } else {
+                throw RuntimeError("Type mismatch in initialization of variable " + name + 
+                    ": expected " + valueTypeToString(init_val.type) + 
+                    " but got " + valueTypeToString(expr_val.type));
+            }
+        }
+        init_val = expr_val;
+    }
+    return init_val;
 }
 
 std::string EvalRuntime::valueTypeToString(ValueType t) {
@@ -96,13 +350,33 @@ std::string EvalRuntime::valueTypeToString(ValueType t) {
         default: return "unknown";
     }
 }
-ValueType EvalRuntime::stringToValueType(const std::string& s) {
+void EvalRuntime::type_mismatch(const std::string& what, ValueType expected, ValueType got) {
+    throw TypeError("Type mismatch in " + what + ": expected " + valueTypeToString(expected) +
+                    " but got " + valueTypeToString(got));
+}
+
+void EvalRuntime::missing_return(Symbol subr, ValueType expected) {
+    throw TypeError("Missing return value in " + subr.str() + ": expected " + valueTypeToString(expected));
+}
+
+ValueType EvalRuntime::stringToValueType(Symbol s) {
     auto it = types.find(s);
     if (it != types.end()) return it->second;
     if (is_user_type(s)) return ValueType::USERDEFINED;
-    throw std::runtime_error("Unknown type: " + s);
+    throw std::runtime_error("Unknown type: " + s.str());
 }
 
-std::unordered_map<std::string, EvalRuntime::Subr> EvalRuntime::subrs;
-std::unordered_map<std::string, ValueType> EvalRuntime::types;
-std::vector<std::string> EvalRuntime::user_types;
\ No newline at end of file
+std::vector<Subr> EvalRuntime::subrs;
+MemoMode EvalRuntime::memo_mode = MemoMode::Annotated;
+std::size_t EvalRuntime::memo_limit = std::size_t(64) << 20;
+std::size_t EvalRuntime::memo_bytes = 0;
+std::uint64_t EvalRuntime::memo_resets = 0;
+std::uint32_t EvalRuntime::subr_epoch = 1; // 0 marks an empty CallCache
+std::unordered_map<Symbol, ValueType> EvalRuntime::types = {
+    {intern("int"), ValueType::INT},       {intern("short"), ValueType::SHORT},
+    {intern("long"), ValueType::LONG},     {intern("float"), ValueType::FLOAT},
+    {intern("double"), ValueType::DOUBLE}, {intern("bool"), ValueType::BOOL},
+    {intern("char"), ValueType::CHAR},     {intern("string"), ValueType::STRING},
+    {intern("void"), ValueType::NONE}
+};
+std::vector<Symbol> EvalRuntime::user_types;
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "ops.hpp"
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+// C++ payload type of the scalar ValueTypes; void for boxed and NONE
+template <ValueType T> struct Payload { using type = void; };
+template <> struct Payload<ValueType::INT>    { using type = int; };
+template <> struct Payload<ValueType::SHORT>  { using type = short; };
+template <> struct Payload<ValueType::LONG>   { using type = long; };
+template <> struct Payload<ValueType::FLOAT>  { using type = float; };
+template <> struct Payload<ValueType::DOUBLE> { using type = double; };
+template <> struct Payload<ValueType::BOOL>   { using type = bool; };
+template <> struct Payload<ValueType::CHAR>   { using type = char; };
+
+// Strings, user-defined values and void keep going through Value's operators
+template <BinaryOp Op>
+Value generic_binary(const Value& l, const Value& r) {
+    switch (Op) {
+        case BinaryOp::Add: return l + r;
+        case BinaryOp::Sub: return l - r;
+        case BinaryOp::Mul: return l * r;
+        case BinaryOp::Div: return l / r;
+        case BinaryOp::Eq: return l == r;
+        case BinaryOp::Ne: return l != r;
+        case BinaryOp::Lt: return l < r;
+        case BinaryOp::Le: return l <= r;
+        case BinaryOp::Gt: return l > r;
+        case BinaryOp::Ge: return l >= r;
+        case BinaryOp::And: return l && r;
+        case BinaryOp::Or: return l || r;
+        case BinaryOp::BitAnd: return l & r;
+        case BinaryOp::BitOr: return l | r;
+    }
+    return Value();
+}
+
+template <typename L, typename R, typename F>
+Value arith(L l, R r, F f) {
+    return Value(static_cast<std::common_type_t<L, R>>(f(l, r)));
+}
+
+template <typename L, typename R, typename F>
+Value bitwise(L l, R r, F f) {
+    if constexpr (std::is_integral_v<L> && std::is_integral_v<R>) return Value(f(l, r));
+    else throw std::runtime_error("Invalid operands for binary operator");
+}
+
+template <BinaryOp Op, typename L, typename R>
+Value scalar_binary(L l, R r) {
+    constexpr bool same = std::is_same_v<L, R>;
+    if constexpr (Op == BinaryOp::Add) return arith(l, r, std::plus<>());
+    else if constexpr (Op == BinaryOp::Sub) return arith(l, r, std::minus<>());
+    else if constexpr (Op == BinaryOp::Mul) return arith(l, r, std::multiplies<>());
+    else if constexpr (Op == BinaryOp::Div) {
+        // The engines check first; this keeps any other caller from trapping
+        if constexpr (std::is_integral_v<L> && std::is_integral_v<R>) {
+            if (r == 0) throw RuntimeError("Division by zero");
+            if (Value::division_overflows(l, r)) throw RuntimeError("Integer overflow in division");
+        }
+        return arith(l, r, std::divides<>());
+    }
+    else if constexpr (Op == BinaryOp::Eq || Op == BinaryOp::Ne) {
+        // Values of different types are never equal
+        if constexpr (same) return Value((l == r) == (Op == BinaryOp::Eq));
+        else return Value(Op == BinaryOp::Ne);
+    }
+    else if constexpr (Op == BinaryOp::Lt || Op == BinaryOp::Le || Op == BinaryOp::Gt || Op == BinaryOp::Ge) {
+        if constexpr (!same) throw std::runtime_error("Cannot compare different types");
+        else if constexpr (Op == BinaryOp::Lt) return Value(l < r);
+        else if constexpr (Op == BinaryOp::Le) return Value(l < r || l == r);
+        else if constexpr (Op == BinaryOp::Gt) return Value(!(l < r || l == r));
+        else return Value(!(l < r));
+    }
+    else if constexpr (Op == BinaryOp::And || Op == BinaryOp::Or) {
+        if constexpr (std::is_same_v<L, bool> && std::is_same_v<R, bool>)
+            return Value(Op == BinaryOp::And ? (l && r) : (l || r));
+        else throw std::runtime_error(Op == BinaryOp::And ? "&& requires bools" : "|| requires bools");
+    }
+    else if constexpr (Op == BinaryOp::BitAnd) return bitwise(l, r, std::bit_and<>());
+    else return bitwise(l, r, std::bit_or<>());
+}
+
+template <BinaryOp Op, ValueType L, ValueType R>
+Value binary_kernel(const Value& l, const Value& r) {
+    using LT = typename Payload<L>::type;
+    using RT = typename Payload<R>::type;
+    if constexpr (std::is_void_v<LT> || std::is_void_v<RT>) return generic_binary<Op>(l, r);
+    else return scalar_binary<Op>(l.unchecked<LT>(), r.unchecked<RT>());
+}
+
+template <UnaryOp Op, ValueType T>
+Value unary_kernel(const Value& v) {
+    using PT = typename Payload<T>::type;
+    if constexpr (std::is_void_v<PT>) {
+        switch (Op) {
+            case UnaryOp::Neg: return -v;
+            case UnaryOp::Not: return !v;
+            case UnaryOp::BitNot: return ~v;
+        }
+        return Value();
+    } else if constexpr (Op == UnaryOp::Not) {
+        if constexpr (std::is_same_v<PT, bool>) return Value(!v.unchecked<bool>());
+        else throw std::runtime_error("Logical NOT requires a boolean");
+    } else if constexpr (std::is_integral_v<PT>) {
+        if constexpr (Op == UnaryOp::Neg) return Value(std::negate<>()(v.unchecked<PT>()));
+        else return Value(std::bit_not<>()(v.unchecked<PT>()));
+    } else {
+        throw std::runtime_error("Invalid operand for unary operator");
+    }
+}
+
+template <std::size_t... I>
+constexpr auto make_binary_kernels(std::index_sequence<I...>) {
+    return std::array<BinaryKernel, sizeof...(I)>{{
+        &binary_kernel<static_cast<BinaryOp>(I / (kValueTypeCount * kValueTypeCount)),
+                       static_cast<ValueType>(I / kValueTypeCount % kValueTypeCount),
+                       static_cast<ValueType>(I % kValueTypeCount)>...
+    }};
+}
+
+template <std::size_t... I>
+constexpr auto make_unary_kernels(std::index_sequence<I...>) {
+    return std::array<UnaryKernel, sizeof...(I)>{{
+        &unary_kernel<static_cast<UnaryOp>(I / kValueTypeCount), static_cast<ValueType>(I % kValueTypeCount)>...
+    }};
+}
+
+} // namespace
+
+const std::array<BinaryKernel, kBinaryOpCount * kValueTypeCount * kValueTypeCount> binary_kernels =
+    make_binary_kernels(std::make_index_sequence<kBinaryOpCount * kValueTypeCount * kValueTypeCount>());
+
+const std::array<UnaryKernel, kUnaryOpCount * kValueTypeCount> unary_kernels =
+    make_unary_kernels(std::make_index_sequence<kUnaryOpCount * kValueTypeCount>());
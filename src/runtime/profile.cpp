@@ -0,0 +1,141 @@
+#include "profile.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <ctime>
+#include <sys/time.h>
+#include <utility>
+
+volatile std::sig_atomic_t Profiler::ticks = 0;
+
+namespace {
+
+double cpu_now() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+} // namespace
+
+void Profiler::on_tick(int) { ticks = ticks + 1; }
+
+void Profiler::start() {
+    line_starts.assign(1, 0);
+    for (std::size_t i = 0; i < source.size(); ++i)
+        if (source[i] == '\n') line_starts.push_back(static_cast<std::uint32_t>(i + 1));
+
+    struct sigaction action {};
+    action.sa_handler = on_tick;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, nullptr);
+    itimerval timer{{0, kIntervalUs}, {0, kIntervalUs}};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    cpu_secs = cpu_now();
+    running = true;
+}
+
+void Profiler::stop() {
+    if (!running) return;
+    running = false;
+    itimerval off{};
+    setitimer(ITIMER_PROF, &off, nullptr);
+    signal(SIGPROF, SIG_DFL);
+    cpu_secs = cpu_now() - cpu_secs;
+    if (ticks) sample(); // what ran after the last statement started
+}
+
+void Profiler::at(const Node* stmt) {
+    if (ticks) sample();
+    std::size_t depth = call_stack.size();
+    if (depth >= where.size()) where.resize(depth + 1, kNowhere);
+    where[depth] = stmt->offset;
+}
+
+std::size_t Profiler::line_of(std::uint32_t offset) const {
+    return std::upper_bound(line_starts.begin(), line_starts.end(), offset) - line_starts.begin();
+}
+
+std::string_view Profiler::line_text(std::size_t line) const {
+    std::size_t begin = line_starts[line - 1];
+    std::size_t end = line < line_starts.size() ? line_starts[line] - 1 : source.size();
+    std::string_view text = source.substr(begin, end - begin);
+    std::size_t first = text.find_first_not_of(" \t");
+    return first == std::string_view::npos ? std::string_view() : text.substr(first);
+}
+
+// Charges the ticks counted since the last sample to the stack as it is now:
+// self time to the innermost call and its statement, total time once to
+// every subroutine and line on the stack, however often it recurs
+void Profiler::sample() {
+    long n = ticks;
+    ticks = 0;
+    samples += n;
+    std::size_t depth = call_stack.size();
+    seen_subrs.clear();
+    seen_lines.clear();
+    std::string stack = "<top>";
+    for (std::size_t d = 0; d <= depth; ++d) {
+        Symbol subr = d ? call_stack[d - 1] : Symbol{};
+        if (d) {
+            stack += ';';
+            stack += subr.str();
+        }
+        seen_subrs.push_back(subr);
+        std::uint32_t offset = d < where.size() ? where[d] : kNowhere;
+        if (offset != kNowhere) seen_lines.push_back(line_of(offset));
+    }
+    subrs[seen_subrs.back()].self += n;
+    std::uint32_t innermost = depth < where.size() ? where[depth] : kNowhere;
+    if (innermost != kNowhere) lines[line_of(innermost)].self += n;
+
+    std::sort(seen_subrs.begin(), seen_subrs.end(), [](Symbol a, Symbol b) { return a.id < b.id; });
+    seen_subrs.erase(std::unique(seen_subrs.begin(), seen_subrs.end()), seen_subrs.end());
+    for (Symbol s : seen_subrs) subrs[s].total += n;
+    std::sort(seen_lines.begin(), seen_lines.end());
+    seen_lines.erase(std::unique(seen_lines.begin(), seen_lines.end()), seen_lines.end());
+    for (std::size_t line : seen_lines) lines[line].total += n;
+    stacks[stack] += n;
+}
+
+namespace {
+
+template <typename Key, typename Count>
+std::vector<std::pair<Key, Count>> by_self(const std::unordered_map<Key, Count>& counts) {
+    std::vector<std::pair<Key, Count>> rows(counts.begin(), counts.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.self != b.second.self ? a.second.self > b.second.self : a.second.total > b.second.total;
+    });
+    return rows;
+}
+
+} // namespace
+
+void Profiler::report(std::ostream& out) const {
+    char buf[160];
+    std::snprintf(buf, sizeof buf, "Profile: %ld samples over %.0f ms of CPU time\n", samples, cpu_secs * 1e3);
+    out << buf;
+    if (!samples) return;
+    auto percent = [&](long n) { return 100.0 * n / samples; };
+
+    out << "   self%  total%  subroutine\n";
+    for (const auto& [subr, count] : by_self(subrs)) {
+        std::snprintf(buf, sizeof buf, "  %6.1f  %6.1f  %s\n", percent(count.self), percent(count.total),
+                      subr.empty() ? "<top>" : subr.str().c_str());
+        out << buf;
+    }
+    out << "   self%  total%  line\n";
+    for (const auto& [line, count] : by_self(lines)) {
+        std::string_view text = line_text(line).substr(0, 60);
+        std::snprintf(buf, sizeof buf, "  %6.1f  %6.1f  %5zu  %.*s\n", percent(count.self), percent(count.total),
+                      line, static_cast<int>(text.size()), text.data());
+        out << buf;
+    }
+}
+
+void Profiler::write_folded(std::ostream& out) const {
+    std::vector<std::pair<std::string, long>> rows(stacks.begin(), stacks.end());
+    std::sort(rows.begin(), rows.end());
+    for (const auto& [stack, count] : rows) out << stack << ' ' << count << '\n';
+}
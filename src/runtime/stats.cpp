@@ -0,0 +1,83 @@
+#include "stats.hpp"
+#include "expr.hpp"
+#include "stmt.hpp"
+#include "interpret.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <ostream>
+
+Stats stats;
+
+#if TOY_STATS
+void* operator new(std::size_t n) {
+    ++stats.allocs[static_cast<int>(stats.phase)];
+    if (void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#endif
+
+namespace {
+
+constexpr const char* kExprNames[] = {"literal", "ident", "binary", "unary", "call"};
+constexpr const char* kStmtNames[] = {"expr", "assign", "assign-op", "inc-dec", "decl", "block", "if",
+                                      "while", "return", "break", "continue", "check", "recheck"};
+static_assert(std::size(kExprNames) == std::size(Stats{}.exprs) &&
+              std::size(kExprNames) == static_cast<std::size_t>(ExprKind::Call) + 1, "one name per ExprKind");
+static_assert(std::size(kStmtNames) == std::size(Stats{}.stmts) &&
+              std::size(kStmtNames) == static_cast<std::size_t>(StmtKind::Recheck) + 1, "one name per StmtKind");
+
+void row(std::ostream& out, const char* label, unsigned long long n, const char* detail = "") {
+    char buf[160];
+    std::snprintf(buf, sizeof buf, "  %-24s %12llu%s\n", label, n, detail);
+    out << buf;
+}
+
+template <std::size_t N>
+void by_kind(std::ostream& out, const char* label, const std::uint64_t (&counts)[N], const char* const (&names)[N]) {
+    unsigned long long total = 0;
+    for (std::uint64_t n : counts) total += n;
+    row(out, label, total);
+    for (std::size_t i = 0; i < N; ++i) {
+        if (!counts[i]) continue;
+        char name[32];
+        std::snprintf(name, sizeof name, "  %s", names[i]);
+        row(out, name, counts[i]);
+    }
+}
+
+} // namespace
+
+void Stats::print(std::ostream& out) const {
+    char detail[96];
+    out << "Statistics:\n";
+    by_kind(out, "expressions evaluated", exprs, kExprNames);
+    by_kind(out, "statements executed", stmts, kStmtNames);
+    std::snprintf(detail, sizeof detail, " (%llu popped, %llu loop reuses)", (unsigned long long)scope_pops,
+                  (unsigned long long)scope_clears);
+    row(out, "scopes pushed", scope_pushes, detail);
+    row(out, "value copies", value_copies);
+    row(out, "variable reads by slot", slot_reads);
+    std::snprintf(detail, sizeof detail, " (%llu entries scanned, %.1f each)", (unsigned long long)names_scanned,
+                  name_lookups ? double(names_scanned) / name_lookups : 0.0);
+    row(out, "lookups by name", name_lookups, detail);
+    std::snprintf(detail, sizeof detail, " (%llu tail calls)", (unsigned long long)tail_calls);
+    row(out, "subroutine calls", calls, detail);
+
+    unsigned long long hits = 0, misses = 0;
+    for (const Subr& s : EvalRuntime::subrs) {
+        hits += s.memo.hits;
+        misses += s.memo.misses;
+    }
+    std::snprintf(detail, sizeof detail, " (%llu misses, %llu resets)", misses,
+                  (unsigned long long)EvalRuntime::memo_resets);
+    row(out, "memo hits", hits, detail);
+    std::snprintf(detail, sizeof detail, " (%llu calls unwound)", (unsigned long long)unwound_calls);
+    row(out, "errors reported", errors, detail);
+    std::snprintf(detail, sizeof detail, " (parse %llu, check %llu, eval %llu)", (unsigned long long)allocs[1],
+                  (unsigned long long)allocs[2], (unsigned long long)allocs[3]);
+    row(out, "heap allocations", allocs[0] + allocs[1] + allocs[2] + allocs[3], detail);
+}
@@ -0,0 +1,642 @@
+#include "vm.hpp"
+#include "error.hpp"
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+
+std::uint16_t SlotTable::intern(Symbol name) {
+    auto it = index.find(name);
+    if (it != index.end()) return it->second;
+    if (names.size() > std::numeric_limits<std::uint16_t>::max())
+        throw RuntimeError("Too many names for the VM: " + name.str());
+    auto slot = static_cast<std::uint16_t>(names.size());
+    index.emplace(name, slot);
+    names.push_back(name);
+    return slot;
+}
+
+Proto* Compiler::new_proto(const std::string& name) {
+    vm.protos.push_back(std::make_unique<Proto>());
+    Proto* p = vm.protos.back().get();
+    p->name = name;
+    return p;
+}
+
+std::uint16_t Compiler::alloc_reg() {
+    if (fn->next_reg >= kConstBit)
+        throw RuntimeError("Too many registers in " + fn->proto->name);
+    int r = fn->next_reg++;
+    if (fn->next_reg > fn->proto->num_regs) fn->proto->num_regs = static_cast<std::uint16_t>(fn->next_reg);
+    return static_cast<std::uint16_t>(r);
+}
+
+std::uint16_t Compiler::constant(const Value& v) {
+    auto& k = fn->proto->constants;
+    for (size_t i = 0; i < k.size(); ++i) {
+        if (k[i].type == v.type && k[i] == v) return static_cast<std::uint16_t>(i);
+    }
+    if (k.size() >= kConstBit)
+        throw RuntimeError("Too many constants in " + fn->proto->name);
+    k.push_back(v);
+    return static_cast<std::uint16_t>(k.size() - 1);
+}
+
+int Compiler::lookup_local(Symbol name) const {
+    for (auto scope = fn->scopes.rbegin(); scope != fn->scopes.rend(); ++scope) {
+        for (const auto& local : scope->locals) {
+            if (local.first == name) return local.second;
+        }
+    }
+    return -1;
+}
+
+std::uint16_t Compiler::declare_local(Symbol name) {
+    for (const auto& local : fn->scopes.back().locals) {
+        if (local.first == name)
+            throw RuntimeError("Variable already declared in this scope: " + name.str());
+    }
+    std::uint16_t r = alloc_reg();
+    fn->scopes.back().locals.emplace_back(name, r);
+    fn->proto->locals.push_back({name, r, static_cast<std::uint32_t>(fn->proto->code.size())});
+    std::uint16_t slot = vm.global_names.intern(name);
+    if (slot >= vm.local_names.size()) vm.local_names.resize(slot + 1, false);
+    vm.local_names[slot] = true;
+    return r;
+}
+
+std::size_t Compiler::emit(Op op, int a, int b, int c) {
+    Instr i;
+    i.op = op;
+    i.a = static_cast<std::uint16_t>(a);
+    i.b = static_cast<std::uint16_t>(b);
+    i.c = static_cast<std::uint16_t>(c);
+    fn->proto->code.push_back(i);
+    return fn->proto->code.size() - 1;
+}
+
+std::size_t Compiler::emit_jump(Op op, int a) {
+    return emit(op, a);
+}
+
+void Compiler::patch_to(std::size_t at, std::size_t target) {
+    fn->proto->code[at].set_target(static_cast<std::uint32_t>(target));
+}
+
+std::unique_ptr<Proto> Compiler::compile(const Node* node) {
+    // The top-level chunk runs once, so unlike subroutines the VM does not
+    // keep it
+    auto proto = std::make_unique<Proto>();
+    proto->name = "<main>";
+    FnState main;
+    main.proto = proto.get();
+    fn = &main;
+    std::uint16_t result = alloc_reg();
+    switch (node->nodeType) {
+        case NodeType::Expr: expr_to(static_cast<const Expr*>(node), result); break;
+        case NodeType::Stmt: stmt(static_cast<const Stmt*>(node), result); break;
+        case NodeType::Decl: decl(static_cast<const Decl*>(node), result); break;
+    }
+    emit(Op::Return, result);
+    fn = nullptr;
+    return proto;
+}
+
+// Register holding the value of `e`: a local's own register, or a fresh
+// temporary the caller releases with free_to
+std::uint16_t Compiler::expr_any(const Expr* e) {
+    if (e->kind == ExprKind::Ident) {
+        int local = lookup_local(static_cast<const IdentExpr*>(e)->name);
+        if (local >= 0) return static_cast<std::uint16_t>(local);
+    }
+    std::uint16_t t = alloc_reg();
+    expr_to(e, t);
+    return t;
+}
+
+// Operand for an RK slot: literals are read straight from the constant pool
+std::uint16_t Compiler::rk(const Expr* e) {
+    if (e->kind == ExprKind::Literal)
+        return constant(static_cast<const LiteralExpr*>(e)->literal) | kConstBit;
+    return expr_any(e);
+}
+
+// The Test op for a comparison, or for its negation when `negate` is set.
+// Value's >, >= and != are !(<=), !(<) and !(==), so the negated test holds
+// exactly when the comparison does not, NaN operands included.
+static bool test_op(BinaryOp op, Op& test, bool negate = false) {
+    switch (op) {
+        case BinaryOp::Eq: test = negate ? Op::TestNe : Op::TestEq; return true;
+        case BinaryOp::Ne: test = negate ? Op::TestEq : Op::TestNe; return true;
+        case BinaryOp::Lt: test = negate ? Op::TestGe : Op::TestLt; return true;
+        case BinaryOp::Le: test = negate ? Op::TestGt : Op::TestLe; return true;
+        case BinaryOp::Gt: test = negate ? Op::TestLe : Op::TestGt; return true;
+        case BinaryOp::Ge: test = negate ? Op::TestLt : Op::TestGe; return true;
+        default: return false;
+    }
+}
+
+// Emits a jump taken when `cond` is false and returns it for patching.
+// Comparisons fuse into a Test + Jump pair instead of materializing a bool.
+std::size_t Compiler::jump_unless(const Expr* cond) {
+    int mark = fn->next_reg;
+    Op test;
+    std::size_t at;
+    if (cond->kind == ExprKind::Binary && test_op(static_cast<const BinaryExpr*>(cond)->op, test)) {
+        auto* b = static_cast<const BinaryExpr*>(cond);
+        std::uint16_t l = rk(b->lhs);
+        std::uint16_t r = rk(b->rhs);
+        emit(test, 0, l, r);
+        at = emit_jump(Op::Jump);
+    } else {
+        at = emit_jump(Op::JumpIfFalse, expr_any(cond));
+    }
+    free_to(mark);
+    return at;
+}
+
+// Emits a jump taken when `cond` is true and returns it for patching
+std::size_t Compiler::jump_if(const Expr* cond) {
+    int mark = fn->next_reg;
+    Op test;
+    std::size_t at;
+    if (cond->kind == ExprKind::Binary && test_op(static_cast<const BinaryExpr*>(cond)->op, test, true)) {
+        auto* b = static_cast<const BinaryExpr*>(cond);
+        std::uint16_t l = rk(b->lhs);
+        std::uint16_t r = rk(b->rhs);
+        emit(test, 0, l, r);
+        at = emit_jump(Op::Jump);
+    } else {
+        at = emit_jump(Op::JumpIfTrue, expr_any(cond));
+    }
+    free_to(mark);
+    return at;
+}
+
+void Compiler::load(Symbol name, int dst) {
+    int local = lookup_local(name);
+    if (local >= 0) {
+        if (local != dst) emit(Op::Move, dst, local);
+    } else {
+        emit(fn->in_subr ? Op::GetName : Op::GetGlobal, dst, vm.global_names.intern(name));
+    }
+}
+
+void Compiler::store(Symbol name, int src) {
+    int local = lookup_local(name);
+    if (local >= 0) {
+        if (local != src) emit(Op::Move, local, src);
+    } else {
+        emit(fn->in_subr ? Op::SetName : Op::SetGlobal, vm.global_names.intern(name), src);
+    }
+}
+
+static Op binary_op(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::Add: return Op::Add;
+        case BinaryOp::Sub: return Op::Sub;
+        case BinaryOp::Mul: return Op::Mul;
+        case BinaryOp::Div: return Op::Div;
+        case BinaryOp::Eq: return Op::Eq;
+        case BinaryOp::Ne: return Op::Ne;
+        case BinaryOp::Lt: return Op::Lt;
+        case BinaryOp::Le: return Op::Le;
+        case BinaryOp::Gt: return Op::Gt;
+        case BinaryOp::Ge: return Op::Ge;
+        case BinaryOp::And: return Op::And;
+        case BinaryOp::Or: return Op::Or;
+        case BinaryOp::BitAnd: return Op::BitAnd;
+        case BinaryOp::BitOr: return Op::BitOr;
+    }
+    return Op::Add;
+}
+
+static Op unary_op(UnaryOp op) {
+    switch (op) {
+        case UnaryOp::Neg: return Op::Neg;
+        case UnaryOp::Not: return Op::Not;
+        case UnaryOp::BitNot: return Op::BitNot;
+    }
+    return Op::Neg;
+}
+
+void Compiler::expr_to(const Expr* e, int dst) {
+    int mark = fn->next_reg;
+    switch (e->kind) {
+        case ExprKind::Literal:
+            emit(Op::LoadK, dst, constant(static_cast<const LiteralExpr*>(e)->literal));
+            break;
+        case ExprKind::Ident:
+            load(static_cast<const IdentExpr*>(e)->name, dst);
+            break;
+        case ExprKind::Binary: {
+            auto* b = static_cast<const BinaryExpr*>(e);
+            Op op = binary_op(b->op);
+            std::uint16_t l = rk(b->lhs);
+            std::uint16_t r = rk(b->rhs);
+            emit(op, dst, l, r);
+            break;
+        }
+        case ExprKind::Unary: {
+            auto* u = static_cast<const UnaryExpr*>(e);
+            Op op = unary_op(u->op);
+            emit(op, dst, expr_any(u->operand));
+            break;
+        }
+        case ExprKind::Call:
+            call_to(static_cast<const CallExpr*>(e), dst);
+            break;
+    }
+    free_to(mark);
+}
+
+void Compiler::call_to(const CallExpr* c, int dst) {
+    if (c->callee->kind != ExprKind::Ident)
+        throw RuntimeError("Attempted to call a non-function value");
+    Symbol name = static_cast<const IdentExpr*>(c->callee)->name;
+    // The callee's frame starts right after `base`, so the arguments are
+    // evaluated straight into its parameter registers. When nothing is
+    // allocated above `dst`, the result lands there directly.
+    std::uint16_t base = dst + 1 == fn->next_reg ? static_cast<std::uint16_t>(dst) : alloc_reg();
+    for (const auto& arg : c->args) expr_to(arg, alloc_reg());
+    emit(Op::Call, base, vm.subr_names.intern(name), static_cast<int>(c->args.size()));
+    if (base != dst) emit(Op::Move, dst, base);
+}
+
+// Compiles a statement; when dst >= 0 the statement's value (what
+// Evaluator::eval_stmt would return) is left in R[dst]
+void Compiler::stmt(const Stmt* s, int dst) {
+    int mark = fn->next_reg;
+    switch (s->kind) {
+        case StmtKind::ExprStmt: {
+            std::uint16_t t = alloc_reg();
+            expr_to(static_cast<const ExprStmt*>(s)->expr, t);
+            if (dst >= 0) emit(Op::LoadNil, dst);
+            break;
+        }
+        case StmtKind::Assign: {
+            auto* a = static_cast<const AssignStmt*>(s);
+            int local = lookup_local(a->identifier);
+            if (local >= 0) {
+                expr_to(a->rhs, local);
+                if (dst >= 0) emit(Op::Move, dst, local);
+            } else {
+                std::uint16_t t = alloc_reg();
+                expr_to(a->rhs, t);
+                store(a->identifier, t);
+                if (dst >= 0) emit(Op::Move, dst, t);
+            }
+            break;
+        }
+        case StmtKind::AssignOp: {
+            auto* a = static_cast<const AssignOpStmt*>(s);
+            Op op;
+            switch (a->op) {
+                case '+': op = Op::Add; break;
+                case '-': op = Op::Sub; break;
+                case '*': op = Op::Mul; break;
+                case '/': op = Op::Div; break;
+                default: throw RuntimeError(std::string("Unknown assignment operator: ") + a->op + "=");
+            }
+            std::uint16_t rhs = rk(a->rhs);
+            int local = lookup_local(a->identifier);
+            std::uint16_t target = local >= 0 ? static_cast<std::uint16_t>(local) : alloc_reg();
+            if (local < 0) load(a->identifier, target);
+            emit(op, target, target, rhs);
+            if (local < 0) store(a->identifier, target);
+            if (dst >= 0) emit(Op::Move, dst, target);
+            break;
+        }
+        case StmtKind::IncDec: {
+            auto* i = static_cast<const IncDecStmt*>(s);
+            std::uint16_t one = constant(Value(1)) | kConstBit;
+            int local = lookup_local(i->identifier);
+            std::uint16_t target = local >= 0 ? static_cast<std::uint16_t>(local) : alloc_reg();
+            if (local < 0) load(i->identifier, target);
+            emit(i->op == '+' ? Op::Add : Op::Sub, target, target, one);
+            if (local < 0) store(i->identifier, target);
+            if (dst >= 0) emit(Op::Move, dst, target);
+            break;
+        }
+        case StmtKind::Decl:
+            // A declared local keeps its register until the enclosing block ends
+            decl(static_cast<const DeclStmt*>(s)->decl, dst);
+            return;
+        case StmtKind::Block:
+            block(static_cast<const BlockStmt*>(s), dst);
+            break;
+        case StmtKind::If: {
+            auto* i = static_cast<const IfStmt*>(s);
+            std::size_t to_else = jump_unless(i->cond);
+            stmt(i->then_branch, dst);
+            std::size_t to_end = emit_jump(Op::Jump);
+            patch(to_else);
+            if (i->else_branch) stmt(i->else_branch, dst);
+            else if (dst >= 0) emit(Op::LoadNil, dst);
+            patch(to_end);
+            break;
+        }
+        case StmtKind::While: {
+            auto* w = static_cast<const WhileStmt*>(s);
+            if (dst >= 0) emit(Op::LoadNil, dst);
+            // The condition is tested again after the body, which jumps back
+            // to the body's start while it holds: one dispatch per iteration
+            // instead of a test plus a Jump back to the top. A continue still
+            // goes to the test at the top.
+            std::size_t top = fn->proto->code.size();
+            std::size_t to_end = jump_unless(w->cond);
+            std::size_t body = fn->proto->code.size();
+            fn->loops.push_back({top, {}});
+            loop_body(w->body, dst);
+            std::size_t back = jump_if(w->cond);
+            patch_to(back, body);
+            if (dst < 0) fuse_step(w->body, back);
+            patch(to_end);
+            end_loop();
+            break;
+        }
+        case StmtKind::Return: {
+            auto* r = static_cast<const ReturnStmt*>(s);
+            if (!fn->in_subr)
+                throw RuntimeError("return outside of a subroutine");
+            if (r->expr && r->expr->kind == ExprKind::Call) {
+                // `return f(...)` reuses this frame, as the evaluator does
+                auto* c = static_cast<const CallExpr*>(r->expr);
+                if (c->callee->kind != ExprKind::Ident)
+                    throw RuntimeError("Attempted to call a non-function value");
+                std::uint16_t base = alloc_reg();
+                for (const auto& arg : c->args) expr_to(arg, alloc_reg());
+                emit(Op::TailCall, base, vm.subr_names.intern(static_cast<const IdentExpr*>(c->callee)->name),
+                     static_cast<int>(c->args.size()));
+                if (r->slot.checked()) emit(Op::Return, base, static_cast<int>(r->slot.conv));
+            } else if (r->expr) {
+                // Converting a local's own register in place is fine: the
+                // frame ends with the Return
+                std::uint16_t result = expr_any(r->expr);
+                TypeConv conv = r->slot.conv == TypeConv::Store ? TypeConv::Unchecked : r->slot.conv;
+                emit(Op::Return, result, static_cast<int>(conv));
+            } else emit(Op::ReturnNil);
+            break;
+        }
+        case StmtKind::Break:
+            if (fn->loops.empty()) throw RuntimeError("break outside of a loop");
+            fn->loops.back().breaks.push_back(emit_jump(Op::Jump));
+            break;
+        case StmtKind::Continue:
+            if (fn->loops.empty()) throw RuntimeError("continue outside of a loop");
+            patch_to(emit_jump(Op::Jump), fn->loops.back().top);
+            break;
+        case StmtKind::Check:
+            check(static_cast<const CheckStmt*>(s), dst);
+            break;
+        case StmtKind::Recheck:
+            recheck(static_cast<const RecheckStmt*>(s), dst);
+            break;
+    }
+    free_to(mark);
+}
+
+void Compiler::block(const BlockStmt* b, int dst) {
+    int mark = fn->next_reg;
+    fn->scopes.push_back({{}, mark, fn->proto->locals.size()});
+    for (const auto& d : b->decl) if (d) decl(d, -1);
+    if (b->stmts.empty() && dst >= 0) emit(Op::LoadNil, dst);
+    for (size_t i = 0; i < b->stmts.size(); ++i) {
+        // Only the last statement's value is the block's value
+        stmt(b->stmts[i], i + 1 == b->stmts.size() ? dst : -1);
+    }
+    for (std::size_t i = fn->scopes.back().info_base; i < fn->proto->locals.size(); ++i) {
+        LocalInfo& local = fn->proto->locals[i];
+        if (local.end == UINT32_MAX) local.end = static_cast<std::uint32_t>(fn->proto->code.size());
+    }
+    fn->scopes.pop_back();
+    free_to(mark);
+}
+
+// A loop's value only changes when its body completes normally, so the body
+// writes a scratch register that a break or continue jumps past
+void Compiler::loop_body(const Stmt* body, int dst) {
+    int mark = fn->next_reg;
+    if (dst < 0) {
+        stmt(body, -1);
+        return;
+    }
+    std::uint16_t value = alloc_reg();
+    stmt(body, value);
+    emit(Op::Move, dst, value);
+    free_to(mark);
+}
+
+// A body ending in `i++` followed by the loop's test of i, as in
+//   Add i, i, K(1); TestGe i, n; Jump body
+// turns the Add and the Test into one StepGe (and so on for the other
+// Tests). Only an IncDec last in the body qualifies: nothing in the body can
+// then jump to the Test between them.
+void Compiler::fuse_step(const Stmt* body, std::size_t jump) {
+    const Stmt* last = body;
+    if (body->kind == StmtKind::Block) {
+        auto* b = static_cast<const BlockStmt*>(body);
+        if (b->stmts.empty() || b->rturn_stmt) return;
+        last = b->stmts.back();
+    }
+    if (last->kind != StmtKind::IncDec || jump < 2) return;
+    std::vector<Instr>& code = fn->proto->code;
+    Instr& step = code[jump - 2];
+    const Instr& test = code[jump - 1];
+    std::uint16_t one = constant(Value(1)) | kConstBit;
+    if ((step.op != Op::Add && step.op != Op::Sub) || step.a != step.b || step.c != one ||
+        test.op < Op::TestEq || test.op > Op::TestGe || test.b != step.a)
+        return;
+    auto fused = static_cast<Op>(static_cast<int>(Op::StepEq) + (static_cast<int>(test.op) - static_cast<int>(Op::TestEq)));
+    step = {fused, step.a, test.c, step.op == Op::Sub};
+    code.erase(code.begin() + static_cast<std::ptrdiff_t>(jump - 1));
+    // Scopes that ended at the Test now end at the Jump
+    for (LocalInfo& local : fn->proto->locals)
+        local.end = std::min<std::uint32_t>(local.end, static_cast<std::uint32_t>(code.size()));
+}
+
+void Compiler::end_loop() {
+    for (std::size_t j : fn->loops.back().breaks) patch(j);
+    fn->loops.pop_back();
+}
+
+// Mirrors Evaluator::eval_check: arms are compared in order, `only` stops at
+// the first match, and the `then` arm runs when none matched
+void Compiler::check(const CheckStmt* c, int dst) {
+    const CheckArms& arms = c->arms;
+    int mark = fn->next_reg;
+    std::uint16_t value = alloc_reg();
+    expr_to(c->expr, value);
+    if (dst >= 0) emit(Op::LoadNil, dst);
+    if (auto table = ArmTable::build(arms)) {
+        emit(Op::Switch, value, switch_table(std::move(table)));
+        switch_arms(arms, c->execute_first_match, dst, SIZE_MAX);
+        free_to(mark);
+        return;
+    }
+    std::uint16_t matched = alloc_reg();
+    if (arms.else_arm) emit(Op::LoadK, matched, constant(Value(false)));
+    std::vector<std::size_t> to_end;
+    for (const auto& arm : arms.arms) {
+        int arm_mark = fn->next_reg;
+        emit(Op::TestEq, 0, value, rk(arm.first));
+        std::size_t to_next = emit_jump(Op::Jump);
+        free_to(arm_mark);
+        if (arms.else_arm) emit(Op::LoadK, matched, constant(Value(true)));
+        stmt(arm.second, dst);
+        if (c->execute_first_match) to_end.push_back(emit_jump(Op::Jump));
+        patch(to_next);
+    }
+    if (arms.else_arm) {
+        to_end.push_back(emit_jump(Op::JumpIfTrue, matched));
+        stmt(arms.else_arm, dst);
+    }
+    for (std::size_t j : to_end) patch(j);
+    free_to(mark);
+}
+
+std::uint16_t Compiler::switch_table(std::unique_ptr<ArmTable> table) {
+    auto& switches = fn->proto->switches;
+    if (switches.size() > std::numeric_limits<std::uint16_t>::max())
+        throw RuntimeError("Too many check statements in " + fn->proto->name);
+    switches.push_back({std::move(table), {}, 0});
+    return static_cast<std::uint16_t>(switches.size() - 1);
+}
+
+// Arms of a check (loop_top == SIZE_MAX) or recheck dispatched by the
+// Switch just emitted. An arm ends by going on to the next arm with the same
+// value under `on`, or else past the check, or back to the top of a recheck.
+// The `then` arm is the miss target; a recheck without one ends there.
+void Compiler::switch_arms(const CheckArms& arms, bool only, int dst, std::size_t loop_top) {
+    const bool loop = loop_top != SIZE_MAX;
+    const std::size_t index = fn->proto->switches.size() - 1;
+    const ArmTable& table = *fn->proto->switches[index].arms;
+    std::vector<std::uint32_t> targets(arms.arms.size());
+    std::vector<std::pair<std::size_t, std::uint32_t>> to_arm; // jump, arm it goes to
+    std::vector<std::size_t> to_end;
+    for (std::uint32_t i = 0; i < arms.arms.size(); ++i) {
+        targets[i] = static_cast<std::uint32_t>(fn->proto->code.size());
+        if (loop) loop_body(arms.arms[i].second, dst);
+        else stmt(arms.arms[i].second, dst);
+        std::uint32_t next = only ? ArmTable::kNoArm : table.next(i);
+        if (next != ArmTable::kNoArm) to_arm.push_back({emit_jump(Op::Jump), next});
+        else if (loop) patch_to(emit_jump(Op::Jump), loop_top);
+        else to_end.push_back(emit_jump(Op::Jump));
+    }
+    std::uint32_t miss = static_cast<std::uint32_t>(fn->proto->code.size());
+    if (arms.else_arm) {
+        stmt(arms.else_arm, loop ? -1 : dst);
+        if (loop) patch_to(emit_jump(Op::Jump), loop_top);
+    }
+    for (auto [jump, arm] : to_arm) patch_to(jump, targets[arm]);
+    for (std::size_t j : to_end) patch(j);
+    // A recheck's miss without a `then` arm leaves the loop, like break
+    if (loop && !arms.else_arm) miss = static_cast<std::uint32_t>(fn->proto->code.size());
+    SwitchTable& sw = fn->proto->switches[index];
+    sw.targets = std::move(targets);
+    sw.miss = miss;
+}
+
+// Mirrors Evaluator::eval_recheck: the subject and arms are re-run until an
+// iteration matches nothing; a `then` arm runs on such an iteration and loops
+// again
+void Compiler::recheck(const RecheckStmt* r, int dst) {
+    const CheckArms& arms = r->arms;
+    int mark = fn->next_reg;
+    std::uint16_t value = alloc_reg();
+    std::uint16_t matched = alloc_reg();
+    if (dst >= 0) emit(Op::LoadNil, dst);
+    std::size_t top = fn->proto->code.size();
+    expr_to(r->expr, value);
+    if (auto table = ArmTable::build(arms)) {
+        emit(Op::Switch, value, switch_table(std::move(table)));
+        fn->loops.push_back({top, {}});
+        switch_arms(arms, r->execute_first_match, dst, top);
+        end_loop();
+        free_to(mark);
+        return;
+    }
+    emit(Op::LoadK, matched, constant(Value(false)));
+    fn->loops.push_back({top, {}});
+    for (const auto& arm : arms.arms) {
+        int arm_mark = fn->next_reg;
+        emit(Op::TestEq, 0, value, rk(arm.first));
+        std::size_t to_next = emit_jump(Op::Jump);
+        free_to(arm_mark);
+        emit(Op::LoadK, matched, constant(Value(true)));
+        loop_body(arm.second, dst);
+        if (r->execute_first_match) patch_to(emit_jump(Op::Jump), top);
+        patch(to_next);
+    }
+    patch_to(emit_jump(Op::JumpIfTrue, matched), top);
+    if (arms.else_arm) {
+        stmt(arms.else_arm, -1);
+        patch_to(emit_jump(Op::Jump), top);
+    }
+    end_loop();
+    free_to(mark);
+}
+
+void Compiler::decl(const Decl* d, int dst) {
+    switch (d->kind) {
+        case DeclKind::Var:
+            var_decl(static_cast<const VarDecl*>(d));
+            break;
+        case DeclKind::Subr:
+            subr_decl(static_cast<const SubrDecl*>(d));
+            break;
+        default:
+            // Struct/enum/union/tool/kit are not evaluated yet either
+            break;
+    }
+    if (dst >= 0) emit(Op::LoadNil, dst);
+}
+
+void Compiler::var_decl(const VarDecl* v) {
+    if (v->type_name.empty() && !v->init)
+        throw RuntimeError("Variable " + v->name.str() + " needs a type or an initializer");
+    int mark = fn->next_reg;
+    std::uint16_t value = alloc_reg();
+    if (v->init) expr_to(v->init, value); // initializer sees the outer binding
+    if (!v->type_name.empty()) {
+        fn->proto->decls.push_back({v->name, v->type_name, v->slot});
+        emit(Op::DeclInit, value, static_cast<int>(fn->proto->decls.size() - 1), v->init ? 1 : 0);
+    }
+    if (at_top_level()) {
+        emit(Op::DeclGlobal, vm.global_names.intern(v->name), value);
+        free_to(mark);
+    } else {
+        // The initializer register becomes the local itself
+        free_to(mark);
+        std::uint16_t local = declare_local(v->name);
+        if (local != value) emit(Op::Move, local, value);
+    }
+}
+
+void Compiler::subr_decl(const SubrDecl* s) {
+    if (!s->body || s->body->kind != StmtKind::Block)
+        throw RuntimeError("Subroutine " + s->name.str() + " has no body");
+    FnState state;
+    std::size_t index = vm.protos.size();
+    state.proto = new_proto(s->name.str());
+    state.proto->num_params = static_cast<std::uint16_t>(s->params.size());
+    for (const auto& p : s->params) state.proto->params.push_back(p.first);
+    state.proto->param_types = s->param_types;
+    for (const TypeSlot& slot : s->param_types)
+        if (slot.conv != TypeConv::Unchecked && slot.conv != TypeConv::Store) state.proto->converts_args = true;
+    state.proto->ret = s->ret;
+    state.in_subr = true;
+
+    FnState* outer = fn;
+    fn = &state;
+    // Parameters occupy the first registers, in order, like call_subr's
+    // parameter scope
+    fn->scopes.push_back({{}, 0, 0});
+    for (const auto& p : s->params) declare_local(p.first);
+    block(static_cast<const BlockStmt*>(s->body), -1);
+    emit(Op::ReturnNil);
+    fn = outer;
+
+    emit(Op::DefSubr, vm.subr_names.intern(s->name));
+    patch_to(fn->proto->code.size() - 1, index);
+}
@@ -0,0 +1,320 @@
+#include "vm.hpp"
+#include "error.hpp"
+#include "interpret.hpp"
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// The one-type operations of `binary` on its inlined operand types: exactly
+// what the kernels compute, comparisons included, which they build from < and
+// == only (with a NaN operand > and >= are true)
+template <BinaryOp Op, typename T>
+__attribute__((always_inline)) static inline bool inline_binary(Value& dst, T a, T b) {
+    if constexpr (Op == BinaryOp::Add) dst.set(a + b);
+    else if constexpr (Op == BinaryOp::Sub) dst.set(a - b);
+    else if constexpr (Op == BinaryOp::Mul) dst.set(a * b);
+    else if constexpr (Op == BinaryOp::Div && std::is_floating_point_v<T>) dst.set(a / b);
+    else if constexpr (Op == BinaryOp::Eq) dst.set(a == b);
+    else if constexpr (Op == BinaryOp::Ne) dst.set(!(a == b));
+    else if constexpr (Op == BinaryOp::Lt) dst.set(a < b);
+    else if constexpr (Op == BinaryOp::Le) dst.set(a < b || a == b);
+    else if constexpr (Op == BinaryOp::Gt) dst.set(!(a < b || a == b));
+    else if constexpr (Op == BinaryOp::Ge) dst.set(!(a < b));
+    else return false;
+    return true;
+}
+
+// Int-int and double-double arithmetic and comparisons are the bulk of the
+// work in loops; they are inlined here and every other operand pair goes
+// through the kernel table
+template <BinaryOp Op>
+__attribute__((always_inline)) static inline void binary(Value& dst, const Value& l, const Value& r) {
+    if (__builtin_expect(l.type == r.type, 1)) {
+        if (l.type == ValueType::INT) {
+            if (inline_binary<Op>(dst, l.unchecked<int>(), r.unchecked<int>())) return;
+        } else if (l.type == ValueType::DOUBLE) {
+            if (inline_binary<Op>(dst, l.unchecked<double>(), r.unchecked<double>())) return;
+        }
+    }
+    dst = apply(Op, l, r);
+}
+
+// A Test op's comparison: int-int and double-double inline, as the kernels
+// compute them, and Value's operators for everything else
+template <BinaryOp Op>
+__attribute__((always_inline)) static inline bool holds(const Value& l, const Value& r) {
+    if (l.type == r.type && (l.type == ValueType::INT || l.type == ValueType::DOUBLE)) {
+        Value result;
+        if (l.type == ValueType::INT) inline_binary<Op>(result, l.unchecked<int>(), r.unchecked<int>());
+        else inline_binary<Op>(result, l.unchecked<double>(), r.unchecked<double>());
+        return result.unchecked<bool>();
+    }
+    if constexpr (Op == BinaryOp::Eq) return l == r;
+    else if constexpr (Op == BinaryOp::Ne) return l != r;
+    else if constexpr (Op == BinaryOp::Lt) return l < r;
+    else if constexpr (Op == BinaryOp::Le) return l <= r;
+    else if constexpr (Op == BinaryOp::Gt) return l > r;
+    else return l >= r;
+}
+
+// A Step op: x += 1 (x -= 1 if `down`), then x compared with bound
+template <BinaryOp Op>
+__attribute__((always_inline)) static inline bool step(Value& x, const Value& bound, bool down) {
+    if (x.type == ValueType::INT && bound.type == ValueType::INT) {
+        int n = down ? x.unchecked<int>() - 1 : x.unchecked<int>() + 1;
+        x.set(n);
+        Value result;
+        inline_binary<Op>(result, n, bound.unchecked<int>());
+        return result.unchecked<bool>();
+    }
+    const Value one(1);
+    if (down) binary<BinaryOp::Sub>(x, x, one);
+    else binary<BinaryOp::Add>(x, x, one);
+    return holds<Op>(x, bound);
+}
+
+Value VM::run(const Node* node) {
+    std::unique_ptr<Proto> main = Compiler(*this).compile(node);
+    return execute(main.get());
+}
+
+__attribute__((always_inline)) inline void VM::convert_args(const Proto* callee, Value* args) {
+    for (std::size_t r = 0; r < callee->param_types.size(); ++r) {
+        const TypeSlot& slot = callee->param_types[r];
+        // An argument already of a checked parameter's type passes as is
+        if (slot.conv == TypeConv::Check && args[r].type == slot.type) continue;
+        if (!slot.accept(args[r]))
+            EvalRuntime::type_mismatch("argument " + callee->params[r].str() + " of " + callee->name, slot.type,
+                                       args[r].type);
+    }
+}
+
+Value& VM::name_ref(const std::vector<Frame>& frames, const Instr* pc, std::uint16_t slot) {
+    // Names no frame binds, which includes every REPL global that is never
+    // shadowed, go straight to the global
+    if (slot < local_names.size() && local_names[slot]) {
+        Symbol name = global_names.names[slot];
+        for (std::size_t f = frames.size(); f-- > 0;) {
+            const Proto* proto = frames[f].proto;
+            // The instruction being run: the GetName/SetName itself, or the
+            // Call a caller is suspended in
+            const Instr* at = f + 1 == frames.size() ? pc : frames[f].pc;
+            auto offset = static_cast<std::uint32_t>(at - 1 - proto->code.data());
+            for (auto local = proto->locals.rbegin(); local != proto->locals.rend(); ++local) {
+                if (local->name == name && local->start <= offset && offset < local->end)
+                    return stack[frames[f].base + local->reg];
+            }
+        }
+    }
+    if (slot >= global_defined.size() || !global_defined[slot])
+        throw std::runtime_error("Undefined variable: " + global_names.names[slot].str());
+    return globals[slot];
+}
+
+// GCC otherwise merges the handlers' identical dispatch tails into one
+// shared indirect jump, undoing the threading below
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("no-crossjumping", "no-gcse")))
+#endif
+Value VM::execute(const Proto* main) {
+    std::vector<Frame> frames;
+    frames.push_back({main, main->code.data(), 0, 0});
+    if (stack.size() < main->num_regs) stack.resize(main->num_regs);
+
+    const Proto* proto = main;
+    const Instr* code = proto->code.data(); // proto's, kept at hand for jumps
+    const Instr* pc = code;
+    Value* R = stack.data();
+    const Value* K = proto->constants.data();
+
+    // RK operand: constant-pool entry or register
+    auto RK = [&](std::uint16_t x) __attribute__((always_inline)) -> const Value& { return x & kConstBit ? K[x & ~kConstBit] : R[x]; };
+    // Test ops skip the following Jump when the comparison holds
+    auto test = [&](bool holds) __attribute__((always_inline)) { pc = holds ? pc + 1 : code + pc->target(); };
+
+    // Threaded dispatch (GCC's labels as values): every handler ends in its
+    // own indirect jump to the next one, so the branch predictor learns each
+    // opcode's likely successor instead of sharing one jump for all of them
+    static const void* const handlers[] = {
+        &&op_LoadK, &&op_LoadNil, &&op_Move, &&op_GetGlobal, &&op_SetGlobal, &&op_GetName,
+        &&op_SetName, &&op_DeclGlobal, &&op_DeclInit, &&op_Add, &&op_Sub, &&op_Mul, &&op_Div,
+        &&op_Eq, &&op_Ne, &&op_Lt, &&op_Le, &&op_Gt, &&op_Ge, &&op_And, &&op_Or, &&op_BitAnd,
+        &&op_BitOr, &&op_Neg, &&op_Not, &&op_BitNot, &&op_TestEq, &&op_TestNe, &&op_TestLt,
+        &&op_TestLe, &&op_TestGt, &&op_TestGe, &&op_StepEq, &&op_StepNe, &&op_StepLt, &&op_StepLe,
+        &&op_StepGt, &&op_StepGe, &&op_Jump, &&op_JumpIfFalse, &&op_JumpIfTrue, &&op_Switch,
+        &&op_Call, &&op_TailCall, &&op_Return, &&op_ReturnNil, &&op_DefSubr
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == static_cast<std::size_t>(Op::DefSubr) + 1,
+                  "one handler per opcode, in Op's order");
+    const Instr* i; // the instruction being run; its operands are read as used
+    Value result;   // what a Return hands to the caller
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() do { i = pc++; goto *handlers[static_cast<std::size_t>(i->op)]; } while (0)
+
+    try {
+        VM_NEXT();
+        VM_CASE(LoadK) R[i->a] = K[i->b]; VM_NEXT();
+        VM_CASE(LoadNil) R[i->a] = Value(); VM_NEXT();
+        VM_CASE(Move) R[i->a] = R[i->b]; VM_NEXT();
+        VM_CASE(GetGlobal)
+            if (i->b >= global_defined.size() || !global_defined[i->b])
+                throw std::runtime_error("Undefined variable: " + global_names.names[i->b].str());
+            R[i->a] = globals[i->b];
+            VM_NEXT();
+        VM_CASE(SetGlobal)
+            if (i->a >= global_defined.size() || !global_defined[i->a])
+                throw std::runtime_error("Undefined variable: " + global_names.names[i->a].str());
+            globals[i->a] = R[i->b];
+            VM_NEXT();
+        VM_CASE(GetName) R[i->a] = name_ref(frames, pc, i->b); VM_NEXT();
+        VM_CASE(SetName) name_ref(frames, pc, i->a) = R[i->b]; VM_NEXT();
+        VM_CASE(DeclGlobal)
+            if (i->a >= globals.size()) {
+                globals.resize(i->a + 1);
+                global_defined.resize(i->a + 1, false);
+            }
+            if (global_defined[i->a])
+                throw std::runtime_error("Variable already declared in this scope: " + global_names.names[i->a].str());
+            globals[i->a] = R[i->b];
+            global_defined[i->a] = true;
+            VM_NEXT();
+        VM_CASE(DeclInit) {
+            const DeclInfo& d = proto->decls[i->b];
+            if (d.slot.conv == TypeConv::Unchecked)
+                R[i->a] = EvalRuntime::typed_init(d.name, d.type_name, i->c ? &R[i->a] : nullptr);
+            else if (d.slot.conv == TypeConv::Default)
+                R[i->a] = Value::defaultFor(d.slot.type);
+            else if (!d.slot.accept(R[i->a]))
+                EvalRuntime::type_mismatch("initialization of variable " + d.name.str(), d.slot.type, R[i->a].type);
+            VM_NEXT();
+        }
+        VM_CASE(Add) binary<BinaryOp::Add>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(Sub) binary<BinaryOp::Sub>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(Mul) binary<BinaryOp::Mul>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(Div) {
+            const Value& l = RK(i->b);
+            const Value& r = RK(i->c);
+            check_divisor(l, r);
+            if (l.type == ValueType::INT && r.type == ValueType::INT)
+                R[i->a].set(l.unchecked<int>() / r.unchecked<int>());
+            else
+                binary<BinaryOp::Div>(R[i->a], l, r);
+            VM_NEXT();
+        }
+        VM_CASE(Eq) binary<BinaryOp::Eq>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(Ne) binary<BinaryOp::Ne>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(Lt) binary<BinaryOp::Lt>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(Le) binary<BinaryOp::Le>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(Gt) binary<BinaryOp::Gt>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(Ge) binary<BinaryOp::Ge>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(And) binary<BinaryOp::And>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(Or) binary<BinaryOp::Or>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(BitAnd) binary<BinaryOp::BitAnd>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(BitOr) binary<BinaryOp::BitOr>(R[i->a], RK(i->b), RK(i->c)); VM_NEXT();
+        VM_CASE(Neg) R[i->a] = apply(UnaryOp::Neg, R[i->b]); VM_NEXT();
+        VM_CASE(Not) R[i->a] = apply(UnaryOp::Not, R[i->b]); VM_NEXT();
+        VM_CASE(BitNot) R[i->a] = apply(UnaryOp::BitNot, R[i->b]); VM_NEXT();
+        VM_CASE(TestEq) test(holds<BinaryOp::Eq>(RK(i->b), RK(i->c))); VM_NEXT();
+        VM_CASE(TestNe) test(holds<BinaryOp::Ne>(RK(i->b), RK(i->c))); VM_NEXT();
+        VM_CASE(TestLt) test(holds<BinaryOp::Lt>(RK(i->b), RK(i->c))); VM_NEXT();
+        VM_CASE(TestLe) test(holds<BinaryOp::Le>(RK(i->b), RK(i->c))); VM_NEXT();
+        VM_CASE(TestGt) test(holds<BinaryOp::Gt>(RK(i->b), RK(i->c))); VM_NEXT();
+        VM_CASE(TestGe) test(holds<BinaryOp::Ge>(RK(i->b), RK(i->c))); VM_NEXT();
+        VM_CASE(StepEq) test(step<BinaryOp::Eq>(R[i->a], RK(i->b), i->c)); VM_NEXT();
+        VM_CASE(StepNe) test(step<BinaryOp::Ne>(R[i->a], RK(i->b), i->c)); VM_NEXT();
+        VM_CASE(StepLt) test(step<BinaryOp::Lt>(R[i->a], RK(i->b), i->c)); VM_NEXT();
+        VM_CASE(StepLe) test(step<BinaryOp::Le>(R[i->a], RK(i->b), i->c)); VM_NEXT();
+        VM_CASE(StepGt) test(step<BinaryOp::Gt>(R[i->a], RK(i->b), i->c)); VM_NEXT();
+        VM_CASE(StepGe) test(step<BinaryOp::Ge>(R[i->a], RK(i->b), i->c)); VM_NEXT();
+        VM_CASE(Jump) pc = code + i->target(); VM_NEXT();
+        VM_CASE(JumpIfFalse)
+            if (!R[i->a].get<bool>()) pc = code + i->target();
+            VM_NEXT();
+        VM_CASE(JumpIfTrue)
+            if (R[i->a].get<bool>()) pc = code + i->target();
+            VM_NEXT();
+        VM_CASE(Switch) {
+            const SwitchTable& sw = proto->switches[i->b];
+            std::uint32_t arm = sw.arms->first(R[i->a]);
+            pc = code + (arm == ArmTable::kNoArm ? sw.miss : sw.targets[arm]);
+            VM_NEXT();
+        }
+        VM_CASE(Call)
+        VM_CASE(TailCall) {
+            const Proto* callee = i->b < subrs.size() ? subrs[i->b] : nullptr;
+            if (!callee) throw std::runtime_error("Undefined subroutine: " + subr_names.names[i->b].str());
+            if (callee->num_params != i->c)
+                throw std::runtime_error("Argument count mismatch in call to: " + subr_names.names[i->b].str());
+            if (i->op == Op::TailCall && EvalRuntime::tail_callable(proto->ret, callee->ret)) {
+                // The arguments become the first registers of this frame
+                // and the rest are dropped, like the evaluator's frame reuse
+                for (std::size_t r = 0; r < i->c; ++r) R[r] = std::move(R[i->a + 1 + r]);
+                for (std::size_t r = i->c; r < proto->num_regs; ++r) R[r] = Value();
+                if (callee->converts_args) convert_args(callee, R);
+                Frame& frame = frames.back();
+                frame.proto = callee;
+                if (stack.size() < frame.base + callee->num_regs) stack.resize(frame.base + callee->num_regs);
+                proto = callee;
+                pc = code = proto->code.data();
+                R = stack.data() + frame.base;
+                K = proto->constants.data();
+                VM_NEXT();
+            }
+            if (frames.size() > max_depth) // frames[0] is the top-level code
+                throw RecursionError("Maximum recursion depth exceeded in call to: " + subr_names.names[i->b].str());
+            frames.back().pc = pc;
+            std::size_t base = frames.back().base + i->a + 1;
+            if (callee->converts_args) convert_args(callee, stack.data() + base);
+            frames.push_back({callee, callee->code.data(), base, i->a});
+            if (stack.size() < base + callee->num_regs) stack.resize(base + callee->num_regs);
+            proto = callee;
+            pc = code = proto->code.data();
+            R = stack.data() + base;
+            K = proto->constants.data();
+            VM_NEXT();
+        }
+        VM_CASE(ReturnNil)
+            // A bare `return;` from a subroutine declared to return a
+            // value is a TypeError before it runs: this one fell off the end
+            if (proto->ret.checked() && proto->ret.type != ValueType::NONE)
+                EvalRuntime::missing_return(intern(proto->name), proto->ret.type);
+            result = Value();
+            goto leave;
+        VM_CASE(Return)
+            if (static_cast<TypeConv>(i->b) != TypeConv::Unchecked) {
+                TypeSlot slot{proto->ret.type, static_cast<TypeConv>(i->b)};
+                if (!slot.accept(R[i->a])) EvalRuntime::type_mismatch("return from " + proto->name, slot.type, R[i->a].type);
+            }
+            result = std::move(R[i->a]);
+        leave: {
+            const Frame& done = frames.back();
+            // Drop the boxed values in the frame's registers so they are
+            // freed now, as popping the evaluator's scopes does; scalars are
+            // simply overwritten by the next frame
+            for (Value* r = R, *end = R + done.proto->num_regs; r != end; ++r)
+                if (r->type == ValueType::STRING || r->type == ValueType::USERDEFINED) *r = Value();
+            std::uint16_t ret_reg = done.ret_reg;
+            frames.pop_back();
+            if (frames.empty()) return result;
+            const Frame& caller = frames.back();
+            proto = caller.proto;
+            code = proto->code.data();
+            pc = caller.pc;
+            R = stack.data() + caller.base;
+            K = proto->constants.data();
+            R[ret_reg] = std::move(result);
+            VM_NEXT();
+        }
+        VM_CASE(DefSubr)
+            if (i->a >= subrs.size()) subrs.resize(i->a + 1, nullptr);
+            subrs[i->a] = protos[i->target()].get();
+            VM_NEXT();
+#undef VM_CASE
+#undef VM_NEXT
+    } catch (...) {
+        // Leave no stale values behind for the next input
+        for (auto& v : stack) v = Value();
+        throw;
+    }
+}